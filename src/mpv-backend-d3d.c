@@ -12,7 +12,7 @@ void mpvs_render_d3d(struct mpv_source* context)
                                            .w = context->width,
                                            .h = context->height,
                                        } },
-        { MPV_RENDER_PARAM_NEXT_FRAME_INFO, &info }, { MPV_RENDER_PARAM_BLOCK_FOR_TARGET_TIME, &(int) { 1 } }, { 0 }
+        { MPV_RENDER_PARAM_NEXT_FRAME_INFO, &info }, { MPV_RENDER_PARAM_BLOCK_FOR_TARGET_TIME, &(int) { mpvs_block_for_target_time(context) } }, { 0 }
     };
 
     gs_blend_state_push();
@@ -45,7 +45,7 @@ void mpvs_render_d3d_shared(struct mpv_source* context)
                                            .w = context->width,
                                            .h = context->height,
                                        } },
-        { MPV_RENDER_PARAM_NEXT_FRAME_INFO, &info }, { MPV_RENDER_PARAM_BLOCK_FOR_TARGET_TIME, &(int) { 1 } }, { 0 }
+        { MPV_RENDER_PARAM_NEXT_FRAME_INFO, &info }, { MPV_RENDER_PARAM_BLOCK_FOR_TARGET_TIME, &(int) { mpvs_block_for_target_time(context) } }, { 0 }
     };
 
     gs_blend_state_push();
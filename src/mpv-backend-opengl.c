@@ -1,4 +1,6 @@
 #include "mpv-backend.h"
+#include <graphics/matrix4.h>
+#include <math.h>
 
 void mpvs_render_gl(struct mpv_source* context)
 {
@@ -16,7 +18,7 @@ void mpvs_render_gl(struct mpv_source* context)
                                            .w = context->width,
                                            .h = context->height,
                                        } },
-        { MPV_RENDER_PARAM_NEXT_FRAME_INFO, &info }, { MPV_RENDER_PARAM_BLOCK_FOR_TARGET_TIME, &(int) { 1 } }, { 0 }
+        { MPV_RENDER_PARAM_NEXT_FRAME_INFO, &info }, { MPV_RENDER_PARAM_BLOCK_FOR_TARGET_TIME, &(int) { mpvs_block_for_target_time(context) } }, { 0 }
     };
 
     gs_blend_state_push();
@@ -50,3 +52,85 @@ void mpvs_generate_texture_gl(struct mpv_source* context)
     }
     gs_set_render_target(NULL, NULL);
 }
+
+static inline bool mpvs_near(float a, float b)
+{
+    return fabsf(a - b) < 0.5f;
+}
+
+bool mpvs_render_gl_direct(struct mpv_source* context)
+{
+    if (obs_device_type != GS_DEVICE_OPENGL || !context->mpv_gl)
+        return false;
+
+    // mpv writes 8 bit srgb values, anything else needs the texture and the effect
+    gs_texture_t* target = gs_get_render_target();
+    if (!target || gs_get_color_space() != GS_CS_SRGB)
+        return false;
+    enum gs_color_format format = gs_texture_get_color_format(target);
+    if (format != GS_RGBA && format != GS_BGRA && format != GS_BGRX)
+        return false;
+
+    // mpv always fills the whole framebuffer, so the source has to cover the
+    // viewport exactly, which is the case for full screen sources and when
+    // the source is rendered into a filter texture
+    struct gs_rect viewport;
+    struct matrix4 mat;
+    gs_get_viewport(&viewport);
+    gs_matrix_get(&mat);
+    if (viewport.x != 0 || viewport.y != 0 || fabsf(mat.x.y) > 0.001f || fabsf(mat.y.x) > 0.001f)
+        return false;
+    if (!mpvs_near(mat.t.x, 0) || !mpvs_near(mat.t.y, 0) || !mpvs_near(mat.x.x * context->width, (float)viewport.cx) || !mpvs_near(mat.y.y * context->height, (float)viewport.cy))
+        return false;
+
+    GLint fbo = 0;
+    context->_glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &fbo);
+    if (fbo == 0)
+        return false;
+
+    if (!mpvs_watchdog_begin(context, true))
+        return false;
+
+    GLuint currentProgram;
+    context->_glGetIntegerv(GL_CURRENT_PROGRAM, (GLint*)&currentProgram);
+
+    mpv_render_param params[] = {
+        { MPV_RENDER_PARAM_OPENGL_FBO, &(mpv_opengl_fbo) {
+                                           .fbo = fbo,
+                                           .w = viewport.cx,
+                                           .h = viewport.cy,
+                                       } },
+        { MPV_RENDER_PARAM_BLOCK_FOR_TARGET_TIME, &(int) { 0 } }, { 0 }
+    };
+
+    gs_blend_state_push();
+    int result = mpv_render_context_render(context->mpv_gl, params);
+    gs_blend_state_pop();
+    mpvs_watchdog_end(context);
+
+    // obs keeps track of the bound framebuffer and viewport itself
+    context->_glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    gs_set_viewport(viewport.x, viewport.y, viewport.cx, viewport.cy);
+    context->_glUseProgram(currentProgram);
+
+    if (result != 0) {
+        obs_log(LOG_ERROR, "mpv render error: %s", mpv_error_string(result));
+        return false;
+    }
+    return true;
+}
+
+void mpvs_render_gl_nested(struct mpv_source* context)
+{
+    // renders the pending frame into video_buffer from inside video_render,
+    // so the render target obs had bound has to be restored afterwards
+    struct gs_rect viewport;
+    GLint fbo = 0;
+    gs_get_viewport(&viewport);
+    context->_glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &fbo);
+
+    mpvs_watchdog_render(context);
+
+    context->_glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    gs_set_viewport(viewport.x, viewport.y, viewport.cx, viewport.cy);
+}
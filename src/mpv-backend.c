@@ -3,6 +3,10 @@
 #include <obs-module.h>
 #include <util/darray.h>
 #include <util/dstr.h>
+#include <util/platform.h>
+
+// longest time a tick waits for mpv to decode the next frame in untimed mode
+#define MPVS_UNTIMED_TIMEOUT_MS 250
 
 const char* audio_backends[] = {
 #if defined(__linux__)
@@ -38,6 +42,9 @@ static void on_mpvs_render_events(void* ctx)
         context->redraw = true;
     }
     pthread_mutex_unlock(&context->mpv_event_mutex);
+
+    if ((flags & MPV_RENDER_UPDATE_FRAME) && context->frame_event)
+        os_event_signal(context->frame_event);
 }
 
 static void handle_mpvs_events(void* ctx)
@@ -86,6 +93,11 @@ static inline void mpvs_handle_file_loaded(struct mpv_source* context)
         mpvs_init_track(context, info, track);
     }
 
+    // the file has a video track (or cover art), the next tick will create
+    // the render context, see mpvs_source_video_tick
+    if (context->audio_only && context->video_tracks > 1)
+        context->audio_only = false;
+
     // add the default empty sub track
     // empty audio and video don't really work well
     struct mpv_track_info sub_track = { 0 };
@@ -101,11 +113,14 @@ static inline void mpvs_handle_file_loaded(struct mpv_source* context)
     struct dstr str;
     dstr_init(&str);
 
-    dstr_printf(&str, "%d", context->current_video_track);
-    MPV_SEND_COMMAND_ASYNC("set", "vid", str.array);
+    // mpvs_init_video selects the video track once the render context exists
+    if (context->mpv_gl) {
+        dstr_printf(&str, "%d", context->current_video_track);
+        MPV_SEND_COMMAND_ASYNC("set", "vid", str.array);
 
-    dstr_printf(&str, "%d", context->current_video_track);
-    MPV_SEND_COMMAND_ASYNC("set", "vid", str.array);
+        dstr_printf(&str, "%d", context->current_video_track);
+        MPV_SEND_COMMAND_ASYNC("set", "vid", str.array);
+    }
 
     dstr_printf(&str, "%d", context->current_sub_track);
     MPV_SEND_COMMAND_ASYNC("set", "sid", str.array);
@@ -120,7 +135,8 @@ static inline void mpvs_handle_property_change(struct mpv_source* context, mpv_e
 {
     long media_state = os_atomic_load_long(&context->media_state);
     if (strcmp(prop->name, "core-idle") == 0) {
-        if (prop->format == MPV_FORMAT_FLAG) {
+        // in untimed mode mpv is idle between frame steps
+        if (prop->format == MPV_FORMAT_FLAG && !context->untimed) {
             if (*(unsigned*)prop->data && media_state == OBS_MEDIA_STATE_PLAYING)
                 os_atomic_store_long(&context->media_state, OBS_MEDIA_STATE_BUFFERING);
             else
@@ -130,7 +146,8 @@ static inline void mpvs_handle_property_change(struct mpv_source* context, mpv_e
         if (prop->format == MPV_FORMAT_FLAG)
             obs_source_set_muted(context->jack_source, *(unsigned*)prop->data);
     } else if (strcmp(prop->name, "pause") == 0) {
-        if (prop->format == MPV_FORMAT_FLAG) {
+        // mpv pauses after every frame step in untimed mode
+        if (prop->format == MPV_FORMAT_FLAG && !context->untimed) {
             if ((bool)*(unsigned*)prop->data)
                 os_atomic_store_long(&context->media_state, OBS_MEDIA_STATE_PAUSED);
             else
@@ -141,9 +158,27 @@ static inline void mpvs_handle_property_change(struct mpv_source* context, mpv_e
             if (*(unsigned*)prop->data && media_state == OBS_MEDIA_STATE_PLAYING)
                 obs_log(LOG_WARNING, "[%s] Your network is slow or stuck, please wait a bit", obs_source_get_name(context->src));
         }
+    } else if (strcmp(prop->name, "eof-reached") == 0) {
+        // with keep-open mpv holds the last frame at the end of the file,
+        // this is where the dual deck cuts to the prerolled file
+        if (prop->format == MPV_FORMAT_FLAG && context->dual_deck)
+            os_atomic_set_bool(&context->deck_cut_pending, *(unsigned*)prop->data);
+    } else if (strcmp(prop->name, "video-params/alpha") == 0) {
+        // "straight" or "premul" for videos with alpha, unavailable otherwise
+        if (prop->format == MPV_FORMAT_STRING) {
+            const char* alpha = *(char**)prop->data;
+            context->has_alpha = alpha && *alpha;
+        } else {
+            context->has_alpha = false;
+        }
+    } else if (strcmp(prop->name, "playlist-pos") == 0) {
+        if (prop->format == MPV_FORMAT_INT64 && *(int64_t*)prop->data >= 0)
+            os_atomic_set_long(&context->playlist_index, (long)*(int64_t*)prop->data);
     } else if (strcmp(prop->name, "idle-active") == 0) {
         if (prop->format == MPV_FORMAT_FLAG) {
             if (*(unsigned*)prop->data) {
+                // the playlist is done, there's no next file to wait for
+                context->transition_start_ns = 0;
                 os_atomic_store_long(&context->media_state, OBS_MEDIA_STATE_ENDED);
             }
         }
@@ -156,6 +191,7 @@ void mpvs_handle_events(struct mpv_source* context)
         mpv_event* event = mpv_wait_event(context->mpv, 0);
         if (event->event_id == MPV_EVENT_NONE)
             break;
+        mpvs_sync_handle_event(context, event);
 
         if (event->event_id == MPV_EVENT_LOG_MESSAGE) {
             mpv_event_log_message* msg = event->data;
@@ -176,36 +212,66 @@ void mpvs_handle_events(struct mpv_source* context)
             // Retrieve the new video size.
             int64_t w, h;
             if (mpv_get_property(context->mpv, "dwidth", MPV_FORMAT_INT64, &w) >= 0 && mpv_get_property(context->mpv, "dheight", MPV_FORMAT_INT64, &h) >= 0 && w > 0 && h > 0) {
-                context->width = (uint32_t)w;
-                context->height = (uint32_t)h;
-#if defined(WIN32)
-                if (obs_device_type == GS_DEVICE_DIRECT3D_11) {
-                    calc_texture_size(w, h, &context->d3d_width, &context->d3d_height);
-                } else {
-                    context->d3d_height = context->height;
-                    context->d3d_width = context->width;
+                // mpv reconfigures the video output for every file, if the size didn't
+                // change we keep the texture so the last frame stays visible until
+                // the next one is rendered
+                bool same_size = context->video_buffer && context->width == (uint32_t)w && context->height == (uint32_t)h;
+                context->pending_width = context->pending_height = 0;
+                if (!same_size && context->transition_start_ns && context->have_frame) {
+                    // the last frame of the previous file is held in the old
+                    // texture, the tick swaps in the new one with the first
+                    // frame of this file
+                    context->pending_width = (uint32_t)w;
+                    context->pending_height = (uint32_t)h;
+                } else if (!same_size) {
+                    mpvs_set_video_size(context, (uint32_t)w, (uint32_t)h);
                 }
-#else
-                context->d3d_height = context->height;
-                context->d3d_width = context->width;
-#endif
-                context->generate_texture(context);
             }
         } else if (event->event_id == MPV_EVENT_START_FILE) {
+            context->file_loaded = false;
+            // a step that was requested for the previous file never finishes
+            context->untimed_stepping = false;
+            context->untimed_step_ts = 0;
+            mpvs_cue_file_started(context, event->data);
             os_atomic_store_long(&context->media_state, OBS_MEDIA_STATE_OPENING);
             mpvs_set_mpv_properties(context);
+            mpvs_image_file_started(context);
         } else if (event->event_id == MPV_EVENT_FILE_LOADED) {
             context->file_loaded = true;
             os_atomic_store_long(&context->media_state, OBS_MEDIA_STATE_PLAYING);
             mpvs_handle_file_loaded(context);
+            // a file without video never renders a frame that ends the transition
+            if (context->video_tracks <= 1)
+                context->transition_start_ns = 0;
+            mpvs_dormant_file_loaded(context);
+            mpvs_timeshift_file_loaded(context);
+            mpvs_tail_file_loaded(context);
+            if (context->mpv_gl)
+                mpvs_image_prefetch_next(context);
         } else if (event->event_id == MPV_EVENT_END_FILE) {
+            mpv_event_end_file* end_file = event->data;
+            // in gapless mode we keep showing the last frame until the next
+            // file has rendered its first frame, see mpvs_source_video_tick
+            if (context->gapless && end_file->reason == MPV_END_FILE_REASON_EOF)
+                context->transition_start_ns = os_gettime_ns();
+            // a step past the last frame doesn't produce one
+            context->untimed_stepping = false;
             os_atomic_store_long(&context->media_state, OBS_MEDIA_STATE_ENDED);
+        } else if (event->event_id == MPV_EVENT_HOOK && event->reply_userdata == MPVS_YTDL_HOOK) {
+            mpvs_ytdl_handle_hook(context, event->data);
+        } else if (event->event_id == MPV_EVENT_HOOK && event->reply_userdata == MPVS_TIMESHIFT_HOOK) {
+            mpvs_timeshift_handle_hook(context, event->data);
         } else if (event->event_id == MPV_EVENT_COMMAND_REPLY) {
+            if (event->reply_userdata == MPVS_CUE_LOADED)
+                mpvs_cue_entry_added(context, event);
             if (event->reply_userdata == MPVS_PLAYLIST_LOADED) {
+                mpvs_cue_playlist_replaced(context);
                 // make sure that loop/shuffle are set
                 if (context->shuffle)
                     MPV_SEND_COMMAND_ASYNC("playlist-shuffle");
-                MPV_SEND_COMMAND_ASYNC("set", "loop", context->loop ? "inf" : "no");
+                // in dual deck mode each core only has a single file loaded, looping
+                // is handled by the deck so the core must not repeat that file
+                MPV_SEND_COMMAND_ASYNC("set", "loop", context->loop && !context->dual_deck ? "inf" : "no");
                 context->redraw = true;
             }
         }
@@ -215,25 +281,96 @@ void mpvs_handle_events(struct mpv_source* context)
     }
 }
 
-void mpvs_init(struct mpv_source* context)
+void mpvs_set_video_size(struct mpv_source* context, uint32_t width, uint32_t height)
 {
-    if (context->init_failed)
+    context->width = width;
+    context->height = height;
+    context->pending_width = context->pending_height = 0;
+#if defined(WIN32)
+    if (obs_device_type == GS_DEVICE_DIRECT3D_11) {
+        calc_texture_size(width, height, &context->d3d_width, &context->d3d_height);
+    } else {
+        context->d3d_height = context->height;
+        context->d3d_width = context->width;
+    }
+#else
+    context->d3d_height = context->height;
+    context->d3d_width = context->width;
+#endif
+    context->generate_texture(context);
+    context->have_frame = false;
+}
+
+void mpvs_untimed_wait(struct mpv_source* context)
+{
+    if (!context->untimed_stepping || context->untimed_late)
         return;
 
-    if (obs_device_type == GS_DEVICE_OPENGL) {
-        context->render = mpvs_render_gl;
-        context->generate_texture = mpvs_generate_texture_gl;
-    } else if (obs_device_type == GS_DEVICE_DIRECT3D_11) {
-#if defined(WIN32)
-        if (!wgl_init()) {
-            context->init_failed = true;
+    // holding up the tick instead of repeating the last frame keeps the
+    // output frame exact, the timeout only keeps obs responsive if mpv stalls
+    uint64_t deadline = os_gettime_ns() + MPVS_UNTIMED_TIMEOUT_MS * 1000000ULL;
+    while (true) {
+        pthread_mutex_lock(&context->mpv_event_mutex);
+        bool ready = context->redraw;
+        pthread_mutex_unlock(&context->mpv_event_mutex);
+        if (ready)
+            return;
+
+        uint64_t now = os_gettime_ns();
+        if (now >= deadline) {
+            // later ticks don't wait for this step again, it's rendered
+            // whenever mpv has it
+            context->untimed_late = true;
+            context->untimed_timeouts++;
             return;
         }
-#endif
-        context->render = wgl_have_NV_DX_interop ? mpvs_render_d3d_shared : mpvs_render_d3d;
-        context->generate_texture = mpvs_generate_texture_d3d;
+        os_event_timedwait(context->frame_event, (unsigned long)((deadline - now) / 1000000) + 1);
+    }
+}
+
+void mpvs_untimed_frame_check(struct mpv_source* context, bool frame_ready)
+{
+    if (context->untimed_stepping && frame_ready) {
+        context->untimed_stepping = false;
+        context->untimed_frames++;
     }
+}
+
+void mpvs_untimed_step(struct mpv_source* context)
+{
+    if (!context->untimed || context->untimed_paused || !context->file_loaded || !context->mpv_gl || context->untimed_stepping)
+        return;
 
+    // a frame that wasn't rendered yet (e.g. the first one of a file) is shown
+    // before stepping, otherwise it would be skipped
+    pthread_mutex_lock(&context->mpv_event_mutex);
+    bool pending = context->redraw;
+    pthread_mutex_unlock(&context->mpv_event_mutex);
+    if (pending)
+        return;
+
+    // exactly one step per obs frame, also when obs skipped frames, so every
+    // frame of the video is shown once
+    uint64_t ts = obs_get_video_frame_time();
+    if (ts == context->untimed_step_ts)
+        return;
+    context->untimed_step_ts = ts;
+    context->untimed_stepping = true;
+    context->untimed_late = false;
+    MPV_SEND_COMMAND_ASYNC("frame-step");
+}
+
+void mpvs_set_callbacks(struct mpv_source* context)
+{
+    if (!context->mpv)
+        return;
+    mpv_set_wakeup_callback(context->mpv, handle_mpvs_events, context);
+    if (context->mpv_gl)
+        mpv_render_context_set_update_callback(context->mpv_gl, on_mpvs_render_events, context);
+}
+
+void mpvs_load_gl_functions(struct mpv_source* context)
+{
     context->_glGenFramebuffers = (PFNGLGENFRAMEBUFFERSPROC)GLAD_GET_PROC_ADDR("glGenFramebuffers");
     context->_glDeleteFramebuffers = (PFNGLDELETEFRAMEBUFFERSPROC)GLAD_GET_PROC_ADDR("glDeleteFramebuffers");
     context->_glBindFramebuffer = (PFNGLBINDFRAMEBUFFERPROC)GLAD_GET_PROC_ADDR("glBindFramebuffer");
@@ -246,25 +383,120 @@ void mpvs_init(struct mpv_source* context)
     context->_glTexParameteri = (PFNGLTEXPARAMETERIPROC)GLAD_GET_PROC_ADDR("glTexParameteri");
     context->_glDeleteTextures = (PFNGLDELETETEXTURESPROC)GLAD_GET_PROC_ADDR("glDeleteTextures");
     context->_glTexImage2D = (PFNGLTEXIMAGE2DPROC)GLAD_GET_PROC_ADDR("glTexImage2D");
+}
 
-    context->width = 64; // doesn't matter, this'll change once mpv loads a file and tells us the size
-    context->height = 64;
-    context->d3d_width = 64;
-    context->d3d_height = 64;
-    context->generate_texture(context);
+void mpvs_swap_core(struct mpv_source* a, struct mpv_source* b)
+{
+    pthread_mutex_lock(&a->mpv_event_mutex);
+    pthread_mutex_lock(&b->mpv_event_mutex);
+    MPVS_SWAP(mpv_handle*, a->mpv, b->mpv);
+    MPVS_SWAP(mpv_render_context*, a->mpv_gl, b->mpv_gl);
+    MPVS_SWAP(gs_texture_t*, a->video_buffer, b->video_buffer);
+    MPVS_SWAP(GLuint, a->fbo, b->fbo);
+    MPVS_SWAP(GLuint, a->wgl_texture, b->wgl_texture);
+#if defined(WIN32)
+    MPVS_SWAP(HANDLE, a->gl_shared_texture_handle, b->gl_shared_texture_handle);
+#endif
+    MPVS_SWAP(mpvs_platform_callback_t*, a->render, b->render);
+    MPVS_SWAP(mpvs_platform_callback_t*, a->generate_texture, b->generate_texture);
+    MPVS_SWAP(uint32_t, a->width, b->width);
+    MPVS_SWAP(uint32_t, a->height, b->height);
+    MPVS_SWAP(uint32_t, a->d3d_width, b->d3d_width);
+    MPVS_SWAP(uint32_t, a->d3d_height, b->d3d_height);
+    MPVS_SWAP(uint32_t, a->pending_width, b->pending_width);
+    MPVS_SWAP(uint32_t, a->pending_height, b->pending_height);
+    MPVS_SWAP(bool, a->init, b->init);
+    MPVS_SWAP(bool, a->audio_only, b->audio_only);
+    MPVS_SWAP(bool, a->file_loaded, b->file_loaded);
+    MPVS_SWAP(bool, a->have_frame, b->have_frame);
+    MPVS_SWAP(bool, a->has_alpha, b->has_alpha);
+    MPVS_SWAP(struct darray, a->tracks.da, b->tracks.da);
+    MPVS_SWAP(int, a->audio_tracks, b->audio_tracks);
+    MPVS_SWAP(int, a->video_tracks, b->video_tracks);
+    MPVS_SWAP(int, a->sub_tracks, b->sub_tracks);
+    MPVS_SWAP(size_t, a->cache_forward_applied, b->cache_forward_applied);
+    MPVS_SWAP(size_t, a->cache_back_applied, b->cache_back_applied);
+    a->redraw = true;
+    a->new_events = true;
+    b->redraw = true;
+    b->new_events = true;
+    pthread_mutex_unlock(&b->mpv_event_mutex);
+    pthread_mutex_unlock(&a->mpv_event_mutex);
+
+    // mpv calls these from its own threads while holding internal locks,
+    // so they can't be updated while we're holding the event mutexes
+    mpvs_set_callbacks(a);
+    mpvs_set_callbacks(b);
+}
 
-    context->mpv = mpv_create();
+void mpvs_free_core(struct mpv_source* context)
+{
+    obs_enter_graphics();
+    mpv_render_context_free(context->mpv_gl);
+    if (context->video_buffer) {
+        if (context->fbo)
+            context->_glDeleteFramebuffers(1, &context->fbo);
+        gs_texture_destroy(context->video_buffer);
+    }
+#if defined(WIN32)
+    // on d3d mpv renders to a separate gl texture, with opengl we just use the
+    // texture that obs created
+    if (obs_device_type == GS_DEVICE_DIRECT3D_11 && context->wgl_texture)
+        context->_glDeleteTextures(1, &context->wgl_texture);
+#endif
+    obs_leave_graphics();
+    // mpv_destroy can block for a long time, the reaper waits for it instead
+    mpvs_reaper_queue(context->mpv, context->src ? obs_source_get_name(context->src) : NULL);
 
-    MPV_SET_OPTION("audio-client-name", "OBS");
+    for (size_t i = 0; i < context->tracks.num; i++)
+        destroy_mpv_track_info(&context->tracks.array[i]);
+    da_free(context->tracks);
+
+    context->mpv = NULL;
+    context->mpv_gl = NULL;
+    context->video_buffer = NULL;
+    context->fbo = 0;
+    context->wgl_texture = 0;
+    context->init = false;
+    context->file_loaded = false;
+    context->have_frame = false;
+    context->pending_width = context->pending_height = 0;
+    // a load that waited for a resolved URL went away with the core
+    context->ytdl_hook_pending = false;
+    context->ytdl_hooked = false;
+    context->timeshift_hooked = false;
+    context->cache_forward_applied = 0;
+    context->cache_back_applied = 0;
+    mpvs_sync_core_freed(context);
+}
 
-    int result = mpv_initialize(context->mpv) < 0;
-    if (result < 0) {
-        obs_log(LOG_ERROR, "Failed to initialize mpv context: %s", mpv_error_string(result));
-        context->init_failed = true;
-        return;
+bool mpvs_init_video(struct mpv_source* context)
+{
+    if (context->mpv_gl)
+        return true;
+
+    if (obs_device_type == GS_DEVICE_OPENGL) {
+        context->render = mpvs_render_gl;
+        context->generate_texture = mpvs_generate_texture_gl;
+    } else if (obs_device_type == GS_DEVICE_DIRECT3D_11) {
+#if defined(WIN32)
+        if (!wgl_init()) {
+            context->init_failed = true;
+            return false;
+        }
+#endif
+        context->render = wgl_have_NV_DX_interop ? mpvs_render_d3d_shared : mpvs_render_d3d;
+        context->generate_texture = mpvs_generate_texture_d3d;
     }
 
-    mpv_request_log_messages(context->mpv, MPV_LOG_LEVEL);
+    mpvs_load_gl_functions(context);
+
+    context->width = 64; // doesn't matter, this'll change once mpv loads a file and tells us the size
+    context->height = 64;
+    context->d3d_width = 64;
+    context->d3d_height = 64;
+    context->generate_texture(context);
+    context->have_frame = false;
 
     mpv_render_param params[] = {
         { MPV_RENDER_PARAM_API_TYPE, MPV_RENDER_API_TYPE_OPENGL },
@@ -274,22 +506,65 @@ void mpvs_init(struct mpv_source* context)
         { MPV_RENDER_PARAM_ADVANCED_CONTROL, &(int) { 1 } }, { 0 }
     };
 
-    result = mpv_render_context_create(&context->mpv_gl, context->mpv, params);
+    mpvs_shader_cache_begin(context);
+    int result = mpv_render_context_create(&context->mpv_gl, context->mpv, params);
     if (result != 0) {
         obs_log(LOG_ERROR, "Failed to initialize mpvs GL context: %s", mpv_error_string(result));
         context->init_failed = true;
+        return false;
+    }
+    mpv_render_context_set_update_callback(context->mpv_gl, on_mpvs_render_events, context);
+
+    // video was turned off while the source was playing audio only
+    if (context->init) {
+        struct dstr str = { 0 };
+        dstr_printf(&str, "%d", context->current_video_track);
+        MPV_SET_PROP_STR("vid", context->current_video_track > 0 ? str.array : "auto");
+        dstr_free(&str);
+        obs_log(LOG_INFO, "[%s] Found a video track, switching to video playback", obs_source_get_name(context->src));
+    }
+    return true;
+}
+
+void mpvs_init(struct mpv_source* context)
+{
+    if (context->init_failed)
+        return;
+
+    context->mpv = mpv_create();
+    mpvs_shader_cache_apply(context);
+
+    MPV_SET_OPTION("audio-client-name", "OBS");
+
+    int result = mpv_initialize(context->mpv) < 0;
+    if (result < 0) {
+        obs_log(LOG_ERROR, "Failed to initialize mpv context: %s", mpv_error_string(result));
+        context->init_failed = true;
         return;
     }
 
-    mpv_set_wakeup_callback(context->mpv, handle_mpvs_events, context);
-    mpv_render_context_set_update_callback(context->mpv_gl, on_mpvs_render_events, context);
+    mpv_request_log_messages(context->mpv, MPV_LOG_LEVEL);
+    mpvs_http_register(context);
+    mpvs_bundle_register(context);
+    mpvs_ytdl_register(context);
+    mpvs_timeshift_register(context);
+
+    // audio only playlists don't need a render context, it's created once a
+    // file with a video track shows up
+    if (!context->audio_only && !mpvs_init_video(context))
+        return;
+
+    mpvs_set_callbacks(context);
 
     mpv_observe_property(context->mpv, 0, "playback-time", MPV_FORMAT_DOUBLE);
+    mpv_observe_property(context->mpv, 0, "playlist-pos", MPV_FORMAT_INT64);
     mpv_observe_property(context->mpv, 0, "mute", MPV_FORMAT_FLAG);
     mpv_observe_property(context->mpv, 0, "core-idle", MPV_FORMAT_FLAG);
     mpv_observe_property(context->mpv, 0, "idle-active", MPV_FORMAT_FLAG);
     mpv_observe_property(context->mpv, 0, "pause", MPV_FORMAT_FLAG);
     mpv_observe_property(context->mpv, 0, "paused-for-cache", MPV_FORMAT_FLAG);
+    mpv_observe_property(context->mpv, 0, "eof-reached", MPV_FORMAT_FLAG);
+    mpv_observe_property(context->mpv, 0, "video-params/alpha", MPV_FORMAT_STRING);
 
     if (context->queued_temp_playlist_file_path) {
         mpvs_load_file(context, context->queued_temp_playlist_file_path);
@@ -354,34 +629,62 @@ void mpvs_init_track(struct mpv_source* context, struct mpv_track_info* info, mp
         }
     }
 
-    struct dstr track_name;
-    dstr_init(&track_name);
     switch (info->type) {
     case MPV_TRACK_TYPE_AUDIO:
         context->audio_tracks++;
-        if (!info->title) {
-            dstr_catf(&track_name, "Audio track %" PRIu64, info->id);
-            info->title = bstrdup(track_name.array);
-        }
         break;
     case MPV_TRACK_TYPE_VIDEO:
         context->video_tracks++;
-        if (!info->title) {
-            dstr_catf(&track_name, "Video track %" PRIu64, info->id);
-            info->title = bstrdup(track_name.array);
-        }
         break;
     case MPV_TRACK_TYPE_SUB:
         context->sub_tracks++;
-        if (!info->title) {
+        break;
+    }
+    mpvs_set_default_track_title(info);
+}
 
-            dstr_catf(&track_name, "Subtitle track %" PRIu64, info->id);
-            if (info->lang)
-                dstr_catf(&track_name, " (%s)", info->lang);
-            info->title = bstrdup(track_name.array);
-        }
+bool mpvs_has_extension(const char* path, const char* extensions)
+{
+    const char* ext = os_get_path_extension(path);
+    if (!ext || !ext[1])
+        return false;
+
+    // extension lists look like "*.mp4;*.mkv"
+    struct dstr list = { 0 }, pattern = { 0 };
+    dstr_printf(&list, "%s;", extensions);
+    dstr_printf(&pattern, "*%s;", ext);
+    bool result = astrstri(list.array, pattern.array) != NULL;
+    dstr_free(&list);
+    dstr_free(&pattern);
+    return result;
+}
+
+void mpvs_edl_append(struct dstr* edl, const char* str)
+{
+    dstr_catf(edl, "%%%zu%%%s", strlen(str), str);
+}
+
+void mpvs_set_default_track_title(struct mpv_track_info* info)
+{
+    if (info->title)
+        return;
+
+    struct dstr track_name;
+    dstr_init(&track_name);
+    switch (info->type) {
+    case MPV_TRACK_TYPE_AUDIO:
+        dstr_catf(&track_name, "Audio track %" PRIu64, info->id);
+        break;
+    case MPV_TRACK_TYPE_VIDEO:
+        dstr_catf(&track_name, "Video track %" PRIu64, info->id);
+        break;
+    case MPV_TRACK_TYPE_SUB:
+        dstr_catf(&track_name, "Subtitle track %" PRIu64, info->id);
+        if (info->lang)
+            dstr_catf(&track_name, " (%s)", info->lang);
         break;
     }
+    info->title = bstrdup(track_name.array);
     dstr_free(&track_name);
 }
 
@@ -394,6 +697,22 @@ void mpvs_load_file(struct mpv_source* context, const char* playlist_file)
         obs_log(LOG_ERROR, "Failed to load file: %s, %s", playlist_file, mpv_error_string(result));
 }
 
+void mpvs_media_play_pause(struct mpv_source* context, bool pause)
+{
+    mpvs_loop_cache_reset(context, !pause);
+
+    // mpv stays paused in untimed mode, the tick stops stepping instead
+    if (context->untimed) {
+        context->untimed_paused = pause;
+        context->untimed_step_ts = 0;
+        os_atomic_store_long(&context->media_state, pause ? OBS_MEDIA_STATE_PAUSED : OBS_MEDIA_STATE_PLAYING);
+        return;
+    }
+    if (mpvs_sync_play_pause(context, pause))
+        return;
+    mpv_set_property_string(context->mpv, "pause", pause ? "yes" : "no");
+}
+
 void mpvs_set_mpv_properties(struct mpv_source* context)
 {
     // By default mpv will wait in the render callback to exactly hit
@@ -401,6 +720,48 @@ void mpvs_set_mpv_properties(struct mpv_source* context)
     // at whatever frame rate obs is using
     MPV_SET_PROP_STR("video-timing-offset", "0");
 
+    // Opens the demuxer of the next playlist entry while the current one
+    // is still playing, so advancing the playlist doesn't have to wait for it
+    MPV_SET_PROP_STR("prefetch-playlist", context->gapless ? "yes" : "no");
+    MPV_SET_PROP_STR("gapless-audio", context->gapless ? "yes" : "weak");
+
+    // The dual deck needs the last frame to stay around until it cuts to the
+    // other core, so the file must not be closed when it reaches its end
+    MPV_SET_PROP_STR("keep-open", context->dual_deck ? "yes" : "no");
+
+    // Keep the alpha channel of the video instead of blending it with a
+    // checkerboard, the output is premultiplied which is what we draw with
+    MPV_SET_PROP_STR("alpha", "yes");
+
+    // Slaves mpv to the obs frame rate, mpv resamples the video to it and
+    // corrects the difference to the real frame rate by adjusting the playback
+    // speed, so frames are delivered at the obs frame cadence without judder
+    if (context->obs_clock && !context->untimed) {
+        struct obs_video_info ovi;
+        if (context->init && obs_get_video_info(&ovi) && ovi.fps_den) {
+            char fps[32];
+            snprintf(fps, sizeof(fps), "%f", (double)ovi.fps_num / ovi.fps_den);
+            // display-fps was renamed in mpv 0.36
+            if (mpv_set_property_string(context->mpv, "display-fps-override", fps) < 0)
+                MPV_SET_PROP_STR("display-fps", fps);
+        }
+        MPV_SET_PROP_STR("video-sync", "display-resample");
+    } else {
+        MPV_SET_PROP_STR("video-sync", "audio");
+    }
+
+    // Untimed mode steps through the video frame by frame, audio can't follow that
+    if (context->untimed) {
+        MPV_SET_PROP_STR("pause", "yes");
+        MPV_SET_PROP_STR("aid", "no");
+    }
+
+    mpvs_timeshift_set_properties(context);
+
+    // without a render context mpv would fail to initialize the video output
+    if (!context->mpv_gl)
+        MPV_SET_PROP_STR("vid", "no");
+
     // We only want to auto connect if internal audio control is on
     if (mpvs_have_jack_capture_source) {
         if (context->audio_backend < 0 && context->jack_port_name)
@@ -6,6 +6,10 @@
 
 enum mpv_command_replies {
     MPVS_PLAYLIST_LOADED = 0x10000,
+    MPVS_SYNC_SEEK_DONE,
+    MPVS_YTDL_HOOK,
+    MPVS_CUE_LOADED,
+    MPVS_TIMESHIFT_HOOK,
 };
 
 enum mpv_track_type {
@@ -99,6 +103,13 @@ extern size_t audio_backends_count;
             obs_log(LOG_ERROR, "Failed to set mpv option %s: %s", name, mpv_error_string(__mpv_result)); \
     } while (0)
 
+#define MPVS_SWAP(type, a, b) \
+    do {                      \
+        type __tmp = a;       \
+        a = b;                \
+        b = __tmp;            \
+    } while (0)
+
 /* MPV util functions ------------------------------------------------------ */
 
 static inline void destroy_mpv_track_info(struct mpv_track_info* track)
@@ -157,6 +168,29 @@ static inline void mpvs_set_audio_backend(struct mpv_source* context, int backen
     MPV_SET_OPTION("ao", audio_backends[backend]);
 }
 
+// mpv only has to wait for the target time of a frame when it's paced by its
+// own clock, otherwise the next frame is due with the next obs frame
+static inline int mpvs_block_for_target_time(struct mpv_source* context)
+{
+    return !context->untimed && !context->obs_clock && context->render_mode == MPVS_RENDER_NORMAL;
+}
+
+// the core is freed and swapped in the video thread, media controls and proc
+// handlers hold it while they use it from other threads
+static inline bool mpvs_core_acquire(struct mpv_source* context)
+{
+    pthread_mutex_lock(&context->core_mutex);
+    if (context->init && context->mpv)
+        return true;
+    pthread_mutex_unlock(&context->core_mutex);
+    return false;
+}
+
+static inline void mpvs_core_release(struct mpv_source* context)
+{
+    pthread_mutex_unlock(&context->core_mutex);
+}
+
 static inline int mpvs_mpv_log_level_to_obs(mpv_log_level lvl)
 {
     switch (lvl) {
@@ -186,18 +220,455 @@ static inline void calc_texture_size(int64_t w, int64_t h, uint32_t* u, uint32_t
 
 void mpvs_init_track(struct mpv_source* context, struct mpv_track_info* info, mpv_node* node);
 
+void mpvs_set_default_track_title(struct mpv_track_info* info);
+
+// checks the file extension against a list like EXTENSIONS_AUDIO
+bool mpvs_has_extension(const char* path, const char* extensions);
+
+// appends a string to an edl:// URL, prefixed with its length so it can
+// contain separators
+void mpvs_edl_append(struct dstr* edl, const char* str);
+
+void mpvs_set_callbacks(struct mpv_source* context);
+
 void mpvs_init(struct mpv_source* context);
 
+// creates the render context and texture, needs the graphics context
+bool mpvs_init_video(struct mpv_source* context);
+
+void mpvs_load_gl_functions(struct mpv_source* context);
+
+// swaps the mpv core, render context and texture between two sources
+void mpvs_swap_core(struct mpv_source* a, struct mpv_source* b);
+
+// destroys the mpv core, render context and texture of a source
+void mpvs_free_core(struct mpv_source* context);
+
 void mpvs_load_file(struct mpv_source* context, const char* playlist_file);
 
+// pauses or resumes like the media controls, untimed mode and sync groups
+// have their own ways of doing that
+void mpvs_media_play_pause(struct mpv_source* context, bool pause);
+
 void mpvs_set_mpv_properties(struct mpv_source* context);
 
 void mpvs_handle_events(struct mpv_source* context);
 
+// sets the size of the video and creates a texture for it, has to be called
+// in the graphics context
+void mpvs_set_video_size(struct mpv_source* context, uint32_t width, uint32_t height);
+
+// used instead of mpv's clock in untimed mode, a step is requested at the end
+// of a tick and the next tick waits until mpv decoded it and renders it
+void mpvs_untimed_wait(struct mpv_source* context);
+
+void mpvs_untimed_frame_check(struct mpv_source* context, bool frame_ready);
+
+void mpvs_untimed_step(struct mpv_source* context);
+
 void mpvs_generate_texture_gl(struct mpv_source* context);
 
 void mpvs_render_gl(struct mpv_source* context);
 
+// renders straight into the render target obs has bound, fails if the
+// source doesn't cover the whole viewport
+bool mpvs_render_gl_direct(struct mpv_source* context);
+
+// renders into video_buffer from inside video_render
+void mpvs_render_gl_nested(struct mpv_source* context);
+
+/* Dual deck playback (mpv-deck.c) ----------------------------------------- */
+
+// returns true if it cut to the prerolled file
+bool mpvs_deck_tick(struct mpv_source* context);
+
+void mpvs_deck_take(struct mpv_source* context);
+
+void mpvs_deck_load(struct mpv_source* context, size_t index);
+
+void mpvs_deck_destroy(struct mpv_source* context);
+
+// prerolls a file that isn't in the playlist
+void mpvs_deck_cue(struct mpv_source* context, const char* file);
+
+/* Loop cache (mpv-loop-cache.c) ------------------------------------------ */
+
+void mpvs_loop_cache_tick(struct mpv_source* context, bool rendered);
+
+// drops all cached frames on the next tick, resume unpauses mpv if the
+// cache was playing
+void mpvs_loop_cache_reset(struct mpv_source* context, bool resume);
+
+gs_texture_t* mpvs_loop_cache_texture(struct mpv_source* context);
+
+int64_t mpvs_loop_cache_time(struct mpv_source* context);
+
+void mpvs_loop_cache_free(struct mpv_source* context);
+
+/* Directory playlist entries (mpv-dir.c) ---------------------------------- */
+
+bool mpvs_is_media_file(const char* path);
+
+bool mpvs_is_directory(const char* path);
+
+// starts scanning the directory in the background and watching it for changes
+struct mpvs_dir* mpvs_dir_create(const char* path);
+
+void mpvs_dir_destroy(struct mpvs_dir* dir);
+
+const char* mpvs_dir_get_path(struct mpvs_dir* dir);
+
+// appends copies of all media files in the directory tree in sorted order
+void mpvs_dir_get_files(struct mpvs_dir* dir, struct darray* files);
+
+// moves all changes since the last call into changes, returns true once
+// after the first scan of the tree is done
+bool mpvs_dir_pop_changes(struct mpvs_dir* dir, struct darray* changes);
+
+static inline void mpvs_dir_free_change(struct mpvs_dir_change* change)
+{
+    bfree(change->path);
+    bfree(change->prev);
+    bfree(change->next);
+}
+
+// applies changes of watched directories to the playlist
+void mpvs_dir_tick(struct mpv_source* context);
+
+/* Image prefetch (mpv-image.c) ------------------------------------------- */
+
+// starts decoding the next playlist entry if it's an image
+void mpvs_image_prefetch_next(struct mpv_source* context);
+
+// the decoded image still has to be uploaded in the graphics thread
+bool mpvs_image_pending(struct mpv_source* context);
+
+void mpvs_image_tick(struct mpv_source* context);
+
+// shows the prefetched image if mpv started playing it
+void mpvs_image_file_started(struct mpv_source* context);
+
+// abandons a decode that is still running
+void mpvs_image_free(struct mpv_source* context);
+
+// waits for abandoned decodes before the module is unloaded
+void mpvs_image_wait(void);
+
+/* Shared instances (mpv-shared.c) ---------------------------------------- */
+
+// joins or leaves the group of sources playing the same files
+void mpvs_shared_update(struct mpv_source* context, char** files, size_t count);
+
+void mpvs_shared_leave(struct mpv_source* context);
+
+bool mpvs_shared_is_follower(struct mpv_source* context);
+
+// returns the source that plays the media for this source, only in the
+// graphics thread, where the primary can't leave the group meanwhile
+struct mpv_source* mpvs_shared_source(struct mpv_source* context);
+
+// like mpvs_shared_source with a reference for other threads, NULL if the
+// source is being destroyed. mpvs_shared_release takes NULL as well
+struct mpv_source* mpvs_shared_acquire(struct mpv_source* context);
+
+void mpvs_shared_release(struct mpv_source* source);
+
+size_t mpvs_shared_follower_count(struct mpv_source* context);
+
+/* Shader cache (mpv-shader-cache.c) -------------------------------------- */
+
+void mpvs_shader_cache_init(void);
+
+void mpvs_shader_cache_free(void);
+
+// points mpv to the cache directory, has to be called before mpv_initialize
+void mpvs_shader_cache_apply(struct mpv_source* context);
+
+// called when the render context is created and when it rendered its first
+// frame, logs whether the shaders were cached
+void mpvs_shader_cache_begin(struct mpv_source* context);
+
+void mpvs_shader_cache_end(struct mpv_source* context);
+
+/* Sync groups (mpv-sync.c) ----------------------------------------------- */
+
+// joins the sync group with this name, NULL or an empty name leaves the group
+void mpvs_sync_update(struct mpv_source* context, const char* name);
+
+void mpvs_sync_leave(struct mpv_source* context);
+
+// these apply to all members of the group in their next tick, they return
+// false if the source isn't in a group
+bool mpvs_sync_play_pause(struct mpv_source* context, bool pause);
+
+bool mpvs_sync_seek(struct mpv_source* context, double time);
+
+void mpvs_sync_tick(struct mpv_source* context);
+
+// also keeps the observed position that the other members compare with
+void mpvs_sync_handle_event(struct mpv_source* context, mpv_event* event);
+
+// the position of a freed core isn't valid anymore
+void mpvs_sync_core_freed(struct mpv_source* context);
+
+bool mpvs_sync_is_master(struct mpv_source* context);
+
+// largest drift of a member in seconds
+double mpvs_sync_group_drift(struct mpv_source* context);
+
+/* Core teardown (mpv-reaper.c) ------------------------------------------- */
+
+void mpvs_reaper_init(void);
+
+// waits a few seconds for the queued cores to shut down, returns false if some
+// of them still hang, the plugin is kept loaded then
+bool mpvs_reaper_free(void);
+
+// destroys the core on a worker thread, the render context has to be freed already
+void mpvs_reaper_queue(mpv_handle* mpv, const char* name);
+
+/* Dormant mode (mpv-dormant.c) ------------------------------------------- */
+
+// releases or recreates the core, returns true while the source is dormant
+bool mpvs_dormant_tick(struct mpv_source* context);
+
+// restores the file and position from before the source went dormant
+void mpvs_dormant_file_loaded(struct mpv_source* context);
+
+/* Demuxer cache budget (mpv-cache.c) ------------------------------------- */
+
+void mpvs_cache_init(void);
+
+void mpvs_cache_free(void);
+
+void mpvs_cache_join(struct mpv_source* context);
+
+void mpvs_cache_leave(struct mpv_source* context);
+
+// sets the cache size the source asks for, it might get less
+void mpvs_cache_update(struct mpv_source* context, size_t forward_bytes, size_t back_bytes);
+
+// back buffer of a live stream, it isn't taken from the budget if it's on disk
+void mpvs_cache_set_timeshift(struct mpv_source* context, size_t bytes, bool on_disk);
+
+void mpvs_cache_tick(struct mpv_source* context);
+
+void mpvs_cache_get_stats(struct mpv_source* context, obs_data_t* stats);
+
+// size limit of the http cache directory in bytes, 0 for no limit
+size_t mpvs_cache_http_limit(void);
+
+/* Cue and take (mpv-cue.c) ----------------------------------------------- */
+
+// can be called from any thread
+void mpvs_cue_request(struct mpv_source* context, const char* path);
+
+// takes the cued file at the first frame with an obs timestamp of at least
+// timestamp, 0 for the next frame, can be called from any thread
+void mpvs_cue_take_request(struct mpv_source* context, uint64_t timestamp);
+
+// reply to the loadfile of a cued file, plays the new playlist entry
+void mpvs_cue_entry_added(struct mpv_source* context, mpv_event* event);
+
+// removes the cued entry once another one starts
+void mpvs_cue_file_started(struct mpv_source* context, mpv_event_start_file* start);
+
+void mpvs_cue_playlist_replaced(struct mpv_source* context);
+
+void mpvs_cue_tick(struct mpv_source* context);
+
+void mpvs_cue_frame_rendered(struct mpv_source* context);
+
+void mpvs_cue_free(struct mpv_source* context);
+
+void mpvs_cue_get_stats(struct mpv_source* context, obs_data_t* stats);
+
+/* Growing files (mpv-tail.c) --------------------------------------------- */
+
+// returns an appending:// URL for files that are still being written or were
+// followed before, NULL otherwise
+char* mpvs_tail_url(struct mpv_source* context, const char* path);
+
+void mpvs_tail_file_loaded(struct mpv_source* context);
+
+// keeps the playback position close to the end of the file that is written
+void mpvs_tail_tick(struct mpv_source* context);
+
+// the duration of the part that was written so far
+int64_t mpvs_tail_duration(struct mpv_source* context);
+
+void mpvs_tail_get_stats(struct mpv_source* context, obs_data_t* stats);
+
+/* Live timeshift (mpv-timeshift.c) --------------------------------------- */
+
+void mpvs_timeshift_set_properties(struct mpv_source* context);
+
+// adds the hook that puts the cache of network streams on disk, if enabled
+void mpvs_timeshift_register(struct mpv_source* context);
+
+void mpvs_timeshift_handle_hook(struct mpv_source* context, mpv_event_hook* hook);
+
+// checks if the file that was loaded is a live stream
+void mpvs_timeshift_file_loaded(struct mpv_source* context);
+
+// follows the seekable window and sizes the back buffer to the bitrate
+void mpvs_timeshift_tick(struct mpv_source* context);
+
+// true while a live stream is played with a back buffer, the media controls
+// then work on the window of the buffer
+static inline bool mpvs_timeshift_active(struct mpv_source* context)
+{
+    return context->timeshift_minutes && context->timeshift_live && context->file_loaded;
+}
+
+int64_t mpvs_timeshift_duration(struct mpv_source* context);
+
+int64_t mpvs_timeshift_time(struct mpv_source* context);
+
+// ms from the start of the window
+void mpvs_timeshift_seek(struct mpv_source* context, int64_t ms);
+
+void mpvs_timeshift_go_live(struct mpv_source* context);
+
+void mpvs_timeshift_get_stats(struct mpv_source* context, obs_data_t* stats);
+
+/* Render watchdog (mpv-watchdog.c) --------------------------------------- */
+
+void mpvs_watchdog_init(void);
+
+void mpvs_watchdog_free(void);
+
+// wrap every mpv render call, begin returns false if the source is frozen,
+// direct is set for renders that go to the obs render target
+bool mpvs_watchdog_begin(struct mpv_source* context, bool direct);
+
+void mpvs_watchdog_end(struct mpv_source* context);
+
+// calls context->render, returns false if the source is frozen
+bool mpvs_watchdog_render(struct mpv_source* context);
+
+/* HTTP cache stream (mpv-http.c) ----------------------------------------- */
+
+static inline bool mpvs_http_is_url(const char* path)
+{
+    return astrcmpi_n(path, "http://", 7) == 0 || astrcmpi_n(path, "https://", 8) == 0;
+}
+
+#if defined(ENABLE_HTTP_CACHE)
+void mpvs_http_init(void);
+
+void mpvs_http_free(void);
+
+// returns a copy of the URL that is opened through the cache stream
+char* mpvs_http_cache_url(const char* url);
+
+// adds the cache stream protocol to the core, has to be called for every core
+void mpvs_http_register(struct mpv_source* context);
+
+void mpvs_http_get_stats(obs_data_t* stats);
+#else
+// without libcurl URLs are opened by mpv itself
+static inline void mpvs_http_init(void)
+{
+}
+
+static inline void mpvs_http_free(void)
+{
+}
+
+static inline char* mpvs_http_cache_url(const char* url)
+{
+    return bstrdup(url);
+}
+
+static inline void mpvs_http_register(struct mpv_source* context)
+{
+    UNUSED_PARAMETER(context);
+}
+
+static inline void mpvs_http_get_stats(obs_data_t* stats)
+{
+    UNUSED_PARAMETER(stats);
+}
+#endif
+
+/* Asset bundles (mpv-bundle.c) ------------------------------------------- */
+
+// true for existing files with the bundle extension
+bool mpvs_is_bundle(const char* path);
+
+// maps the bundle or adds a reference to it if it's open already, preload
+// reads the whole bundle into memory, returns NULL if it isn't a valid bundle
+struct mpvs_bundle* mpvs_bundle_acquire(const char* path, bool preload);
+
+void mpvs_bundle_release(struct mpvs_bundle* bundle);
+
+// for paths like pack.obsbundle/clip.webm copies the bundle path and returns
+// where the file name starts, returns 0 if the path isn't inside a bundle
+size_t mpvs_bundle_split(const char* path, struct dstr* bundle_path);
+
+// appends bundle:// URLs of all media files in the bundle in sorted order
+void mpvs_bundle_get_files(struct mpvs_bundle* bundle, struct darray* files);
+
+// returns the bundle:// URL of a file in the bundle or NULL if it isn't in it
+char* mpvs_bundle_get_url(struct mpvs_bundle* bundle, const char* name);
+
+// adds the bundle stream protocol to the core, has to be called for every core
+void mpvs_bundle_register(struct mpv_source* context);
+
+// stops the preloads and waits for them before the module is unloaded
+void mpvs_bundle_wait(void);
+
+/* Resolved URL cache (mpv-ytdl.c) ---------------------------------------- */
+
+void mpvs_ytdl_init(void);
+
+void mpvs_ytdl_free(void);
+
+// true for http(s) URLs that don't link to a media file
+bool mpvs_ytdl_is_page(const char* path);
+
+// resolves the page in the background unless a valid result is cached
+void mpvs_ytdl_queue(const char* url);
+
+// adds the load hooks to the core if the source uses the cache, called for
+// every core and when the setting changes
+void mpvs_ytdl_register(struct mpv_source* context);
+
+void mpvs_ytdl_handle_hook(struct mpv_source* context, mpv_event_hook* hook);
+
+// continues loading once a page the core waits for was resolved
+void mpvs_ytdl_tick(struct mpv_source* context);
+
+void mpvs_ytdl_get_stats(obs_data_t* stats);
+
+/* Edit lists (mpv-edit.c) ------------------------------------------------ */
+
+// true for .obsedit files
+bool mpvs_is_edit_list(const char* path);
+
+// returns the edl:// timeline of the segments in the edit list or NULL if it
+// is invalid, has to be freed with bfree
+char* mpvs_edit_list_to_edl(const char* path);
+
+/* Media probe cache (mpv-probe.c) ----------------------------------------- */
+
+void mpvs_probe_init(void);
+
+void mpvs_probe_free(void);
+
+void mpvs_probe_queue(const char* path);
+
+// returns the cached probe result for a file or NULL if it hasn't been probed
+// since it was last modified, release with obs_data_release
+obs_data_t* mpvs_probe_get(const char* path);
+
+// same as mpvs_probe_get without checking the file, for the UI thread. Stale
+// results are dropped when the file is queued again and when the cache is saved.
+obs_data_t* mpvs_probe_lookup(const char* path);
+
+void mpvs_probe_get_tracks(obs_data_t* entry, struct darray* tracks);
+
 #if defined(WIN32)
 void mpvs_generate_texture_d3d(struct mpv_source* context);
 
@@ -0,0 +1,481 @@
+#include "mpv-backend.h"
+#include <mpv/stream_cb.h>
+#include <obs-module.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#if defined(WIN32)
+#    include <windows.h>
+#else
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <unistd.h>
+#endif
+#include <sys/stat.h>
+
+#define MPVS_BUNDLE_PROTOCOL "bundle"
+#define MPVS_BUNDLE_EXTENSION ".obsbundle"
+
+#define MPVS_ZIP_EOCD 0x06054b50
+#define MPVS_ZIP_CENTRAL 0x02014b50
+#define MPVS_ZIP_LOCAL 0x04034b50
+#define MPVS_ZIP_EOCD_SIZE 22
+#define MPVS_ZIP_CENTRAL_SIZE 46
+#define MPVS_ZIP_LOCAL_SIZE 30
+
+// A bundle is a zip archive with uncompressed entries (zip -0), renamed to
+// .obsbundle. The central directory is its index, which never changes once
+// the bundle is open. Bundles are mapped into memory and shared by all
+// sources, their entries are read by mpv through the bundle:// stream straight
+// from the mapping, so opening a clip only checks that the bundle didn't change.
+// Playlist entries can be a whole bundle, which is expanded into its media
+// files, or a single file like pack.obsbundle/clip.webm.
+// A bundle that was replaced on disk is mapped again for new streams, streams
+// that are still open keep reading the old mapping. Bundles should be replaced
+// by writing a new file and renaming it. Writing to a bundle in place changes
+// the data of clips that are playing, and truncating it can crash on
+// platforms that allow it. Windows refuses writes to a mapped bundle.
+
+struct mpvs_bundle_entry {
+    char* name;
+    uint64_t offset; // of the data in the bundle
+    uint64_t size;
+};
+
+struct mpvs_bundle {
+    char* path;
+    long refs;
+    const uint8_t* data;
+    uint64_t size;
+    time_t mtime;
+    bool preloaded;
+    bool preloading; // a worker is reading the pages
+    bool stale;      // the file changed, it isn't in the registry anymore
+#if defined(WIN32)
+    HANDLE file;
+    HANDLE mapping;
+#endif
+    // sorted by name
+    DARRAY(struct mpvs_bundle_entry)
+    entries;
+};
+
+struct mpvs_bundle_stream {
+    struct mpvs_bundle* bundle;
+    const uint8_t* data;
+    uint64_t size;
+    uint64_t pos;
+};
+
+static struct {
+    pthread_mutex_t mutex;
+    DARRAY(struct mpvs_bundle*)
+    bundles;
+    volatile long preloads; // running preload threads
+    volatile bool stop;     // the module is unloaded, preloads stop early
+} bundles = { PTHREAD_MUTEX_INITIALIZER };
+
+static inline uint16_t mpvs_zip_u16(const uint8_t* p)
+{
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static inline uint32_t mpvs_zip_u32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static int mpvs_bundle_compare_entries(const void* a, const void* b)
+{
+    const struct mpvs_bundle_entry* x = a;
+    const struct mpvs_bundle_entry* y = b;
+    return strcmp(x->name, y->name);
+}
+
+/* Mapping ----------------------------------------------------------------- */
+
+static bool mpvs_bundle_map(struct mpvs_bundle* bundle)
+{
+#if defined(WIN32)
+    wchar_t* wpath = NULL;
+    os_utf8_to_wcs_ptr(bundle->path, 0, &wpath);
+    // deleting lets a new file be renamed over the bundle while it's mapped
+    bundle->file = CreateFileW(wpath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+    bfree(wpath);
+    if (bundle->file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(bundle->file, &size) || size.QuadPart == 0)
+        return false;
+    bundle->mapping = CreateFileMappingW(bundle->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!bundle->mapping)
+        return false;
+    bundle->data = MapViewOfFile(bundle->mapping, FILE_MAP_READ, 0, 0, 0);
+    bundle->size = (uint64_t)size.QuadPart;
+    struct stat st;
+    if (os_stat(bundle->path, &st) == 0)
+        bundle->mtime = st.st_mtime;
+#else
+    int fd = open(bundle->path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    // the mapping keeps the file open. Writes to the file are still seen
+    // through the mapping, only replacing the file by renaming a new one over
+    // it leaves the mapped data as it was
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+    bundle->data = data;
+    bundle->size = (uint64_t)st.st_size;
+    bundle->mtime = st.st_mtime;
+#endif
+    return bundle->data != NULL;
+}
+
+// a bundle that was written again after it was mapped is opened again
+static bool mpvs_bundle_changed(struct mpvs_bundle* bundle)
+{
+    struct stat st;
+    return os_stat(bundle->path, &st) != 0 || (uint64_t)st.st_size != bundle->size || st.st_mtime != bundle->mtime;
+}
+
+static void mpvs_bundle_unmap(struct mpvs_bundle* bundle)
+{
+#if defined(WIN32)
+    if (bundle->data)
+        UnmapViewOfFile(bundle->data);
+    if (bundle->mapping)
+        CloseHandle(bundle->mapping);
+    if (bundle->file && bundle->file != INVALID_HANDLE_VALUE)
+        CloseHandle(bundle->file);
+#else
+    if (bundle->data)
+        munmap((void*)bundle->data, (size_t)bundle->size);
+#endif
+    bundle->data = NULL;
+}
+
+// reads every page once so the whole bundle is in memory before it's played,
+// runs on its own thread with a reference to the bundle
+static void* mpvs_bundle_preload(void* data)
+{
+    struct mpvs_bundle* bundle = data;
+    os_set_thread_name("obs-mpv: bundle preload");
+    uint64_t start = os_gettime_ns();
+#if defined(WIN32)
+    WIN32_MEMORY_RANGE_ENTRY range = { (void*)bundle->data, (SIZE_T)bundle->size };
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+    madvise((void*)bundle->data, (size_t)bundle->size, MADV_WILLNEED);
+#endif
+    volatile uint8_t sum = 0;
+    for (uint64_t i = 0; i < bundle->size && !bundles.stop; i += 4096)
+        sum += bundle->data[i];
+    if (!bundles.stop)
+        obs_log(LOG_INFO, "Preloaded bundle %s (%.1f MiB) in %.1f ms", bundle->path, bundle->size / (1024.0 * 1024.0), (os_gettime_ns() - start) / 1000000.0);
+
+    pthread_mutex_lock(&bundles.mutex);
+    bundle->preloaded = true;
+    bundle->preloading = false;
+    pthread_mutex_unlock(&bundles.mutex);
+    mpvs_bundle_release(bundle);
+    os_atomic_dec_long(&bundles.preloads);
+    return NULL;
+}
+
+static void mpvs_bundle_preload_locked(struct mpvs_bundle* bundle)
+{
+    if (bundle->preloaded || bundle->preloading)
+        return;
+
+    pthread_t thread;
+    bundle->refs++;
+    os_atomic_inc_long(&bundles.preloads);
+    bundle->preloading = pthread_create(&thread, NULL, mpvs_bundle_preload, bundle) == 0;
+    if (bundle->preloading) {
+        pthread_detach(thread);
+    } else {
+        bundle->refs--;
+        os_atomic_dec_long(&bundles.preloads);
+        obs_log(LOG_WARNING, "Failed to start preloading bundle %s", bundle->path);
+    }
+}
+
+/* Index ------------------------------------------------------------------- */
+
+static bool mpvs_bundle_read_index(struct mpvs_bundle* bundle)
+{
+    const uint8_t* data = bundle->data;
+    uint64_t size = bundle->size;
+    if (size < MPVS_ZIP_EOCD_SIZE)
+        return false;
+
+    // the end of central directory record is followed by a comment of up to 64 KiB
+    const uint8_t* eocd = NULL;
+    uint64_t min = size > MPVS_ZIP_EOCD_SIZE + 0xffff ? size - MPVS_ZIP_EOCD_SIZE - 0xffff : 0;
+    for (uint64_t i = size - MPVS_ZIP_EOCD_SIZE + 1; i-- > min;) {
+        if (mpvs_zip_u32(data + i) == MPVS_ZIP_EOCD) {
+            eocd = data + i;
+            break;
+        }
+    }
+    if (!eocd)
+        return false;
+
+    uint16_t count = mpvs_zip_u16(eocd + 10);
+    uint64_t cd_offset = mpvs_zip_u32(eocd + 16);
+    if (cd_offset == 0xffffffff) {
+        obs_log(LOG_ERROR, "Bundle %s is a zip64 archive, which isn't supported", bundle->path);
+        return false;
+    }
+    if (cd_offset > size)
+        return false;
+
+    const uint8_t* p = data + cd_offset;
+    for (uint16_t i = 0; i < count; i++) {
+        if (p + MPVS_ZIP_CENTRAL_SIZE > data + size || mpvs_zip_u32(p) != MPVS_ZIP_CENTRAL)
+            return false;
+
+        uint16_t method = mpvs_zip_u16(p + 10);
+        uint64_t entry_size = mpvs_zip_u32(p + 24);
+        uint16_t name_len = mpvs_zip_u16(p + 28);
+        uint16_t extra_len = mpvs_zip_u16(p + 30);
+        uint16_t comment_len = mpvs_zip_u16(p + 32);
+        uint64_t local = mpvs_zip_u32(p + 42);
+        const char* name = (const char*)p + MPVS_ZIP_CENTRAL_SIZE;
+        p += MPVS_ZIP_CENTRAL_SIZE + name_len + extra_len + comment_len;
+        if (p > data + size)
+            return false;
+
+        // directories
+        if (name_len == 0 || name[name_len - 1] == '/')
+            continue;
+
+        struct mpvs_bundle_entry entry = { bstrdup_n(name, name_len), 0, entry_size };
+        if (method != 0) {
+            obs_log(LOG_WARNING, "Skipping compressed file %s in bundle %s", entry.name, bundle->path);
+            bfree(entry.name);
+            continue;
+        }
+
+        // the local header can have a different extra field than the central directory
+        if (local + MPVS_ZIP_LOCAL_SIZE > size || mpvs_zip_u32(data + local) != MPVS_ZIP_LOCAL) {
+            bfree(entry.name);
+            return false;
+        }
+        entry.offset = local + MPVS_ZIP_LOCAL_SIZE + mpvs_zip_u16(data + local + 26) + mpvs_zip_u16(data + local + 28);
+        if (entry.offset + entry.size > size) {
+            bfree(entry.name);
+            return false;
+        }
+        da_push_back(bundle->entries, &entry);
+    }
+
+    qsort(bundle->entries.array, bundle->entries.num, sizeof(struct mpvs_bundle_entry), mpvs_bundle_compare_entries);
+    return true;
+}
+
+static void mpvs_bundle_destroy(struct mpvs_bundle* bundle)
+{
+    mpvs_bundle_unmap(bundle);
+    for (size_t i = 0; i < bundle->entries.num; i++)
+        bfree(bundle->entries.array[i].name);
+    da_free(bundle->entries);
+    bfree(bundle->path);
+    bfree(bundle);
+}
+
+static struct mpvs_bundle_entry* mpvs_bundle_find(struct mpvs_bundle* bundle, const char* name)
+{
+    struct mpvs_bundle_entry key = { (char*)name };
+    return bsearch(&key, bundle->entries.array, bundle->entries.num, sizeof(struct mpvs_bundle_entry), mpvs_bundle_compare_entries);
+}
+
+/* Registry ---------------------------------------------------------------- */
+
+struct mpvs_bundle* mpvs_bundle_acquire(const char* path, bool preload)
+{
+    pthread_mutex_lock(&bundles.mutex);
+    struct mpvs_bundle* bundle = NULL;
+    for (size_t i = 0; i < bundles.bundles.num; i++) {
+        if (strcmp(bundles.bundles.array[i]->path, path) == 0) {
+            bundle = bundles.bundles.array[i];
+            break;
+        }
+    }
+
+    // streams that are still open keep the old mapping until they're closed
+    if (bundle && mpvs_bundle_changed(bundle)) {
+        obs_log(LOG_INFO, "Bundle %s changed, opening it again", path);
+        bundle->stale = true;
+        da_erase_item(bundles.bundles, &bundle);
+        bundle = NULL;
+    } else if (bundle) {
+        bundle->refs++;
+    }
+
+    if (!bundle) {
+        uint64_t start = os_gettime_ns();
+        bundle = bzalloc(sizeof(struct mpvs_bundle));
+        bundle->path = bstrdup(path);
+        bundle->refs = 1;
+        if (!mpvs_bundle_map(bundle) || !mpvs_bundle_read_index(bundle)) {
+            obs_log(LOG_ERROR, "Failed to open bundle %s", path);
+            mpvs_bundle_destroy(bundle);
+            pthread_mutex_unlock(&bundles.mutex);
+            return NULL;
+        }
+        da_push_back(bundles.bundles, &bundle);
+        obs_log(LOG_INFO, "Opened bundle %s with %zu files in %.1f ms", path, bundle->entries.num, (os_gettime_ns() - start) / 1000000.0);
+    }
+
+    if (preload)
+        mpvs_bundle_preload_locked(bundle);
+    pthread_mutex_unlock(&bundles.mutex);
+    return bundle;
+}
+
+void mpvs_bundle_release(struct mpvs_bundle* bundle)
+{
+    if (!bundle)
+        return;
+
+    pthread_mutex_lock(&bundles.mutex);
+    if (--bundle->refs == 0) {
+        if (!bundle->stale)
+            da_erase_item(bundles.bundles, &bundle);
+        mpvs_bundle_destroy(bundle);
+    }
+    pthread_mutex_unlock(&bundles.mutex);
+}
+
+bool mpvs_is_bundle(const char* path)
+{
+    const char* ext = os_get_path_extension(path);
+    return ext && astrcmpi(ext, MPVS_BUNDLE_EXTENSION) == 0 && os_file_exists(path);
+}
+
+size_t mpvs_bundle_split(const char* path, struct dstr* bundle_path)
+{
+    // the first part of the path that ends in the bundle extension and is a file
+    size_t ext_len = strlen(MPVS_BUNDLE_EXTENSION);
+    for (const char* p = astrstri(path, MPVS_BUNDLE_EXTENSION); p; p = astrstri(p + 1, MPVS_BUNDLE_EXTENSION)) {
+        if (p[ext_len] != '/' && p[ext_len] != '\\')
+            continue;
+        dstr_ncopy(bundle_path, path, p + ext_len - path);
+        if (os_file_exists(bundle_path->array))
+            return p + ext_len + 1 - path;
+    }
+    return 0;
+}
+
+void mpvs_bundle_get_files(struct mpvs_bundle* bundle, struct darray* files)
+{
+    struct dstr url = { 0 };
+    for (size_t i = 0; i < bundle->entries.num; i++) {
+        const char* name = bundle->entries.array[i].name;
+        if (!mpvs_is_media_file(name))
+            continue;
+        dstr_printf(&url, "%s://%s/%s", MPVS_BUNDLE_PROTOCOL, bundle->path, name);
+        char* p = bstrdup(url.array);
+        darray_push_back(sizeof(char*), files, &p);
+    }
+    dstr_free(&url);
+}
+
+char* mpvs_bundle_get_url(struct mpvs_bundle* bundle, const char* name)
+{
+    if (!mpvs_bundle_find(bundle, name))
+        return NULL;
+
+    struct dstr url = { 0 };
+    dstr_printf(&url, "%s://%s/%s", MPVS_BUNDLE_PROTOCOL, bundle->path, name);
+    return url.array;
+}
+
+/* Stream callbacks -------------------------------------------------------- */
+
+static int64_t mpvs_bundle_read(void* cookie, char* buf, uint64_t nbytes)
+{
+    struct mpvs_bundle_stream* s = cookie;
+    uint64_t len = util_min(nbytes, s->size - s->pos);
+    memcpy(buf, s->data + s->pos, (size_t)len);
+    s->pos += len;
+    return (int64_t)len;
+}
+
+static int64_t mpvs_bundle_seek(void* cookie, int64_t offset)
+{
+    struct mpvs_bundle_stream* s = cookie;
+    if (offset < 0 || (uint64_t)offset > s->size)
+        return MPV_ERROR_GENERIC;
+    s->pos = (uint64_t)offset;
+    return offset;
+}
+
+static int64_t mpvs_bundle_size(void* cookie)
+{
+    struct mpvs_bundle_stream* s = cookie;
+    return (int64_t)s->size;
+}
+
+static void mpvs_bundle_close(void* cookie)
+{
+    struct mpvs_bundle_stream* s = cookie;
+    mpvs_bundle_release(s->bundle);
+    bfree(s);
+}
+
+static int mpvs_bundle_open(void* user_data, char* uri, mpv_stream_cb_info* info)
+{
+    UNUSED_PARAMETER(user_data);
+    const char* path = uri + strlen(MPVS_BUNDLE_PROTOCOL "://");
+
+    struct dstr bundle_path = { 0 };
+    size_t name_start = mpvs_bundle_split(path, &bundle_path);
+    struct mpvs_bundle* bundle = name_start ? mpvs_bundle_acquire(bundle_path.array, false) : NULL;
+    dstr_free(&bundle_path);
+
+    struct mpvs_bundle_entry* entry = bundle ? mpvs_bundle_find(bundle, path + name_start) : NULL;
+    if (!entry) {
+        obs_log(LOG_ERROR, "%s isn't in a bundle", path);
+        mpvs_bundle_release(bundle);
+        return MPV_ERROR_LOADING_FAILED;
+    }
+
+    struct mpvs_bundle_stream* s = bzalloc(sizeof(struct mpvs_bundle_stream));
+    s->bundle = bundle;
+    s->data = bundle->data + entry->offset;
+    s->size = entry->size;
+
+    info->cookie = s;
+    info->read_fn = mpvs_bundle_read;
+    info->seek_fn = mpvs_bundle_seek;
+    info->size_fn = mpvs_bundle_size;
+    info->close_fn = mpvs_bundle_close;
+    return 0;
+}
+
+void mpvs_bundle_wait(void)
+{
+    bundles.stop = true;
+    while (os_atomic_load_long(&bundles.preloads) > 0)
+        os_sleep_ms(10);
+}
+
+void mpvs_bundle_register(struct mpv_source* context)
+{
+    int result = mpv_stream_cb_add_ro(context->mpv, MPVS_BUNDLE_PROTOCOL, NULL, mpvs_bundle_open);
+    if (result < 0)
+        obs_log(LOG_ERROR, "[%s] Failed to register bundle stream: %s", obs_source_get_name(context->src), mpv_error_string(result));
+}
@@ -0,0 +1,235 @@
+#include "mpv-backend.h"
+#include <obs-module.h>
+#include <util/darray.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#define MPVS_CACHE_CONFIG_FILE "cache.json"
+#define MPVS_CACHE_DEFAULT_BUDGET_MB 2048
+#define MPVS_CACHE_DEFAULT_HTTP_MB 4096
+
+// Priorities for dividing the module wide budget, sources that are on the
+// program get the largest part of it
+#define MPVS_CACHE_WEIGHT_ACTIVE 4
+#define MPVS_CACHE_WEIGHT_SHOWING 2
+#define MPVS_CACHE_WEIGHT_HIDDEN 1
+
+// Each source asks for forward and back demuxer cache bytes. If their sum is
+// more than the budget from cache.json in the plugin config directory, the
+// budget is divided by priority. Sources that need less than their part give
+// the rest to the others. Every source applies its own budget in its tick, so
+// the cores of other sources are never touched here. The second core of the
+// dual deck asks for as much as the source and gets half of its budget.
+
+static struct {
+    pthread_mutex_t mutex;
+    size_t budget;     // bytes, 0 for no limit
+    size_t http_limit; // size of the http cache directory, see mpv-http.c
+    bool dirty;
+    DARRAY(struct mpv_source*)
+    sources;
+} cache = { PTHREAD_MUTEX_INITIALIZER };
+
+static inline size_t mpvs_cache_back_requested(struct mpv_source* context)
+{
+    // a timeshift buffer on disk doesn't take memory from the budget
+    if (!context->timeshift_on_disk)
+        return util_max(context->cache_back_bytes, context->timeshift_bytes);
+    return context->cache_back_bytes;
+}
+
+static inline size_t mpvs_cache_requested(struct mpv_source* context)
+{
+    return (context->cache_forward_bytes + mpvs_cache_back_requested(context)) * util_max(context->cache_cores, 1);
+}
+
+static void mpvs_cache_rebalance_locked(void)
+{
+    cache.dirty = false;
+
+    size_t requested = 0;
+    for (size_t i = 0; i < cache.sources.num; i++) {
+        struct mpv_source* context = cache.sources.array[i];
+        context->cache_budget = context->cache_weight ? mpvs_cache_requested(context) : 0;
+        requested += context->cache_budget;
+    }
+    if (!cache.budget || requested <= cache.budget)
+        return;
+
+    bool* done = bzalloc(cache.sources.num * sizeof(bool));
+    size_t remaining = cache.budget;
+    while (remaining > 0) {
+        size_t weights = 0;
+        for (size_t i = 0; i < cache.sources.num; i++)
+            weights += done[i] ? 0 : cache.sources.array[i]->cache_weight;
+        if (weights == 0)
+            break;
+
+        // sources that need less than their part keep what they asked for,
+        // the parts of the others are then computed again without them
+        bool capped = false;
+        for (size_t i = 0; i < cache.sources.num; i++) {
+            struct mpv_source* context = cache.sources.array[i];
+            size_t share = (size_t)((double)remaining * context->cache_weight / weights);
+            if (!done[i] && mpvs_cache_requested(context) <= share) {
+                context->cache_budget = mpvs_cache_requested(context);
+                remaining -= context->cache_budget;
+                done[i] = capped = true;
+            }
+        }
+        if (capped)
+            continue;
+
+        for (size_t i = 0; i < cache.sources.num; i++) {
+            struct mpv_source* context = cache.sources.array[i];
+            if (!done[i])
+                context->cache_budget = (size_t)((double)remaining * context->cache_weight / weights);
+        }
+        break;
+    }
+    bfree(done);
+}
+
+void mpvs_cache_init(void)
+{
+    char* path = obs_module_config_path(MPVS_CACHE_CONFIG_FILE);
+    obs_data_t* config = obs_data_create_from_json_file_safe(path, "bak");
+    if (!config) {
+        // written once so operators can find and change it
+        char* dir = obs_module_config_path("");
+        os_mkdirs(dir);
+        bfree(dir);
+        config = obs_data_create();
+        obs_data_set_int(config, "budget_mb", MPVS_CACHE_DEFAULT_BUDGET_MB);
+        obs_data_set_int(config, "http_cache_mb", MPVS_CACHE_DEFAULT_HTTP_MB);
+        obs_data_save_json_safe(config, path, "tmp", "bak");
+    }
+    obs_data_set_default_int(config, "budget_mb", MPVS_CACHE_DEFAULT_BUDGET_MB);
+    obs_data_set_default_int(config, "http_cache_mb", MPVS_CACHE_DEFAULT_HTTP_MB);
+    cache.budget = (size_t)util_max(obs_data_get_int(config, "budget_mb"), 0) * 1024 * 1024;
+    cache.http_limit = (size_t)util_max(obs_data_get_int(config, "http_cache_mb"), 0) * 1024 * 1024;
+    obs_data_release(config);
+    bfree(path);
+
+    if (cache.budget)
+        obs_log(LOG_INFO, "Demuxer cache budget is %zu MiB", cache.budget / (1024 * 1024));
+}
+
+void mpvs_cache_free(void)
+{
+    da_free(cache.sources);
+}
+
+size_t mpvs_cache_http_limit(void)
+{
+    return cache.http_limit;
+}
+
+void mpvs_cache_join(struct mpv_source* context)
+{
+    pthread_mutex_lock(&cache.mutex);
+    da_push_back(cache.sources, &context);
+    cache.dirty = true;
+    pthread_mutex_unlock(&cache.mutex);
+}
+
+void mpvs_cache_leave(struct mpv_source* context)
+{
+    pthread_mutex_lock(&cache.mutex);
+    da_erase_item(cache.sources, &context);
+    cache.dirty = true;
+    pthread_mutex_unlock(&cache.mutex);
+}
+
+void mpvs_cache_update(struct mpv_source* context, size_t forward_bytes, size_t back_bytes)
+{
+    pthread_mutex_lock(&cache.mutex);
+    context->cache_forward_bytes = forward_bytes;
+    context->cache_back_bytes = back_bytes;
+    cache.dirty = true;
+    pthread_mutex_unlock(&cache.mutex);
+}
+
+void mpvs_cache_set_timeshift(struct mpv_source* context, size_t bytes, bool on_disk)
+{
+    pthread_mutex_lock(&cache.mutex);
+    context->timeshift_bytes = bytes;
+    context->timeshift_on_disk = on_disk;
+    cache.dirty = true;
+    pthread_mutex_unlock(&cache.mutex);
+}
+
+static bool mpvs_cache_apply(struct mpv_source* core, size_t forward, size_t back)
+{
+    if (!core->init || (forward == core->cache_forward_applied && back == core->cache_back_applied))
+        return false;
+
+    char bytes[32];
+    snprintf(bytes, sizeof(bytes), "%zu", forward);
+    mpv_set_property_string(core->mpv, "demuxer-max-bytes", bytes);
+    snprintf(bytes, sizeof(bytes), "%zu", back);
+    mpv_set_property_string(core->mpv, "demuxer-max-back-bytes", bytes);
+    core->cache_forward_applied = forward;
+    core->cache_back_applied = back;
+    return true;
+}
+
+void mpvs_cache_tick(struct mpv_source* context)
+{
+    // followers of a shared instance don't have a cache of their own
+    int weight = 0;
+    if (context->mpv)
+        weight = obs_source_active(context->src) ? MPVS_CACHE_WEIGHT_ACTIVE : obs_source_showing(context->src) ? MPVS_CACHE_WEIGHT_SHOWING
+                                                                                                                  : MPVS_CACHE_WEIGHT_HIDDEN;
+    // the deck is only created and destroyed in this thread
+    int cores = context->deck && context->deck->init ? 2 : 1;
+
+    pthread_mutex_lock(&cache.mutex);
+    if (context->cache_weight != weight || context->cache_cores != cores) {
+        context->cache_weight = weight;
+        context->cache_cores = cores;
+        cache.dirty = true;
+    }
+    if (cache.dirty)
+        mpvs_cache_rebalance_locked();
+    size_t budget = context->cache_budget / cores;
+    size_t requested = mpvs_cache_requested(context) / cores;
+    size_t forward = requested ? (size_t)((double)budget * context->cache_forward_bytes / requested) : 0;
+    size_t back = budget - forward;
+    if (context->timeshift_on_disk)
+        back = util_max(back, context->timeshift_bytes);
+    pthread_mutex_unlock(&cache.mutex);
+
+    if (!weight)
+        return;
+    if (cores > 1)
+        mpvs_cache_apply(context->deck, forward, back);
+    if (mpvs_cache_apply(context, forward, back) && budget < requested)
+        obs_log(LOG_DEBUG, "[%s] Demuxer cache limited to %.1f MiB of %.1f MiB", obs_source_get_name(context->src), budget / (1024.0 * 1024.0), requested / (1024.0 * 1024.0));
+}
+
+void mpvs_cache_get_stats(struct mpv_source* context, obs_data_t* stats)
+{
+    obs_data_set_double(stats, "cache_budget_mb", context->cache_budget / (1024.0 * 1024.0));
+    if (!context->init)
+        return;
+
+    mpv_node state = { 0 };
+    if (mpv_get_property(context->mpv, "demuxer-cache-state", MPV_FORMAT_NODE, &state) >= 0 && state.format == MPV_FORMAT_NODE_MAP) {
+        for (int i = 0; i < state.u.list->num; i++) {
+            const char* key = state.u.list->keys[i];
+            mpv_node* value = &state.u.list->values[i];
+            if (value->format != MPV_FORMAT_INT64)
+                continue;
+            if (strcmp(key, "total-bytes") == 0)
+                obs_data_set_double(stats, "cache_used_mb", value->u.int64 / (1024.0 * 1024.0));
+            else if (strcmp(key, "fw-bytes") == 0)
+                obs_data_set_double(stats, "cache_forward_mb", value->u.int64 / (1024.0 * 1024.0));
+        }
+    }
+    mpv_free_node_contents(&state);
+
+    double duration = 0;
+    if (mpv_get_property(context->mpv, "demuxer-cache-duration", MPV_FORMAT_DOUBLE, &duration) >= 0)
+        obs_data_set_double(stats, "cache_duration", duration);
+}
@@ -0,0 +1,259 @@
+#include "mpv-backend.h"
+#include <obs-module.h>
+#include <util/platform.h>
+
+// Automation can cue a file and take it later. A cue loads the file paused,
+// so mpv decodes and renders its first frame and holds it. With dual deck
+// playback the file is prerolled in the second core while the current file
+// keeps playing. Otherwise it's inserted after the current entry of mpv's
+// playlist and played, and removed again once another entry starts, so the
+// playlist continues where it was. A take unpauses the cued file the same way
+// the media controls do, or cuts to the deck, on the next obs frame or the
+// first frame at or after a given obs timestamp. Requests come from proc
+// handlers on any thread and are picked up by the tick in the graphics thread.
+
+static const char* mpvs_cue_state_name(enum mpvs_cue_state state)
+{
+    switch (state) {
+    case MPVS_CUE_LOADING:
+        return "loading";
+    case MPVS_CUE_READY:
+        return "ready";
+    default:
+        return "none";
+    }
+}
+
+void mpvs_cue_request(struct mpv_source* context, const char* path)
+{
+    pthread_mutex_lock(&context->mpv_event_mutex);
+    bfree(context->cue_request);
+    context->cue_request = bstrdup(path);
+    pthread_mutex_unlock(&context->mpv_event_mutex);
+    os_atomic_set_bool(&context->cue_requested, true);
+}
+
+void mpvs_cue_take_request(struct mpv_source* context, uint64_t timestamp)
+{
+    pthread_mutex_lock(&context->mpv_event_mutex);
+    context->take_request = true;
+    context->take_request_at = timestamp;
+    pthread_mutex_unlock(&context->mpv_event_mutex);
+    os_atomic_set_bool(&context->cue_requested, true);
+}
+
+// finds the playlist index of an entry by its id, which doesn't change when
+// entries are moved or removed
+static long mpvs_cue_find_entry(struct mpv_source* context, int64_t id)
+{
+    mpv_node list = { 0 };
+    long index = -1;
+
+    if (mpv_get_property(context->mpv, "playlist", MPV_FORMAT_NODE, &list) >= 0 && list.format == MPV_FORMAT_NODE_ARRAY) {
+        for (int i = 0; i < list.u.list->num && index < 0; i++) {
+            mpv_node* entry = &list.u.list->values[i];
+            if (entry->format != MPV_FORMAT_NODE_MAP)
+                continue;
+            for (int j = 0; j < entry->u.list->num; j++) {
+                mpv_node* value = &entry->u.list->values[j];
+                if (strcmp(entry->u.list->keys[j], "id") == 0 && value->format == MPV_FORMAT_INT64 && value->u.int64 == id) {
+                    index = i;
+                    break;
+                }
+            }
+        }
+    }
+    mpv_free_node_contents(&list);
+    return index;
+}
+
+static void mpvs_cue_remove_entry(struct mpv_source* context, int64_t* id)
+{
+    if (!*id)
+        return;
+    long index = mpvs_cue_find_entry(context, *id);
+    *id = 0;
+    if (index < 0)
+        return;
+    char str[32];
+    snprintf(str, sizeof(str), "%ld", index);
+    MPV_SEND_COMMAND_ASYNC("playlist-remove", str);
+}
+
+static void mpvs_cue_start(struct mpv_source* context, char* path)
+{
+    bfree(context->cue_path);
+    context->cue_path = path;
+    context->cue_state = MPVS_CUE_LOADING;
+    context->cue_take_pending = false;
+    context->cue_start_ns = os_gettime_ns();
+
+    context->cue_on_deck = false;
+    if (context->dual_deck) {
+        mpvs_deck_cue(context, path);
+        context->cue_on_deck = context->deck && context->dual_deck;
+    }
+    if (!context->cue_on_deck) {
+        // the position of a source that just woke up isn't restored anymore
+        bfree(context->dormant_path);
+        context->dormant_path = NULL;
+
+        // pauses untimed mode and sync groups the same way the media controls do
+        mpvs_media_play_pause(context, true);
+        const char* cmd[] = { "loadfile", path, "insert-next", NULL };
+        int result = mpv_command_async(context->mpv, MPVS_CUE_LOADED, cmd);
+        if (result < 0) {
+            obs_log(LOG_ERROR, "[%s] Failed to cue %s: %s", obs_source_get_name(context->src), path, mpv_error_string(result));
+            context->cue_state = MPVS_CUE_NONE;
+        }
+    }
+    obs_log(LOG_DEBUG, "[%s] Cueing %s", obs_source_get_name(context->src), path);
+}
+
+static void mpvs_cue_ready(struct mpv_source* context)
+{
+    context->cue_state = MPVS_CUE_READY;
+    context->last_cue_ready_ns = os_gettime_ns() - context->cue_start_ns;
+    if (!context->cue_on_deck)
+        os_atomic_store_long(&context->media_state, OBS_MEDIA_STATE_PAUSED);
+    obs_log(LOG_INFO, "[%s] Cued %s in %.2f ms", obs_source_get_name(context->src), context->cue_path, context->last_cue_ready_ns / 1000000.0);
+}
+
+static void mpvs_cue_take(struct mpv_source* context)
+{
+    if (context->cue_on_deck)
+        mpvs_deck_take(context);
+    else
+        mpvs_media_play_pause(context, false);
+    context->cue_state = MPVS_CUE_NONE;
+    context->cue_take_pending = false;
+    context->cue_take_ns = os_gettime_ns();
+    obs_log(LOG_DEBUG, "[%s] Took %s", obs_source_get_name(context->src), context->cue_path);
+}
+
+void mpvs_cue_entry_added(struct mpv_source* context, mpv_event* event)
+{
+    mpv_event_command* reply = event->data;
+    if (event->error < 0 || context->cue_state != MPVS_CUE_LOADING || context->cue_on_deck) {
+        context->cue_state = MPVS_CUE_NONE;
+        return;
+    }
+
+    // loadfile returns the id of the new entry
+    mpv_node* result = &reply->result;
+    int64_t id = 0;
+    for (int i = 0; result->format == MPV_FORMAT_NODE_MAP && i < result->u.list->num; i++) {
+        if (strcmp(result->u.list->keys[i], "playlist_entry_id") == 0 && result->u.list->values[i].format == MPV_FORMAT_INT64)
+            id = result->u.list->values[i].u.int64;
+    }
+
+    // a file that was taken is removed after it's over, one that is still
+    // waiting is replaced
+    if (context->cue_entry_id && context->cue_entry_id == context->cue_playing_id) {
+        mpvs_cue_remove_entry(context, &context->cue_taken_id);
+        context->cue_taken_id = context->cue_entry_id;
+    } else {
+        mpvs_cue_remove_entry(context, &context->cue_entry_id);
+    }
+    context->cue_entry_id = id;
+
+    long index = id ? mpvs_cue_find_entry(context, id) : -1;
+    if (index < 0) {
+        obs_log(LOG_ERROR, "[%s] Cued file %s isn't in the playlist", obs_source_get_name(context->src), context->cue_path);
+        context->cue_state = MPVS_CUE_NONE;
+        return;
+    }
+
+    char str[32];
+    snprintf(str, sizeof(str), "%ld", index);
+    MPV_SEND_COMMAND_ASYNC("playlist-play-index", str);
+}
+
+void mpvs_cue_file_started(struct mpv_source* context, mpv_event_start_file* start)
+{
+    context->cue_playing_id = start->playlist_entry_id;
+    if (context->cue_taken_id != start->playlist_entry_id)
+        mpvs_cue_remove_entry(context, &context->cue_taken_id);
+    if (!context->cue_entry_id || start->playlist_entry_id == context->cue_entry_id)
+        return;
+
+    // the cued file was taken and is over, or another entry was started before
+    mpvs_cue_remove_entry(context, &context->cue_entry_id);
+    if (!context->cue_on_deck)
+        context->cue_state = MPVS_CUE_NONE;
+}
+
+void mpvs_cue_playlist_replaced(struct mpv_source* context)
+{
+    context->cue_taken_id = 0;
+    if (!context->cue_entry_id)
+        return;
+    context->cue_entry_id = 0;
+    if (!context->cue_on_deck)
+        context->cue_state = MPVS_CUE_NONE;
+}
+
+void mpvs_cue_tick(struct mpv_source* context)
+{
+    // the playlist of a source that woke up is loaded in its next update, a
+    // cue before that would be replaced by it
+    if (context->dormant_reloading)
+        return;
+
+    if (os_atomic_set_bool(&context->cue_requested, false)) {
+        pthread_mutex_lock(&context->mpv_event_mutex);
+        char* path = context->cue_request;
+        bool take = context->take_request;
+        uint64_t take_at = context->take_request_at;
+        context->cue_request = NULL;
+        context->take_request = false;
+        pthread_mutex_unlock(&context->mpv_event_mutex);
+
+        if (path)
+            mpvs_cue_start(context, path);
+        if (take && context->cue_state == MPVS_CUE_NONE) {
+            obs_log(LOG_WARNING, "[%s] Take without a cued file", obs_source_get_name(context->src));
+        } else if (take) {
+            // a take before the file is ready happens as soon as it is
+            context->cue_take_pending = true;
+            context->cue_take_at = take_at;
+        }
+    }
+
+    // the deck renders its first frame in mpvs_deck_tick, the source in the
+    // video tick which calls mpvs_cue_frame_rendered
+    if (context->cue_state == MPVS_CUE_LOADING && context->cue_on_deck) {
+        struct mpv_source* deck = context->deck;
+        if (deck && deck->file_loaded && deck->have_frame && deck->deck_file && strcmp(deck->deck_file, context->cue_path) == 0)
+            mpvs_cue_ready(context);
+    }
+
+    if (context->cue_state == MPVS_CUE_READY && context->cue_take_pending && (!context->cue_take_at || obs_get_video_frame_time() >= context->cue_take_at))
+        mpvs_cue_take(context);
+}
+
+void mpvs_cue_frame_rendered(struct mpv_source* context)
+{
+    if (context->cue_state == MPVS_CUE_LOADING && !context->cue_on_deck && context->cue_entry_id && context->cue_playing_id == context->cue_entry_id)
+        mpvs_cue_ready(context);
+
+    if (context->cue_take_ns) {
+        context->last_take_ns = os_gettime_ns() - context->cue_take_ns;
+        context->cue_take_ns = 0;
+    }
+}
+
+void mpvs_cue_free(struct mpv_source* context)
+{
+    bfree(context->cue_request);
+    bfree(context->cue_path);
+    context->cue_request = NULL;
+    context->cue_path = NULL;
+}
+
+void mpvs_cue_get_stats(struct mpv_source* context, obs_data_t* stats)
+{
+    obs_data_set_string(stats, "cue_state", mpvs_cue_state_name(context->cue_state));
+    obs_data_set_double(stats, "cue_ready_ms", context->last_cue_ready_ns / 1000000.0);
+    obs_data_set_double(stats, "take_first_frame_ms", context->last_take_ns / 1000000.0);
+}
@@ -0,0 +1,196 @@
+#include "mpv-backend.h"
+#include "wgl.h"
+#include <obs-module.h>
+#include <util/darray.h>
+#include <util/platform.h>
+
+static inline size_t mpvs_deck_next_index(struct mpv_source* context)
+{
+    size_t next = context->deck_index + 1;
+    if (next < context->files.num)
+        return next;
+    if (context->loop && context->files.num > 0)
+        return 0;
+    return SIZE_MAX;
+}
+
+static struct mpv_source* mpvs_deck_create(struct mpv_source* context)
+{
+    struct mpv_source* deck = bzalloc(sizeof(struct mpv_source));
+
+    // the deck only exists inside of the source, so it shares its obs source
+    // and borrows the jack names which are freed by the owner
+    deck->src = context->src;
+    deck->dual_deck = true;
+    deck->redraw = true;
+    deck->audio_backend = context->audio_backend;
+    deck->jack_port_name = context->jack_port_name;
+    deck->jack_client_name = context->jack_client_name;
+    deck->deck_index = SIZE_MAX;
+    deck->deck_load_request = -1;
+
+    da_init(deck->tracks);
+    pthread_mutex_init_value(&deck->mpv_event_mutex);
+    return deck;
+}
+
+static void mpvs_deck_preroll_file(struct mpv_source* context, const char* file, size_t index)
+{
+    if (!context->deck)
+        context->deck = mpvs_deck_create(context);
+
+    struct mpv_source* deck = context->deck;
+    deck->ytdl_cache = context->ytdl_cache;
+    if (!deck->init)
+        mpvs_init(deck);
+    mpvs_ytdl_register(deck);
+    if (deck->init_failed) {
+        obs_log(LOG_ERROR, "[%s] Failed to initialize second deck, disabling dual deck playback", obs_source_get_name(context->src));
+        context->dual_deck = false;
+        return;
+    }
+    // the deck gets its part of the budget before it opens the file
+    mpvs_cache_tick(context);
+
+    bfree(deck->deck_file);
+    deck->deck_file = bstrdup(file);
+    deck->deck_index = index;
+    deck->have_frame = false;
+    deck->audio_backend = context->audio_backend;
+    deck->current_audio_track = context->current_audio_track;
+    deck->current_video_track = context->current_video_track;
+    deck->current_sub_track = context->current_sub_track;
+
+    // hold the file on its first frame until we cut to it
+    mpv_set_property_string(deck->mpv, "pause", "yes");
+    mpvs_load_file(deck, file);
+}
+
+static inline void mpvs_deck_preroll(struct mpv_source* context, size_t index)
+{
+    mpvs_deck_preroll_file(context, context->files.array[index], index);
+}
+
+void mpvs_deck_cue(struct mpv_source* context, const char* file)
+{
+    // not part of the playlist, the playlist starts over after it was taken
+    mpvs_deck_preroll_file(context, file, SIZE_MAX);
+}
+
+bool mpvs_deck_tick(struct mpv_source* context)
+{
+    if (!context->dual_deck) {
+        mpvs_deck_destroy(context);
+        return false;
+    }
+
+    long request = os_atomic_set_long(&context->deck_load_request, -1);
+    if (request >= 0)
+        mpvs_deck_load(context, (size_t)request);
+
+    struct mpv_source* deck = context->deck;
+    if (deck && deck->init) {
+        pthread_mutex_lock(&deck->mpv_event_mutex);
+        bool need_redraw = deck->redraw;
+        bool need_poll = deck->new_events;
+        deck->redraw = false;
+        deck->new_events = false;
+        pthread_mutex_unlock(&deck->mpv_event_mutex);
+
+        if (need_poll)
+            mpvs_handle_events(deck);
+
+        if (deck->render && need_redraw) {
+            deck->render(deck);
+            // a render before the file is loaded still shows the previous file
+            if (deck->file_loaded)
+                deck->have_frame = true;
+        }
+    }
+
+    // a cued file stays in the deck until it's taken, see mpv-cue.c
+    if (context->cue_state != MPVS_CUE_NONE && context->cue_on_deck)
+        return false;
+
+    bool cut = os_atomic_load_bool(&context->deck_cut_pending);
+    if (!context->file_loaded && !cut)
+        return false;
+
+    size_t next = mpvs_deck_next_index(context);
+    if (next == SIZE_MAX) {
+        // nothing left to preroll, so there's no reason to keep the second core around
+        mpvs_deck_destroy(context);
+        if (os_atomic_set_bool(&context->deck_cut_pending, false))
+            os_atomic_store_long(&context->media_state, OBS_MEDIA_STATE_ENDED);
+        return false;
+    }
+
+    bool prerolled = deck && deck->deck_index == next && deck->deck_file && strcmp(deck->deck_file, context->files.array[next]) == 0;
+    if (!prerolled) {
+        // recycles the core we cut away from
+        mpvs_deck_preroll(context, next);
+        return false;
+    }
+
+    if (!cut || !deck->file_loaded || !deck->have_frame)
+        return false;
+    mpvs_deck_take(context);
+    return true;
+}
+
+void mpvs_deck_take(struct mpv_source* context)
+{
+    struct mpv_source* deck = context->deck;
+    if (!deck)
+        return;
+
+    // the render functions only know about the source, so the cut is done by
+    // swapping everything that belongs to a core between the source and the deck
+    pthread_mutex_lock(&context->core_mutex);
+    mpvs_swap_core(context, deck);
+    pthread_mutex_unlock(&context->core_mutex);
+    MPVS_SWAP(size_t, context->deck_index, deck->deck_index);
+    MPVS_SWAP(char*, context->deck_file, deck->deck_file);
+    os_atomic_set_bool(&context->deck_cut_pending, false);
+    os_atomic_set_bool(&deck->deck_cut_pending, false);
+
+    mpvs_set_mpv_properties(context);
+    mpv_set_property_string(context->mpv, "pause", "no");
+    os_atomic_store_long(&context->media_state, OBS_MEDIA_STATE_PLAYING);
+
+    // the old core stays paused on its last frame until it gets recycled
+    mpv_set_property_string(deck->mpv, "pause", "yes");
+
+    obs_log(LOG_DEBUG, "[%s] Cut to playlist entry %zu", obs_source_get_name(context->src), context->deck_index);
+}
+
+void mpvs_deck_load(struct mpv_source* context, size_t index)
+{
+    if (index >= context->files.num)
+        return;
+
+    struct mpv_source* deck = context->deck;
+    bool prerolled = deck && deck->deck_index == index && deck->deck_file && strcmp(deck->deck_file, context->files.array[index]) == 0;
+    if (prerolled && deck->file_loaded && deck->have_frame) {
+        mpvs_deck_take(context);
+        return;
+    }
+
+    context->deck_index = index;
+    os_atomic_set_bool(&context->deck_cut_pending, false);
+    bfree(context->deck_file);
+    context->deck_file = bstrdup(context->files.array[index]);
+    mpvs_load_file(context, context->deck_file);
+}
+
+void mpvs_deck_destroy(struct mpv_source* context)
+{
+    struct mpv_source* deck = context->deck;
+    if (!deck)
+        return;
+    context->deck = NULL;
+
+    mpvs_free_core(deck);
+    bfree(deck->deck_file);
+    bfree(deck);
+}
@@ -0,0 +1,715 @@
+#include "mpv-backend.h"
+#include <obs-module.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#if defined(__linux__)
+#    include <poll.h>
+#    include <sys/inotify.h>
+#    include <unistd.h>
+#endif
+
+#define MPVS_DIR_MAX_SCAN_THREADS 8
+#define MPVS_DIR_RESCAN_INTERVAL_MS 10000 // platforms without inotify
+
+struct mpvs_dir_watch {
+    int wd;
+    char* path;
+};
+
+struct mpvs_dir {
+    char* path;
+    pthread_mutex_t mutex;
+
+    // sorted index of all media files in the tree
+    DARRAY(char*)
+    files;
+    // changes to the index which haven't been picked up by the source yet
+    DARRAY(struct mpvs_dir_change)
+    changes;
+
+    bool scanned;  // the first scan of the tree is done
+    bool reported; // and the source was told about it
+
+    pthread_t thread;
+    bool thread_created;
+    volatile bool stop;
+    int inotify_fd;
+    DARRAY(struct mpvs_dir_watch)
+    watches;
+};
+
+/* Scanning ---------------------------------------------------------------- */
+
+struct mpvs_dir_scan {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    DARRAY(char*)
+    queue;
+    size_t busy; // workers currently reading a directory
+    struct darray* files;
+    struct darray* dirs;
+    volatile bool* stop; // the directory is destroyed, the rest of the tree is skipped
+};
+
+bool mpvs_is_media_file(const char* path)
+{
+    return mpvs_has_extension(path, EXTENSIONS_MEDIA);
+}
+
+bool mpvs_is_directory(const char* path)
+{
+    os_dir_t* dir = os_opendir(path);
+    if (!dir)
+        return false;
+    os_closedir(dir);
+    return true;
+}
+
+static void mpvs_dir_scan_one(struct mpvs_dir_scan* scan, const char* path)
+{
+    os_dir_t* dir = os_opendir(path);
+    if (!dir)
+        return;
+
+    struct dstr full = { 0 };
+    struct os_dirent* ent;
+    while (!*scan->stop && (ent = os_readdir(dir)) != NULL) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+            continue;
+        dstr_printf(&full, "%s/%s", path, ent->d_name);
+
+        if (ent->directory) {
+            char* p = bstrdup(full.array);
+            char* d = bstrdup(full.array);
+            pthread_mutex_lock(&scan->mutex);
+            da_push_back(scan->queue, &p);
+            if (scan->dirs)
+                darray_push_back(sizeof(char*), scan->dirs, &d);
+            else
+                bfree(d);
+            pthread_cond_signal(&scan->cond);
+            pthread_mutex_unlock(&scan->mutex);
+        } else if (mpvs_is_media_file(ent->d_name)) {
+            char* p = bstrdup(full.array);
+            pthread_mutex_lock(&scan->mutex);
+            darray_push_back(sizeof(char*), scan->files, &p);
+            pthread_mutex_unlock(&scan->mutex);
+        }
+    }
+    dstr_free(&full);
+    os_closedir(dir);
+}
+
+static void* mpvs_dir_scan_thread(void* data)
+{
+    struct mpvs_dir_scan* scan = data;
+
+    pthread_mutex_lock(&scan->mutex);
+    while (true) {
+        // the scan is done once nobody can add new directories to the queue
+        while (scan->queue.num == 0 && scan->busy > 0)
+            pthread_cond_wait(&scan->cond, &scan->mutex);
+        if (scan->queue.num == 0)
+            break;
+
+        char* path = scan->queue.array[scan->queue.num - 1];
+        da_pop_back(scan->queue);
+        scan->busy++;
+        pthread_mutex_unlock(&scan->mutex);
+
+        mpvs_dir_scan_one(scan, path);
+        bfree(path);
+
+        pthread_mutex_lock(&scan->mutex);
+        scan->busy--;
+        pthread_cond_broadcast(&scan->cond);
+    }
+    pthread_mutex_unlock(&scan->mutex);
+    return NULL;
+}
+
+static int mpvs_dir_compare(const void* a, const void* b)
+{
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+// scans the tree below root with a few threads, files end up sorted
+static void mpvs_dir_scan(const char* root, struct darray* files, struct darray* dirs, volatile bool* stop)
+{
+    struct mpvs_dir_scan scan = { 0 };
+    pthread_t threads[MPVS_DIR_MAX_SCAN_THREADS];
+    size_t thread_count = util_clamp((size_t)os_get_logical_cores(), 1, MPVS_DIR_MAX_SCAN_THREADS);
+    size_t started = 0;
+
+    pthread_mutex_init(&scan.mutex, NULL);
+    pthread_cond_init(&scan.cond, NULL);
+    scan.files = files;
+    scan.dirs = dirs;
+    scan.stop = stop;
+
+    char* p = bstrdup(root);
+    da_push_back(scan.queue, &p);
+
+    for (size_t i = 0; i < thread_count; i++) {
+        if (pthread_create(&threads[started], NULL, mpvs_dir_scan_thread, &scan) == 0)
+            started++;
+    }
+    if (started == 0)
+        mpvs_dir_scan_thread(&scan);
+    for (size_t i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    qsort(scan.files->array, scan.files->num, sizeof(char*), mpvs_dir_compare);
+
+    // directories that were skipped after a stop
+    for (size_t i = 0; i < scan.queue.num; i++)
+        bfree(scan.queue.array[i]);
+    da_free(scan.queue);
+    pthread_cond_destroy(&scan.cond);
+    pthread_mutex_destroy(&scan.mutex);
+}
+
+/* Index ------------------------------------------------------------------- */
+
+// binary search in the sorted index, returns whether the file is in it and
+// where it is or would have to be inserted
+static bool mpvs_dir_find(struct mpvs_dir* dir, const char* path, size_t* pos)
+{
+    size_t lo = 0, hi = dir->files.num;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(dir->files.array[mid], path);
+        if (cmp == 0) {
+            *pos = mid;
+            return true;
+        }
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    *pos = lo;
+    return false;
+}
+
+static void mpvs_dir_push_change(struct mpvs_dir* dir, const char* path, size_t pos, bool added)
+{
+    struct mpvs_dir_change change = { 0 };
+    change.path = bstrdup(path);
+    change.added = added;
+    if (added) {
+        if (pos > 0)
+            change.prev = bstrdup(dir->files.array[pos - 1]);
+        if (pos + 1 < dir->files.num)
+            change.next = bstrdup(dir->files.array[pos + 1]);
+    }
+    da_push_back(dir->changes, &change);
+}
+
+static void mpvs_dir_add_file(struct mpvs_dir* dir, const char* path)
+{
+    size_t pos;
+    pthread_mutex_lock(&dir->mutex);
+    if (!mpvs_dir_find(dir, path, &pos)) {
+        char* p = bstrdup(path);
+        da_insert(dir->files, pos, &p);
+        mpvs_dir_push_change(dir, path, pos, true);
+    }
+    pthread_mutex_unlock(&dir->mutex);
+}
+
+static void mpvs_dir_remove_file(struct mpvs_dir* dir, const char* path)
+{
+    size_t pos;
+    pthread_mutex_lock(&dir->mutex);
+    if (mpvs_dir_find(dir, path, &pos)) {
+        mpvs_dir_push_change(dir, path, pos, false);
+        bfree(dir->files.array[pos]);
+        da_erase(dir->files, pos);
+    }
+    pthread_mutex_unlock(&dir->mutex);
+}
+
+static void mpvs_dir_remove_tree(struct mpvs_dir* dir, const char* path)
+{
+    struct dstr prefix = { 0 };
+    dstr_printf(&prefix, "%s/", path);
+
+    pthread_mutex_lock(&dir->mutex);
+    size_t pos;
+    mpvs_dir_find(dir, prefix.array, &pos);
+    // everything below the directory is right after the prefix in the sorted index
+    while (pos < dir->files.num && strncmp(dir->files.array[pos], prefix.array, prefix.len) == 0) {
+        mpvs_dir_push_change(dir, dir->files.array[pos], pos, false);
+        bfree(dir->files.array[pos]);
+        da_erase(dir->files, pos);
+    }
+    pthread_mutex_unlock(&dir->mutex);
+    dstr_free(&prefix);
+}
+
+// compares a fresh scan with the index and records the differences, the
+// directories in the tree are added to dirs if it isn't NULL
+static void mpvs_dir_rescan(struct mpvs_dir* dir, const char* path, struct darray* dirs)
+{
+    DARRAY(char*)
+    files;
+    da_init(files);
+    mpvs_dir_scan(path, &files.da, dirs, &dir->stop);
+    if (dir->stop) {
+        // an incomplete scan would remove files that are still there
+        for (size_t i = 0; i < files.num; i++)
+            bfree(files.array[i]);
+        da_free(files);
+        return;
+    }
+
+    for (size_t i = 0; i < files.num; i++)
+        mpvs_dir_add_file(dir, files.array[i]);
+
+    struct dstr prefix = { 0 };
+    dstr_printf(&prefix, "%s/", path);
+    pthread_mutex_lock(&dir->mutex);
+    for (size_t i = dir->files.num; i > 0; i--) {
+        const char* file = dir->files.array[i - 1];
+        if (strncmp(file, prefix.array, prefix.len) != 0)
+            continue;
+        void* found = bsearch(&file, files.array, files.num, sizeof(char*), mpvs_dir_compare);
+        if (!found) {
+            mpvs_dir_push_change(dir, file, i - 1, false);
+            bfree(dir->files.array[i - 1]);
+            da_erase(dir->files, i - 1);
+        }
+    }
+    pthread_mutex_unlock(&dir->mutex);
+    dstr_free(&prefix);
+
+    for (size_t i = 0; i < files.num; i++)
+        bfree(files.array[i]);
+    da_free(files);
+}
+
+/* Watching ---------------------------------------------------------------- */
+
+static void mpvs_dir_first_scan(struct mpvs_dir* dir);
+
+#if defined(__linux__)
+static void mpvs_dir_add_watch(struct mpvs_dir* dir, const char* path)
+{
+    uint32_t mask = IN_CREATE | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+    int wd = inotify_add_watch(dir->inotify_fd, path, mask);
+    if (wd < 0) {
+        obs_log(LOG_WARNING, "Failed to watch %s for changes", path);
+        return;
+    }
+
+    for (size_t i = 0; i < dir->watches.num; i++) {
+        if (dir->watches.array[i].wd == wd)
+            return;
+    }
+    struct mpvs_dir_watch watch = { wd, bstrdup(path) };
+    da_push_back(dir->watches, &watch);
+}
+
+static const char* mpvs_dir_watch_path(struct mpvs_dir* dir, int wd)
+{
+    for (size_t i = 0; i < dir->watches.num; i++) {
+        if (dir->watches.array[i].wd == wd)
+            return dir->watches.array[i].path;
+    }
+    return NULL;
+}
+
+static void mpvs_dir_remove_watch(struct mpvs_dir* dir, int wd)
+{
+    for (size_t i = 0; i < dir->watches.num; i++) {
+        if (dir->watches.array[i].wd == wd) {
+            bfree(dir->watches.array[i].path);
+            da_erase(dir->watches, i);
+            return;
+        }
+    }
+}
+
+static void mpvs_dir_add_tree(struct mpvs_dir* dir, const char* path)
+{
+    DARRAY(char*)
+    files;
+    DARRAY(char*)
+    dirs;
+    da_init(files);
+    da_init(dirs);
+
+    mpvs_dir_add_watch(dir, path);
+    mpvs_dir_scan(path, &files.da, &dirs.da, &dir->stop);
+    for (size_t i = 0; i < dirs.num; i++) {
+        mpvs_dir_add_watch(dir, dirs.array[i]);
+        bfree(dirs.array[i]);
+    }
+    for (size_t i = 0; i < files.num; i++) {
+        mpvs_dir_add_file(dir, files.array[i]);
+        bfree(files.array[i]);
+    }
+    da_free(files);
+    da_free(dirs);
+}
+
+static void mpvs_dir_handle_event(struct mpvs_dir* dir, const struct inotify_event* event)
+{
+    if (event->mask & IN_Q_OVERFLOW) {
+        // directories that were created in the meantime aren't watched yet
+        obs_log(LOG_WARNING, "Too many changes in %s, rescanning it", dir->path);
+        DARRAY(char*)
+        dirs;
+        da_init(dirs);
+        mpvs_dir_add_watch(dir, dir->path);
+        mpvs_dir_rescan(dir, dir->path, &dirs.da);
+        for (size_t i = 0; i < dirs.num; i++) {
+            if (!dir->stop)
+                mpvs_dir_add_watch(dir, dirs.array[i]);
+            bfree(dirs.array[i]);
+        }
+        da_free(dirs);
+        return;
+    }
+    if (event->mask & IN_IGNORED) {
+        mpvs_dir_remove_watch(dir, event->wd);
+        return;
+    }
+
+    const char* parent = mpvs_dir_watch_path(dir, event->wd);
+    if (!parent || !event->len)
+        return;
+
+    struct dstr path = { 0 };
+    dstr_printf(&path, "%s/%s", parent, event->name);
+
+    if (event->mask & IN_ISDIR) {
+        if (event->mask & (IN_CREATE | IN_MOVED_TO))
+            mpvs_dir_add_tree(dir, path.array);
+        else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+            mpvs_dir_remove_tree(dir, path.array);
+    } else if (mpvs_is_media_file(event->name)) {
+        // files are only added once they've been written completely
+        if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+            mpvs_dir_add_file(dir, path.array);
+        else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+            mpvs_dir_remove_file(dir, path.array);
+    }
+    dstr_free(&path);
+}
+
+static void* mpvs_dir_watch_thread(void* data)
+{
+    struct mpvs_dir* dir = data;
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    os_set_thread_name("obs-mpv: directory watch");
+
+    mpvs_dir_first_scan(dir);
+    while (!dir->stop && dir->inotify_fd >= 0) {
+        struct pollfd pfd = { dir->inotify_fd, POLLIN, 0 };
+        if (poll(&pfd, 1, 250) <= 0)
+            continue;
+
+        ssize_t len = read(dir->inotify_fd, buf, sizeof(buf));
+        if (len <= 0)
+            continue;
+
+        for (char* ptr = buf; ptr < buf + len;) {
+            const struct inotify_event* event = (const struct inotify_event*)ptr;
+            mpvs_dir_handle_event(dir, event);
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    return NULL;
+}
+#else
+static void* mpvs_dir_watch_thread(void* data)
+{
+    struct mpvs_dir* dir = data;
+    os_set_thread_name("obs-mpv: directory watch");
+
+    mpvs_dir_first_scan(dir);
+    while (!dir->stop) {
+        for (int i = 0; i < MPVS_DIR_RESCAN_INTERVAL_MS / 250 && !dir->stop; i++)
+            os_sleep_ms(250);
+        if (!dir->stop)
+            mpvs_dir_rescan(dir, dir->path, NULL);
+    }
+    return NULL;
+}
+#endif
+
+// runs in the watch thread, a large tree can take a while to scan and the
+// source is created in the video thread
+static void mpvs_dir_first_scan(struct mpvs_dir* dir)
+{
+    uint64_t start = os_gettime_ns();
+
+#if defined(__linux__)
+    if (dir->inotify_fd >= 0) {
+        mpvs_dir_add_tree(dir, dir->path);
+    } else
+#endif
+    {
+        DARRAY(char*)
+        files;
+        da_init(files);
+        mpvs_dir_scan(dir->path, &files.da, NULL, &dir->stop);
+        pthread_mutex_lock(&dir->mutex);
+        da_move(dir->files, files);
+        pthread_mutex_unlock(&dir->mutex);
+    }
+
+    // the first scan isn't a change, the source loads the whole index once
+    // it's done
+    pthread_mutex_lock(&dir->mutex);
+    for (size_t i = 0; i < dir->changes.num; i++)
+        mpvs_dir_free_change(&dir->changes.array[i]);
+    da_resize(dir->changes, 0);
+    dir->scanned = true;
+    size_t count = dir->files.num;
+    pthread_mutex_unlock(&dir->mutex);
+
+    if (!dir->stop)
+        obs_log(LOG_INFO, "Scanned %s in %.1f ms, %zu media files", dir->path, (os_gettime_ns() - start) / 1000000.0, count);
+}
+
+/* Public functions -------------------------------------------------------- */
+
+struct mpvs_dir* mpvs_dir_create(const char* path)
+{
+    struct mpvs_dir* dir = bzalloc(sizeof(struct mpvs_dir));
+    struct dstr root = { 0 };
+    dstr_copy(&root, path);
+    while (root.len > 1 && (root.array[root.len - 1] == '/' || root.array[root.len - 1] == '\\'))
+        dstr_resize(&root, root.len - 1);
+    dir->path = bstrdup(root.array);
+    dstr_free(&root);
+
+    pthread_mutex_init(&dir->mutex, NULL);
+
+#if defined(__linux__)
+    dir->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (dir->inotify_fd < 0)
+        obs_log(LOG_WARNING, "Failed to initialize inotify, %s won't be watched for changes", dir->path);
+#endif
+
+    // the tree is scanned by the watch thread
+    dir->thread_created = pthread_create(&dir->thread, NULL, mpvs_dir_watch_thread, dir) == 0;
+    if (!dir->thread_created) {
+        obs_log(LOG_WARNING, "Failed to start the watch thread for %s, scanning it now", dir->path);
+        mpvs_dir_first_scan(dir);
+    }
+    return dir;
+}
+
+void mpvs_dir_destroy(struct mpvs_dir* dir)
+{
+    if (!dir)
+        return;
+
+    if (dir->thread_created) {
+        dir->stop = true;
+        pthread_join(dir->thread, NULL);
+    }
+#if defined(__linux__)
+    if (dir->inotify_fd >= 0)
+        close(dir->inotify_fd);
+#endif
+
+    for (size_t i = 0; i < dir->watches.num; i++)
+        bfree(dir->watches.array[i].path);
+    da_free(dir->watches);
+    for (size_t i = 0; i < dir->files.num; i++)
+        bfree(dir->files.array[i]);
+    da_free(dir->files);
+    for (size_t i = 0; i < dir->changes.num; i++)
+        mpvs_dir_free_change(&dir->changes.array[i]);
+    da_free(dir->changes);
+
+    pthread_mutex_destroy(&dir->mutex);
+    bfree(dir->path);
+    bfree(dir);
+}
+
+const char* mpvs_dir_get_path(struct mpvs_dir* dir)
+{
+    return dir->path;
+}
+
+void mpvs_dir_get_files(struct mpvs_dir* dir, struct darray* files)
+{
+    pthread_mutex_lock(&dir->mutex);
+    for (size_t i = 0; i < dir->files.num; i++) {
+        char* p = bstrdup(dir->files.array[i]);
+        darray_push_back(sizeof(char*), files, &p);
+    }
+    pthread_mutex_unlock(&dir->mutex);
+}
+
+bool mpvs_dir_pop_changes(struct mpvs_dir* dir, struct darray* changes)
+{
+    pthread_mutex_lock(&dir->mutex);
+    darray_move(changes, &dir->changes.da);
+    bool scanned = dir->scanned && !dir->reported;
+    dir->reported = dir->scanned;
+    pthread_mutex_unlock(&dir->mutex);
+    return scanned;
+}
+
+/* Playlist ---------------------------------------------------------------- */
+
+static long mpvs_dir_find_file(struct mpv_source* context, const char* path)
+{
+    for (size_t i = 0; i < context->files.num; i++) {
+        if (strcmp(context->files.array[i], path) == 0)
+            return (long)i;
+    }
+    return -1;
+}
+
+// mpv's playlist order differs from ours when it's shuffled
+static long mpvs_dir_find_playlist_entry(struct mpv_source* context, const char* path)
+{
+    mpv_node list = { 0 };
+    long index = -1;
+
+    if (mpv_get_property(context->mpv, "playlist", MPV_FORMAT_NODE, &list) >= 0 && list.format == MPV_FORMAT_NODE_ARRAY) {
+        for (int i = 0; i < list.u.list->num && index < 0; i++) {
+            mpv_node* entry = &list.u.list->values[i];
+            if (entry->format != MPV_FORMAT_NODE_MAP)
+                continue;
+            for (int j = 0; j < entry->u.list->num; j++) {
+                mpv_node* value = &entry->u.list->values[j];
+                if (strcmp(entry->u.list->keys[j], "filename") == 0 && value->format == MPV_FORMAT_STRING && strcmp(value->u.string, path) == 0) {
+                    index = i;
+                    break;
+                }
+            }
+        }
+    }
+    mpv_free_node_contents(&list);
+    return index;
+}
+
+static inline void mpvs_dir_shift_deck_index(struct mpv_source* context, size_t pos, bool added)
+{
+    struct mpv_source* cores[] = { context, context->deck };
+    for (size_t i = 0; i < 2; i++) {
+        if (!cores[i] || !cores[i]->deck_file)
+            continue;
+        if (added && pos <= cores[i]->deck_index)
+            cores[i]->deck_index++;
+        else if (!added && pos < cores[i]->deck_index)
+            cores[i]->deck_index--;
+    }
+}
+
+static void mpvs_dir_add_entry(struct mpv_source* context, struct mpvs_dir_change* change)
+{
+    long i;
+    size_t pos = context->files.num;
+    if (mpvs_dir_find_file(context, change->path) >= 0)
+        return;
+    if (change->prev && (i = mpvs_dir_find_file(context, change->prev)) >= 0)
+        pos = (size_t)i + 1;
+    else if (change->next && (i = mpvs_dir_find_file(context, change->next)) >= 0)
+        pos = (size_t)i;
+
+    char* p = bstrdup(change->path);
+    da_insert(context->files, pos, &p);
+    mpvs_probe_queue(change->path);
+
+    // the deck loads files straight from our list
+    if (context->dual_deck) {
+        mpvs_dir_shift_deck_index(context, pos, true);
+        if (context->files.num == 1)
+            os_atomic_set_long(&context->deck_load_request, 0);
+        return;
+    }
+    if (!context->init)
+        return;
+
+    const char* cmd[] = { "loadfile", change->path, "append-play", NULL };
+    int result = mpv_command(context->mpv, cmd);
+    if (result < 0) {
+        obs_log(LOG_ERROR, "[%s] Failed to add %s to the playlist: %s", obs_source_get_name(context->src), change->path, mpv_error_string(result));
+        return;
+    }
+
+    // new files are appended, move them to their sorted position
+    if (!context->shuffle && pos + 1 < context->files.num) {
+        struct dstr from = { 0 }, to = { 0 };
+        dstr_printf(&from, "%zu", context->files.num - 1);
+        dstr_printf(&to, "%zu", pos);
+        MPV_SEND_COMMAND_ASYNC("playlist-move", from.array, to.array);
+        dstr_free(&from);
+        dstr_free(&to);
+    }
+}
+
+static void mpvs_dir_remove_entry(struct mpv_source* context, struct mpvs_dir_change* change)
+{
+    long i = mpvs_dir_find_file(context, change->path);
+    if (i < 0)
+        return;
+    bfree(context->files.array[i]);
+    da_erase(context->files, (size_t)i);
+
+    if (context->dual_deck) {
+        mpvs_dir_shift_deck_index(context, (size_t)i, false);
+        return;
+    }
+    if (!context->init)
+        return;
+
+    long index = mpvs_dir_find_playlist_entry(context, change->path);
+    if (index >= 0) {
+        struct dstr str = { 0 };
+        dstr_printf(&str, "%ld", index);
+        MPV_SEND_COMMAND_ASYNC("playlist-remove", str.array);
+        dstr_free(&str);
+    }
+}
+
+void mpvs_dir_tick(struct mpv_source* context)
+{
+    DARRAY(struct mpvs_dir_change)
+    changes;
+    bool changed = false;
+
+    // the files are matched to mpv's playlist by position, the changes wait
+    // until a cued file was removed from it again
+    if (context->cue_entry_id || context->cue_taken_id)
+        return;
+
+    for (size_t i = 0; i < context->dirs.num; i++) {
+        da_init(changes);
+        // the playlist was loaded before the directory was scanned, it's
+        // loaded again with all of its files
+        if (mpvs_dir_pop_changes(context->dirs.array[i], &changes.da)) {
+            obs_log(LOG_DEBUG, "[%s] Scanned %s, reloading the playlist", obs_source_get_name(context->src), mpvs_dir_get_path(context->dirs.array[i]));
+            os_atomic_set_bool(&context->restart_requested, true);
+        }
+
+        for (size_t j = 0; j < changes.num; j++) {
+            struct mpvs_dir_change* change = &changes.array[j];
+            obs_log(LOG_INFO, "[%s] %s %s", obs_source_get_name(context->src), change->added ? "Adding" : "Removing", change->path);
+            if (change->added)
+                mpvs_dir_add_entry(context, change);
+            else
+                mpvs_dir_remove_entry(context, change);
+            mpvs_dir_free_change(change);
+            changed = true;
+        }
+        da_free(changes);
+    }
+
+    // the loop cache only works for a single file
+    if (changed)
+        mpvs_loop_cache_reset(context, true);
+}
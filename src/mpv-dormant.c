@@ -0,0 +1,113 @@
+#include "mpv-backend.h"
+#include <inttypes.h>
+#include <obs-module.h>
+#include <util/platform.h>
+
+// A source that has been hidden for longer than dormant_minutes frees its mpv
+// core, render context and textures. It remembers the file and position, which
+// are restored once the source is shown again and the playlist was reloaded.
+
+static void mpvs_dormant_sleep(struct mpv_source* context)
+{
+    bfree(context->dormant_path);
+    char* path = mpv_get_property_string(context->mpv, "path");
+    context->dormant_path = path ? bstrdup(path) : NULL;
+    mpv_free(path);
+    context->dormant_time = 0;
+    mpv_get_property(context->mpv, "playback-time", MPV_FORMAT_DOUBLE, &context->dormant_time);
+    int paused = 0;
+    mpv_get_property(context->mpv, "pause", MPV_FORMAT_FLAG, &paused);
+    context->dormant_paused = paused;
+    context->dormant_jumped = false;
+
+    mpvs_loop_cache_free(context);
+    mpvs_image_free(context);
+    // media controls and proc handlers might be using the core right now
+    pthread_mutex_lock(&context->core_mutex);
+    mpvs_deck_destroy(context);
+    mpvs_free_core(context);
+    pthread_mutex_unlock(&context->core_mutex);
+
+    // the playlist is loaded again when the source wakes up
+    for (size_t i = 0; i < context->files.num; i++)
+        bfree(context->files.array[i]);
+    da_resize(context->files, 0);
+
+    context->dormant = true;
+    obs_log(LOG_INFO, "[%s] Hidden for %d minutes, released the mpv core", obs_source_get_name(context->src), context->dormant_minutes);
+}
+
+static void mpvs_dormant_wake(struct mpv_source* context)
+{
+    context->dormant = false;
+    context->dormant_wakeups++;
+    context->dormant_wake_ns = os_gettime_ns();
+    context->dormant_reloading = true;
+    obs_log(LOG_INFO, "[%s] Waking up from dormant mode", obs_source_get_name(context->src));
+
+    // reloads the playlist, which is queued until the next tick created the core
+    obs_source_update(context->src, NULL);
+}
+
+bool mpvs_dormant_tick(struct mpv_source* context)
+{
+    bool visible = obs_source_showing(context->src) || obs_source_active(context->src);
+    if (visible || (context->dormant && !context->dormant_minutes)) {
+        context->hidden_since_ns = 0;
+        if (context->dormant)
+            mpvs_dormant_wake(context);
+        return false;
+    }
+    if (context->dormant || !context->dormant_minutes)
+        return context->dormant;
+
+    uint64_t now = os_gettime_ns();
+    if (!context->hidden_since_ns) {
+        context->hidden_since_ns = now;
+        return false;
+    }
+
+    // shared instances and sync groups rely on the core of their members
+    if (now - context->hidden_since_ns >= (uint64_t)context->dormant_minutes * 60 * 1000000000ULL && context->init && !context->shared && !context->sync)
+        mpvs_dormant_sleep(context);
+    return context->dormant;
+}
+
+void mpvs_dormant_file_loaded(struct mpv_source* context)
+{
+    if (!context->dormant_path)
+        return;
+
+    char* path = mpv_get_property_string(context->mpv, "path");
+    bool found = path && strcmp(path, context->dormant_path) == 0;
+    mpv_free(path);
+
+    if (found) {
+        char time[32];
+        snprintf(time, sizeof(time), "%f", context->dormant_time);
+        MPV_SEND_COMMAND_ASYNC("seek", time, "absolute");
+        if (context->dormant_paused)
+            MPV_SEND_COMMAND_ASYNC("set", "pause", "yes");
+    } else if (!context->dormant_jumped) {
+        // the playlist starts at its first entry, jump to the file that was playing
+        int64_t count = 0;
+        mpv_get_property(context->mpv, "playlist-count", MPV_FORMAT_INT64, &count);
+        for (int64_t i = 0; i < count; i++) {
+            char name[64];
+            snprintf(name, sizeof(name), "playlist/%" PRId64 "/filename", i);
+            char* file = mpv_get_property_string(context->mpv, name);
+            bool match = file && strcmp(file, context->dormant_path) == 0;
+            mpv_free(file);
+            if (match) {
+                snprintf(name, sizeof(name), "%" PRId64, i);
+                MPV_SEND_COMMAND_ASYNC("playlist-play-index", name);
+                context->dormant_jumped = true;
+                return;
+            }
+        }
+    }
+
+    // the file isn't in the playlist anymore or the position was restored
+    bfree(context->dormant_path);
+    context->dormant_path = NULL;
+}
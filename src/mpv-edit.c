@@ -0,0 +1,120 @@
+#include "mpv-backend.h"
+#include <ctype.h>
+#include <math.h>
+#include <obs-module.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+
+#define MPVS_EDIT_EXTENSION ".obsedit"
+
+// An edit list is a text file with one segment per line:
+//   <in> <out> <path>
+// Times are seconds or [hh:]mm:ss[.ms], an out point of - plays the file to
+// its end. Relative paths start at the directory of the edit list, lines that
+// start with # are comments. The segments are turned into an edl:// timeline,
+// so mpv plays them as one item with a single duration and no gaps.
+
+// returns the time in seconds or a negative value if it isn't one
+static double mpvs_edit_parse_time(const char* str)
+{
+    double time = 0;
+    const char* p = str;
+    while (*p) {
+        char* end;
+        double part = strtod(p, &end);
+        if (end == p || part < 0)
+            return -1;
+        time = time * 60 + part;
+        if (*end == ':')
+            end++;
+        else if (*end)
+            return -1;
+        p = end;
+    }
+    return p == str ? -1 : time;
+}
+
+static const char* mpvs_edit_next_token(const char* line, struct dstr* token)
+{
+    while (isspace((unsigned char)*line))
+        line++;
+    const char* end = line;
+    while (*end && !isspace((unsigned char)*end))
+        end++;
+    dstr_ncopy(token, line, end - line);
+    return end;
+}
+
+bool mpvs_is_edit_list(const char* path)
+{
+    const char* ext = os_get_path_extension(path);
+    return ext && astrcmpi(ext, MPVS_EDIT_EXTENSION) == 0 && os_file_exists(path);
+}
+
+char* mpvs_edit_list_to_edl(const char* path)
+{
+    char* text = os_quick_read_utf8_file(path);
+    if (!text) {
+        obs_log(LOG_ERROR, "Failed to read edit list %s", path);
+        return NULL;
+    }
+
+    struct dstr dir = { 0 };
+    dstr_copy(&dir, path);
+    dstr_replace(&dir, "\\", "/");
+    const char* slash = strrchr(dir.array, '/');
+    dstr_resize(&dir, slash ? slash - dir.array + 1 : 0);
+
+    struct dstr edl = { 0 };
+    struct dstr in = { 0 }, out = { 0 }, file = { 0 }, segment = { 0 };
+    dstr_copy(&edl, "edl://");
+    size_t segments = 0;
+    bool valid = true;
+
+    char** lines = strlist_split(text, '\n', false);
+    for (size_t i = 0; lines && lines[i] && valid; i++) {
+        const char* line = mpvs_edit_next_token(lines[i], &in);
+        if (!in.len || in.array[0] == '#')
+            continue;
+        line = mpvs_edit_next_token(line, &out);
+        dstr_copy(&file, line);
+        dstr_depad(&file);
+
+        double start = mpvs_edit_parse_time(in.array);
+        double end = out.len && strcmp(out.array, "-") != 0 ? mpvs_edit_parse_time(out.array) : INFINITY;
+        if (start < 0 || end <= start || !file.len) {
+            obs_log(LOG_ERROR, "Invalid segment in line %zu of edit list %s: %s", i + 1, path, lines[i]);
+            valid = false;
+            break;
+        }
+
+        // relative to the edit list
+        bool absolute = file.array[0] == '/' || file.array[0] == '\\' || (file.len > 1 && file.array[1] == ':') || strstr(file.array, "://");
+        if (!absolute)
+            dstr_insert(&file, 0, dir.array ? dir.array : "");
+
+        if (segments++ > 0)
+            dstr_cat(&edl, ";");
+        mpvs_edl_append(&edl, file.array);
+        dstr_printf(&segment, ",start=%f", start);
+        if (isfinite(end))
+            dstr_catf(&segment, ",length=%f", end - start);
+        dstr_cat_dstr(&edl, &segment);
+    }
+    strlist_free(lines);
+    bfree(text);
+    dstr_free(&dir);
+    dstr_free(&in);
+    dstr_free(&out);
+    dstr_free(&file);
+    dstr_free(&segment);
+
+    if (!valid || segments == 0) {
+        if (valid)
+            obs_log(LOG_WARNING, "Edit list %s has no segments", path);
+        dstr_free(&edl);
+        return NULL;
+    }
+    obs_log(LOG_DEBUG, "Edit list %s has %zu segments", path, segments);
+    return edl.array;
+}
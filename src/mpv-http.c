@@ -0,0 +1,825 @@
+#include "mpv-backend.h"
+#include <curl/curl.h>
+#include <mpv/stream_cb.h>
+#include <obs-module.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#define MPVS_HTTP_PROTOCOL "mpvs-http"
+#define MPVS_HTTP_CACHE_DIR "http-cache"
+#define MPVS_HTTP_CHUNK_SIZE (1024 * 1024)
+#define MPVS_HTTP_CONNECTIONS 4    // parallel range requests per cache file
+#define MPVS_HTTP_READAHEAD 16     // chunks after the read position that are fetched first
+#define MPVS_HTTP_MAX_FAILURES 5   // failed requests in a row before reads fail
+#define MPVS_HTTP_WAIT_MS 100
+#define MPVS_HTTP_WINDOW 32 // chunks of a download without a size that are kept on disk
+
+// http(s) playlist entries are opened through this stream instead of mpv's
+// own http reader. Files are split into chunks which are downloaded with
+// parallel range requests, starting at the read position, and stored in the
+// plugin config directory. The cache file is named after the URL and the
+// ETag the server sent, so a clip that loops or is played again is read from
+// disk as long as it didn't change on the server. Once the read ahead is
+// covered the rest of the file is downloaded in the background.
+// Servers that don't support ranges are downloaded with a single request.
+// Responses without a size, e.g. live streams, are never complete. They're
+// written into a window at the start of the cache file that is reused in a
+// loop, and the download waits for the reader before it overwrites data that
+// wasn't read yet.
+
+enum mpvs_http_chunk {
+    MPVS_HTTP_MISSING,
+    MPVS_HTTP_LOADING,
+    MPVS_HTTP_DONE,   // downloaded while the file was open
+    MPVS_HTTP_CACHED, // was on disk when the file was opened
+};
+
+// A cache file and its downloads, shared by all streams of the same URL and
+// version, e.g. two sources, both cores of the dual deck or a clip that is
+// opened again while the previous stream is still closing
+struct mpvs_http_file {
+    long refs; // guarded by http.mutex
+    char* url;
+    char* path;       // cache file
+    char* map_path;   // chunk states of the cache file
+    int64_t size;     // -1 if the server didn't send one
+    int64_t window;   // bytes of the file that are reused without a size, 0 otherwise
+    bool ranges;      // chunks are fetched in parallel, otherwise sequentially
+    bool persistent;  // the cache file is kept after the last stream is closed
+    FILE* map;        // one byte per chunk, written as chunks complete
+
+    pthread_mutex_t mutex;
+    os_event_t* data_event; // signaled when a chunk or sequential data arrived
+    os_event_t* work_event; // signaled when a read position moved
+    uint8_t* chunks;        // enum mpvs_http_chunk
+    size_t chunk_count;
+    int64_t read_pos;   // where the workers start fetching, set by the last read
+    int64_t downloaded; // sequential mode, bytes written from the start of the file
+    bool eof;           // sequential mode, the download finished
+    int failures;
+    volatile bool stop;
+
+    pthread_t workers[MPVS_HTTP_CONNECTIONS];
+    size_t worker_count;
+};
+
+// one stream that mpv opened, every stream has its own read handle
+struct mpvs_http_stream {
+    struct mpvs_http_file* f;
+    FILE* file;
+    int64_t pos;
+    volatile bool cancel;
+};
+
+struct mpvs_http_write {
+    struct mpvs_http_file* f;
+    FILE* file;
+    int64_t offset;
+    int64_t end; // last byte of the range, -1 for sequential downloads
+};
+
+static struct {
+    bool initialized;
+    size_t limit; // bytes, 0 for no limit
+    char* dir;
+    pthread_mutex_t mutex;
+    DARRAY(struct mpvs_http_file*)
+    files;               // open cache files, they're never truncated or trimmed
+    uint64_t hit_bytes;  // read from chunks that were cached before the file was opened
+    uint64_t miss_bytes; // read from chunks that had to be downloaded
+    uint64_t net_bytes;
+    uint64_t net_ns; // time spent in requests, summed over all connections
+} http = { false, 0, NULL, PTHREAD_MUTEX_INITIALIZER };
+
+static inline void mpvs_http_count(uint64_t* counter, uint64_t value)
+{
+    pthread_mutex_lock(&http.mutex);
+    *counter += value;
+    pthread_mutex_unlock(&http.mutex);
+}
+
+static uint64_t mpvs_http_hash(const char* str, uint64_t hash)
+{
+    // FNV-1a
+    for (; *str; str++)
+        hash = (hash ^ (uint8_t)*str) * 0x100000001b3ULL;
+    return hash;
+}
+
+static struct mpvs_http_file* mpvs_http_find_locked(const char* path)
+{
+    for (size_t i = 0; i < http.files.num; i++) {
+        if (strcmp(http.files.array[i]->path, path) == 0)
+            return http.files.array[i];
+    }
+    return NULL;
+}
+
+/* Cache directory --------------------------------------------------------- */
+
+struct mpvs_http_entry {
+    char* path; // without extension
+    time_t mtime;
+    int64_t size;
+};
+
+static int mpvs_http_compare_entries(const void* a, const void* b)
+{
+    const struct mpvs_http_entry* x = a;
+    const struct mpvs_http_entry* y = b;
+    return x->mtime < y->mtime ? -1 : x->mtime > y->mtime;
+}
+
+// deletes the least recently used files until there is room for size more
+// bytes, files that are open are kept, has to be called with http.mutex held
+static void mpvs_http_trim_locked(int64_t size)
+{
+    if (!http.limit)
+        return;
+
+    DARRAY(struct mpvs_http_entry)
+    entries;
+    da_init(entries);
+    int64_t total = 0;
+
+    os_dir_t* dir = os_opendir(http.dir);
+    struct os_dirent* ent;
+    while (dir && (ent = os_readdir(dir)) != NULL) {
+        const char* ext = os_get_path_extension(ent->d_name);
+        if (ent->directory || !ext || strcmp(ext, ".bin") != 0)
+            continue;
+
+        struct dstr path = { 0 };
+        dstr_printf(&path, "%s/%s", http.dir, ent->d_name);
+        struct stat st;
+        if (os_stat(path.array, &st) != 0) {
+            dstr_free(&path);
+            continue;
+        }
+        bool open = mpvs_http_find_locked(path.array) != NULL;
+        dstr_resize(&path, path.len - strlen(ext));
+
+        // the chunk map is written when a chunk completes, so its time is the last use
+        struct mpvs_http_entry entry = { path.array, st.st_mtime, (int64_t)st.st_size };
+        dstr_cat(&path, ".map");
+        if (os_stat(path.array, &st) == 0)
+            entry.mtime = st.st_mtime;
+        dstr_resize(&path, path.len - 4);
+        entry.path = path.array;
+
+        total += entry.size;
+        if (open)
+            dstr_free(&path);
+        else
+            da_push_back(entries, &entry);
+    }
+    os_closedir(dir);
+
+    qsort(entries.array, entries.num, sizeof(struct mpvs_http_entry), mpvs_http_compare_entries);
+    struct dstr path = { 0 };
+    for (size_t i = 0; i < entries.num; i++) {
+        struct mpvs_http_entry* entry = &entries.array[i];
+        if (total + size > (int64_t)http.limit) {
+            dstr_printf(&path, "%s.bin", entry->path);
+            os_unlink(path.array);
+            dstr_printf(&path, "%s.map", entry->path);
+            os_unlink(path.array);
+            total -= entry->size;
+            obs_log(LOG_DEBUG, "Removed %s.bin from the http cache", entry->path);
+        }
+        bfree(entry->path);
+    }
+    dstr_free(&path);
+    da_free(entries);
+}
+
+// the map is updated for every chunk, so a crash only loses the chunks that
+// were being downloaded
+static void mpvs_http_chunk_done_locked(struct mpvs_http_file* f, size_t chunk)
+{
+    if (f->chunks[chunk] >= MPVS_HTTP_DONE)
+        return;
+    f->chunks[chunk] = MPVS_HTTP_DONE;
+    if (f->map && os_fseeki64(f->map, (int64_t)chunk, SEEK_SET) == 0) {
+        fputc(1, f->map);
+        fflush(f->map);
+    }
+}
+
+/* Downloads --------------------------------------------------------------- */
+
+static int mpvs_http_progress(void* data, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+{
+    UNUSED_PARAMETER(dltotal);
+    UNUSED_PARAMETER(dlnow);
+    UNUSED_PARAMETER(ultotal);
+    UNUSED_PARAMETER(ulnow);
+    struct mpvs_http_file* f = data;
+    return f->stop ? 1 : 0;
+}
+
+// waits until the reader is close enough to end that the window has room
+static bool mpvs_http_wait_for_room(struct mpvs_http_file* f, int64_t end)
+{
+    while (!f->stop) {
+        pthread_mutex_lock(&f->mutex);
+        bool room = end - f->read_pos <= f->window;
+        pthread_mutex_unlock(&f->mutex);
+        if (room)
+            return true;
+        os_event_timedwait(f->work_event, MPVS_HTTP_WAIT_MS);
+    }
+    return false;
+}
+
+static size_t mpvs_http_write_data(char* data, size_t size, size_t count, void* user)
+{
+    struct mpvs_http_write* w = user;
+    struct mpvs_http_file* f = w->f;
+    size_t len = size * count;
+
+    // a server that ignores the range would overwrite the following chunks
+    if (w->end >= 0 && w->offset + (int64_t)len > w->end + 1)
+        return 0;
+    if (f->window && !mpvs_http_wait_for_room(f, w->offset + (int64_t)len))
+        return 0;
+    for (size_t done = 0; done < len;) {
+        int64_t pos = f->window ? w->offset % f->window : w->offset;
+        size_t part = f->window ? (size_t)util_min((int64_t)(len - done), f->window - pos) : len - done;
+        if (os_fseeki64(w->file, pos, SEEK_SET) != 0 || fwrite(data + done, 1, part, w->file) != part)
+            return 0;
+        done += part;
+        w->offset += part;
+    }
+
+    if (w->end < 0) {
+        fflush(w->file);
+        pthread_mutex_lock(&f->mutex);
+        f->downloaded = w->offset;
+        for (size_t i = 0; i < f->chunk_count && (int64_t)(i + 1) * MPVS_HTTP_CHUNK_SIZE <= w->offset; i++)
+            mpvs_http_chunk_done_locked(f, i);
+        pthread_mutex_unlock(&f->mutex);
+        os_event_signal(f->data_event);
+    }
+    return len;
+}
+
+static void mpvs_http_setup(struct mpvs_http_file* f, CURL* curl)
+{
+    curl_easy_reset(curl);
+    curl_easy_setopt(curl, CURLOPT_URL, f->url);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+    // stalled connections are dropped and the chunk is requested again
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1024L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 10L);
+    // a download into the window stops while playback is paused
+    if (f->window)
+        curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 0L);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, mpvs_http_progress);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, f);
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, "obs-mpv");
+}
+
+// downloads the bytes from start to end, end is -1 for the whole file
+static bool mpvs_http_fetch(struct mpvs_http_file* f, CURL* curl, FILE* file, int64_t start, int64_t end)
+{
+    struct mpvs_http_write w = { f, file, start, end };
+    mpvs_http_setup(f, curl);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, mpvs_http_write_data);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &w);
+
+    char range[64];
+    if (end >= 0) {
+        snprintf(range, sizeof(range), "%lld-%lld", (long long)start, (long long)end);
+        curl_easy_setopt(curl, CURLOPT_RANGE, range);
+    }
+
+    uint64_t begin = os_gettime_ns();
+    CURLcode result = curl_easy_perform(curl);
+    fflush(file);
+
+    pthread_mutex_lock(&http.mutex);
+    http.net_bytes += (uint64_t)(w.offset - start);
+    http.net_ns += os_gettime_ns() - begin;
+    pthread_mutex_unlock(&http.mutex);
+
+    if (result != CURLE_OK) {
+        if (!f->stop)
+            obs_log(LOG_WARNING, "Request for %s failed: %s", f->url, curl_easy_strerror(result));
+        return false;
+    }
+    return end < 0 || w.offset == end + 1;
+}
+
+// the first missing chunk of the read ahead, after that the rest of the file
+static size_t mpvs_http_next_chunk_locked(struct mpvs_http_file* f)
+{
+    size_t first = (size_t)(f->read_pos / MPVS_HTTP_CHUNK_SIZE);
+    for (size_t i = first; i < f->chunk_count && i < first + MPVS_HTTP_READAHEAD; i++) {
+        if (f->chunks[i] == MPVS_HTTP_MISSING)
+            return i;
+    }
+    for (size_t i = 0; i < f->chunk_count; i++) {
+        if (f->chunks[i] == MPVS_HTTP_MISSING)
+            return i;
+    }
+    return SIZE_MAX;
+}
+
+static void* mpvs_http_worker(void* data)
+{
+    struct mpvs_http_file* f = data;
+    os_set_thread_name("obs-mpv: http");
+
+    FILE* file = os_fopen(f->path, "r+b");
+    CURL* curl = curl_easy_init();
+    if (!file || !curl) {
+        obs_log(LOG_ERROR, "Failed to start download of %s", f->url);
+        pthread_mutex_lock(&f->mutex);
+        f->failures = MPVS_HTTP_MAX_FAILURES;
+        pthread_mutex_unlock(&f->mutex);
+        goto end;
+    }
+
+    if (!f->ranges) {
+        bool ok = mpvs_http_fetch(f, curl, file, 0, -1);
+        pthread_mutex_lock(&f->mutex);
+        f->eof = true;
+        if (ok && f->size < 0)
+            f->size = f->downloaded;
+        if (ok) {
+            for (size_t i = 0; i < f->chunk_count; i++)
+                mpvs_http_chunk_done_locked(f, i);
+        } else {
+            f->failures = MPVS_HTTP_MAX_FAILURES;
+        }
+        pthread_mutex_unlock(&f->mutex);
+        os_event_signal(f->data_event);
+        goto end;
+    }
+
+    while (!f->stop) {
+        pthread_mutex_lock(&f->mutex);
+        size_t chunk = mpvs_http_next_chunk_locked(f);
+        if (chunk != SIZE_MAX)
+            f->chunks[chunk] = MPVS_HTTP_LOADING;
+        pthread_mutex_unlock(&f->mutex);
+
+        if (chunk == SIZE_MAX)
+            break;
+
+        int64_t start = (int64_t)chunk * MPVS_HTTP_CHUNK_SIZE;
+        int64_t end = util_min(start + MPVS_HTTP_CHUNK_SIZE, f->size) - 1;
+        bool ok = mpvs_http_fetch(f, curl, file, start, end);
+
+        pthread_mutex_lock(&f->mutex);
+        if (ok)
+            mpvs_http_chunk_done_locked(f, chunk);
+        else
+            f->chunks[chunk] = MPVS_HTTP_MISSING;
+        f->failures = ok ? 0 : f->failures + 1;
+        bool failed = f->failures >= MPVS_HTTP_MAX_FAILURES;
+        pthread_mutex_unlock(&f->mutex);
+        os_event_signal(f->data_event);
+
+        if (failed)
+            break;
+        if (!ok && !f->stop)
+            os_event_timedwait(f->work_event, MPVS_HTTP_WAIT_MS * 5);
+    }
+
+end:
+    if (curl)
+        curl_easy_cleanup(curl);
+    if (file)
+        fclose(file);
+    return NULL;
+}
+
+/* Cache files ------------------------------------------------------------- */
+
+static void mpvs_http_file_destroy(struct mpvs_http_file* f)
+{
+    f->stop = true;
+    os_event_signal(f->work_event);
+    for (size_t i = 0; i < f->worker_count; i++)
+        pthread_join(f->workers[i], NULL);
+
+    if (f->map)
+        fclose(f->map);
+    if (!f->persistent && f->path) {
+        os_unlink(f->path);
+        os_unlink(f->map_path);
+    }
+
+    os_event_destroy(f->data_event);
+    os_event_destroy(f->work_event);
+    pthread_mutex_destroy(&f->mutex);
+    bfree(f->chunks);
+    bfree(f->url);
+    bfree(f->path);
+    bfree(f->map_path);
+    bfree(f);
+}
+
+static void mpvs_http_file_release(struct mpvs_http_file* f)
+{
+    pthread_mutex_lock(&http.mutex);
+    bool last = --f->refs == 0;
+    if (last)
+        da_erase_item(http.files, &f);
+    pthread_mutex_unlock(&http.mutex);
+    if (last)
+        mpvs_http_file_destroy(f);
+}
+
+struct mpvs_http_headers {
+    struct dstr etag;
+    struct dstr last_modified;
+    bool ranges;
+};
+
+static void mpvs_http_header_value(const char* line, size_t len, const char* name, struct dstr* value)
+{
+    size_t name_len = strlen(name);
+    if (len <= name_len || astrcmpi_n(line, name, name_len) != 0)
+        return;
+    dstr_ncopy(value, line + name_len, len - name_len);
+    dstr_depad(value);
+}
+
+static size_t mpvs_http_header(char* data, size_t size, size_t count, void* user)
+{
+    struct mpvs_http_headers* headers = user;
+    size_t len = size * count;
+
+    // headers of redirects are replaced by the ones of the next response
+    if (len > 5 && strncmp(data, "HTTP/", 5) == 0) {
+        dstr_free(&headers->etag);
+        dstr_free(&headers->last_modified);
+        headers->ranges = false;
+    }
+
+    struct dstr ranges = { 0 };
+    mpvs_http_header_value(data, len, "etag:", &headers->etag);
+    mpvs_http_header_value(data, len, "last-modified:", &headers->last_modified);
+    mpvs_http_header_value(data, len, "accept-ranges:", &ranges);
+    if (ranges.len)
+        headers->ranges = astrcmpi(ranges.array, "bytes") == 0;
+    dstr_free(&ranges);
+    return len;
+}
+
+// asks the server for the size and version of the file
+static int64_t mpvs_http_head(struct mpvs_http_file* f, struct mpvs_http_headers* headers)
+{
+    CURL* curl = curl_easy_init();
+    if (!curl)
+        return -1;
+
+    mpvs_http_setup(f, curl);
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, mpvs_http_header);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, headers);
+
+    CURLcode result = curl_easy_perform(curl);
+    curl_off_t length = -1;
+    if (result == CURLE_OK)
+        curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+    else
+        obs_log(LOG_WARNING, "Failed to get the headers of %s: %s", f->url, curl_easy_strerror(result));
+    curl_easy_cleanup(curl);
+
+    return result == CURLE_OK && length > 0 ? (int64_t)length : -1;
+}
+
+// reads the chunk map of a file on disk or creates an empty file, has to be
+// called with http.mutex held so no open file is replaced
+static bool mpvs_http_prepare_locked(struct mpvs_http_file* f)
+{
+    f->chunk_count = f->size > 0 ? (size_t)((f->size + MPVS_HTTP_CHUNK_SIZE - 1) / MPVS_HTTP_CHUNK_SIZE) : 0;
+    f->chunks = bzalloc(util_max(f->chunk_count, 1));
+
+    struct stat st;
+    bool reuse = f->persistent && os_stat(f->path, &st) == 0 && (int64_t)st.st_size == f->size;
+    FILE* map = reuse ? os_fopen(f->map_path, "rb") : NULL;
+    if (map) {
+        size_t read = fread(f->chunks, 1, f->chunk_count, map);
+        fclose(map);
+        for (size_t i = 0; i < f->chunk_count; i++)
+            f->chunks[i] = i < read && f->chunks[i] ? MPVS_HTTP_CACHED : MPVS_HTTP_MISSING;
+    } else {
+        mpvs_http_trim_locked(f->size > 0 ? f->size : f->window);
+        FILE* file = os_fopen(f->path, "wb");
+        if (!file) {
+            obs_log(LOG_ERROR, "Failed to create http cache file %s", f->path);
+            return false;
+        }
+        fclose(file);
+        os_unlink(f->map_path);
+    }
+    if (!f->persistent)
+        return true;
+
+    // a map that is shorter than the file counts the rest as missing
+    if (!map) {
+        FILE* file = os_fopen(f->map_path, "wb");
+        if (file)
+            fclose(file);
+    }
+    f->map = os_fopen(f->map_path, "r+b");
+    if (f->map) {
+        for (size_t i = 0; i < f->chunk_count; i++)
+            fputc(f->chunks[i] >= MPVS_HTTP_DONE, f->map);
+        fflush(f->map);
+    }
+    return true;
+}
+
+// returns the open cache file for the current version of the URL on the
+// server, or opens it and starts its downloads
+static struct mpvs_http_file* mpvs_http_file_acquire(const char* url)
+{
+    struct mpvs_http_file* f = bzalloc(sizeof(struct mpvs_http_file));
+    f->url = bstrdup(url);
+    f->refs = 1;
+    pthread_mutex_init(&f->mutex, NULL);
+    os_event_init(&f->data_event, OS_EVENT_TYPE_AUTO);
+    os_event_init(&f->work_event, OS_EVENT_TYPE_AUTO);
+
+    // servers that don't answer HEAD requests are downloaded without caching
+    struct mpvs_http_headers headers = { 0 };
+    f->size = mpvs_http_head(f, &headers);
+    f->ranges = headers.ranges && f->size > 0;
+    f->window = f->size > 0 ? 0 : MPVS_HTTP_WINDOW * MPVS_HTTP_CHUNK_SIZE;
+
+    // without a version the file can't be reused, it's only kept while it plays
+    const char* version = headers.etag.len ? headers.etag.array : headers.last_modified.array;
+    f->persistent = version && *version && f->size > 0;
+
+    uint64_t hash = mpvs_http_hash(url, 0xcbf29ce484222325ULL);
+    if (f->persistent) {
+        hash = mpvs_http_hash("\n", hash);
+        hash = mpvs_http_hash(version, hash);
+    } else {
+        // streams of the same URL without a version must not share a file
+        hash ^= (uint64_t)(uintptr_t)f ^ os_gettime_ns();
+    }
+    dstr_free(&headers.etag);
+    dstr_free(&headers.last_modified);
+
+    struct dstr path = { 0 };
+    dstr_printf(&path, "%s/%016llx.bin", http.dir, (unsigned long long)hash);
+    f->path = bstrdup(path.array);
+    dstr_resize(&path, path.len - 4);
+    dstr_cat(&path, ".map");
+    f->map_path = bstrdup(path.array);
+
+    pthread_mutex_lock(&http.mutex);
+    struct mpvs_http_file* open = mpvs_http_find_locked(f->path);
+    if (open && open->size == f->size) {
+        open->refs++;
+        pthread_mutex_unlock(&http.mutex);
+        dstr_free(&path);
+        f->persistent = true; // the path belongs to the open file
+        f->refs = 0;
+        mpvs_http_file_destroy(f);
+        return open;
+    }
+    if (open) {
+        // the server sent a different size for the same version, the open
+        // file keeps its path and this one is only used while it plays
+        obs_log(LOG_WARNING, "Size of %s changed without a new version, it isn't cached", url);
+        f->persistent = false;
+        bfree(f->path);
+        bfree(f->map_path);
+        dstr_printf(&path, "%s/%016llx-%p.bin", http.dir, (unsigned long long)hash, (void*)f);
+        f->path = bstrdup(path.array);
+        dstr_resize(&path, path.len - 4);
+        dstr_cat(&path, ".map");
+        f->map_path = bstrdup(path.array);
+    }
+    dstr_free(&path);
+
+    bool ok = mpvs_http_prepare_locked(f);
+    if (ok)
+        da_push_back(http.files, &f);
+    pthread_mutex_unlock(&http.mutex);
+    if (!ok) {
+        f->persistent = false;
+        mpvs_http_file_destroy(f);
+        return NULL;
+    }
+
+    size_t missing = 0;
+    for (size_t i = 0; i < f->chunk_count; i++)
+        missing += f->chunks[i] == MPVS_HTTP_MISSING;
+
+    if (missing > 0 || f->chunk_count == 0) {
+        size_t workers = f->ranges ? util_min(missing, MPVS_HTTP_CONNECTIONS) : 1;
+        for (size_t i = 0; i < workers; i++) {
+            if (pthread_create(&f->workers[f->worker_count], NULL, mpvs_http_worker, f) == 0)
+                f->worker_count++;
+        }
+        if (!f->worker_count) {
+            obs_log(LOG_ERROR, "Failed to start download threads for %s", f->url);
+            mpvs_http_file_release(f);
+            return NULL;
+        }
+    }
+
+    if (f->window)
+        obs_log(LOG_DEBUG, "Opened %s without a size, keeping the last %d MiB", f->url, MPVS_HTTP_WINDOW);
+    else
+        obs_log(LOG_DEBUG, "Opened %s (%.1f MiB, %zu of %zu chunks cached%s)", f->url, f->size / (1024.0 * 1024.0),
+            f->chunk_count - missing, f->chunk_count, f->ranges ? "" : ", no range requests");
+    return f;
+}
+
+/* Stream callbacks -------------------------------------------------------- */
+
+// returns how many bytes can be read at pos without waiting, -1 if the data
+// was already overwritten in the window
+static int64_t mpvs_http_available_locked(struct mpvs_http_file* f, int64_t pos)
+{
+    if (f->window) {
+        if (pos < f->downloaded - f->window)
+            return -1;
+        if (pos >= f->downloaded)
+            return 0;
+        // up to the end of the window, the rest is at its start
+        return util_min(f->downloaded - pos, f->window - pos % f->window);
+    }
+    if (pos < f->downloaded)
+        return f->downloaded - pos;
+    size_t chunk = (size_t)(pos / MPVS_HTTP_CHUNK_SIZE);
+    if (f->size >= 0 && chunk < f->chunk_count && f->chunks[chunk] >= MPVS_HTTP_DONE)
+        return util_min((int64_t)(chunk + 1) * MPVS_HTTP_CHUNK_SIZE, f->size) - pos;
+    return 0;
+}
+
+static int64_t mpvs_http_read(void* cookie, char* buf, uint64_t nbytes)
+{
+    struct mpvs_http_stream* s = cookie;
+    struct mpvs_http_file* f = s->f;
+    int64_t pos = s->pos;
+
+    pthread_mutex_lock(&f->mutex);
+    f->read_pos = pos;
+    pthread_mutex_unlock(&f->mutex);
+    os_event_signal(f->work_event);
+
+    int64_t available;
+    bool cached;
+    while (true) {
+        pthread_mutex_lock(&f->mutex);
+        bool end = f->size >= 0 ? pos >= f->size : f->eof && pos >= f->downloaded;
+        bool failed = f->failures >= MPVS_HTTP_MAX_FAILURES;
+        available = mpvs_http_available_locked(f, pos);
+        size_t chunk = (size_t)(pos / MPVS_HTTP_CHUNK_SIZE);
+        cached = chunk < f->chunk_count && f->chunks[chunk] == MPVS_HTTP_CACHED;
+        pthread_mutex_unlock(&f->mutex);
+
+        if (end)
+            return 0;
+        if (available > 0)
+            break;
+        if (s->cancel || failed || available < 0)
+            return -1;
+        // the data event is shared by all readers of the file, so the wait is short
+        os_event_timedwait(f->data_event, MPVS_HTTP_WAIT_MS);
+    }
+
+    size_t len = (size_t)util_min((int64_t)nbytes, available);
+    if (os_fseeki64(s->file, f->window ? pos % f->window : pos, SEEK_SET) != 0)
+        return -1;
+    len = fread(buf, 1, len, s->file);
+    if (len == 0)
+        return -1;
+
+    s->pos += len;
+    mpvs_http_count(cached ? &http.hit_bytes : &http.miss_bytes, len);
+    return (int64_t)len;
+}
+
+static int64_t mpvs_http_seek(void* cookie, int64_t offset)
+{
+    struct mpvs_http_stream* s = cookie;
+    if (offset < 0 || (s->f->size >= 0 && offset > s->f->size))
+        return MPV_ERROR_GENERIC;
+    s->pos = offset;
+    return offset;
+}
+
+static int64_t mpvs_http_size(void* cookie)
+{
+    struct mpvs_http_stream* s = cookie;
+    return s->f->size >= 0 ? s->f->size : MPV_ERROR_UNSUPPORTED;
+}
+
+static void mpvs_http_cancel(void* cookie)
+{
+    // only this stream stops waiting, the downloads may still be used by others
+    struct mpvs_http_stream* s = cookie;
+    s->cancel = true;
+    os_event_signal(s->f->data_event);
+}
+
+static void mpvs_http_close(void* cookie)
+{
+    struct mpvs_http_stream* s = cookie;
+    if (s->file)
+        fclose(s->file);
+    mpvs_http_file_release(s->f);
+    bfree(s);
+}
+
+static int mpvs_http_open(void* user_data, char* uri, mpv_stream_cb_info* info)
+{
+    UNUSED_PARAMETER(user_data);
+    const char* url = uri + strlen(MPVS_HTTP_PROTOCOL "://");
+
+    struct mpvs_http_file* f = mpvs_http_file_acquire(url);
+    if (!f)
+        return MPV_ERROR_LOADING_FAILED;
+
+    struct mpvs_http_stream* s = bzalloc(sizeof(struct mpvs_http_stream));
+    s->f = f;
+    s->file = os_fopen(f->path, "rb");
+    if (!s->file) {
+        mpvs_http_close(s);
+        return MPV_ERROR_LOADING_FAILED;
+    }
+
+    info->cookie = s;
+    info->read_fn = mpvs_http_read;
+    info->seek_fn = mpvs_http_seek;
+    info->size_fn = mpvs_http_size;
+    info->close_fn = mpvs_http_close;
+    info->cancel_fn = mpvs_http_cancel;
+    return 0;
+}
+
+/* Module functions -------------------------------------------------------- */
+
+void mpvs_http_init(void)
+{
+    if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK) {
+        obs_log(LOG_ERROR, "Failed to initialize libcurl, the http cache is disabled");
+        return;
+    }
+
+    http.dir = obs_module_config_path(MPVS_HTTP_CACHE_DIR);
+    os_mkdirs(http.dir);
+    http.limit = mpvs_cache_http_limit();
+    http.initialized = true;
+    pthread_mutex_lock(&http.mutex);
+    mpvs_http_trim_locked(0);
+    pthread_mutex_unlock(&http.mutex);
+}
+
+void mpvs_http_free(void)
+{
+    if (!http.initialized)
+        return;
+    curl_global_cleanup();
+    da_free(http.files);
+    bfree(http.dir);
+    http.dir = NULL;
+    http.initialized = false;
+}
+
+char* mpvs_http_cache_url(const char* url)
+{
+    if (!http.initialized)
+        return bstrdup(url);
+    struct dstr str = { 0 };
+    dstr_printf(&str, "%s://%s", MPVS_HTTP_PROTOCOL, url);
+    return str.array;
+}
+
+void mpvs_http_register(struct mpv_source* context)
+{
+    if (!http.initialized)
+        return;
+    int result = mpv_stream_cb_add_ro(context->mpv, MPVS_HTTP_PROTOCOL, NULL, mpvs_http_open);
+    if (result < 0)
+        obs_log(LOG_ERROR, "[%s] Failed to register http cache stream: %s", obs_source_get_name(context->src), mpv_error_string(result));
+}
+
+void mpvs_http_get_stats(obs_data_t* stats)
+{
+    pthread_mutex_lock(&http.mutex);
+    uint64_t read = http.hit_bytes + http.miss_bytes;
+    obs_data_set_double(stats, "http_cache_hit_rate", read ? (double)http.hit_bytes / read : 0.0);
+    obs_data_set_double(stats, "http_cache_read_mb", read / (1024.0 * 1024.0));
+    obs_data_set_double(stats, "http_downloaded_mb", http.net_bytes / (1024.0 * 1024.0));
+    obs_data_set_double(stats, "http_throughput_mbps", http.net_ns ? http.net_bytes * 8000.0 / http.net_ns : 0.0);
+    pthread_mutex_unlock(&http.mutex);
+}
@@ -0,0 +1,163 @@
+#include "mpv-backend.h"
+#include <graphics/image-file.h>
+#include <inttypes.h>
+#include <obs-module.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+// Images are decoded by mpv when the playlist advances to them, which can
+// take a while for large photos. The next image in the playlist is decoded
+// in the background and shown until mpv has rendered its first frame.
+// A decode can't be interrupted and the graphics thread must not wait for it,
+// so a decode that isn't needed anymore is abandoned. The job is shared by
+// the source and the decode thread, whichever is done with it last frees it.
+
+struct mpvs_image_job {
+    char* name; // of the source, which might be gone by the time the decode is done
+    char* path;
+    gs_image_file_t image;
+    volatile bool decoded;
+    volatile long refs;
+};
+
+// decodes that are still running, the module waits for them when it's unloaded
+static volatile long image_jobs = 0;
+
+static void mpvs_image_job_release(struct mpvs_image_job* job)
+{
+    if (os_atomic_dec_long(&job->refs) > 0)
+        return;
+    obs_enter_graphics();
+    gs_image_file_free(&job->image);
+    obs_leave_graphics();
+    bfree(job->name);
+    bfree(job->path);
+    bfree(job);
+}
+
+static void* mpvs_image_thread(void* data)
+{
+    struct mpvs_image_job* job = data;
+    os_set_thread_name("obs-mpv: image prefetch");
+
+    uint64_t start = os_gettime_ns();
+    gs_image_file_init(&job->image, job->path);
+    if (job->image.loaded) {
+        obs_log(LOG_DEBUG, "[%s] Decoded %s (%ux%u) in %.1f ms", job->name, job->path, job->image.cx, job->image.cy,
+            (os_gettime_ns() - start) / 1000000.0);
+    }
+    os_atomic_set_bool(&job->decoded, true);
+    mpvs_image_job_release(job);
+    os_atomic_dec_long(&image_jobs);
+    return NULL;
+}
+
+static void mpvs_image_prefetch(struct mpv_source* context, const char* path)
+{
+    // the image that is being decoded or was decoded already
+    if (context->image_path && strcmp(context->image_path, path) == 0)
+        return;
+
+    mpvs_image_free(context);
+    context->image_path = bstrdup(path);
+
+    struct mpvs_image_job* job = bzalloc(sizeof(struct mpvs_image_job));
+    job->name = bstrdup(obs_source_get_name(context->src));
+    job->path = bstrdup(path);
+    job->refs = 2;
+
+    pthread_t thread;
+    os_atomic_inc_long(&image_jobs);
+    if (pthread_create(&thread, NULL, mpvs_image_thread, job) != 0) {
+        obs_log(LOG_WARNING, "[%s] Failed to start image prefetch thread", obs_source_get_name(context->src));
+        os_atomic_dec_long(&image_jobs);
+        job->refs = 1;
+        mpvs_image_job_release(job);
+        return;
+    }
+    pthread_detach(thread);
+    context->image_job = job;
+}
+
+void mpvs_image_prefetch_next(struct mpv_source* context)
+{
+    // the second deck already prerolls the next entry
+    if (context->dual_deck)
+        return;
+
+    int64_t pos = 0, count = 0;
+    if (mpv_get_property(context->mpv, "playlist-pos", MPV_FORMAT_INT64, &pos) < 0 || mpv_get_property(context->mpv, "playlist-count", MPV_FORMAT_INT64, &count) < 0)
+        return;
+
+    int64_t next = pos + 1;
+    if (next >= count) {
+        if (!context->loop)
+            return;
+        next = 0;
+    }
+    if (next == pos)
+        return;
+
+    // the playlist property is in mpv's order, so this also works when it's shuffled
+    char name[64];
+    snprintf(name, sizeof(name), "playlist/%" PRId64 "/filename", next);
+    char* file = mpv_get_property_string(context->mpv, name);
+    if (file && mpvs_has_extension(file, EXTENSIONS_IMAGE))
+        mpvs_image_prefetch(context, file);
+    mpv_free(file);
+}
+
+bool mpvs_image_pending(struct mpv_source* context)
+{
+    return context->image_job && os_atomic_load_bool(&context->image_job->decoded);
+}
+
+void mpvs_image_tick(struct mpv_source* context)
+{
+    if (!mpvs_image_pending(context))
+        return;
+
+    // the decode thread is done with the job, the image moves to the source
+    struct mpvs_image_job* job = context->image_job;
+    context->image_job = NULL;
+    if (job->image.loaded && !job->image.is_animated_gif) {
+        context->image = job->image;
+        memset(&job->image, 0, sizeof(job->image));
+        gs_image_file_init_texture(&context->image);
+    }
+    mpvs_image_job_release(job);
+}
+
+void mpvs_image_file_started(struct mpv_source* context)
+{
+    context->image_showing = false;
+    if (!context->image_path || !context->image.texture)
+        return;
+
+    char* path = mpv_get_property_string(context->mpv, "path");
+    context->image_showing = path && strcmp(path, context->image_path) == 0;
+    mpv_free(path);
+}
+
+void mpvs_image_free(struct mpv_source* context)
+{
+    // a decode that is still running frees the job when it's done
+    if (context->image_job) {
+        mpvs_image_job_release(context->image_job);
+        context->image_job = NULL;
+    }
+
+    obs_enter_graphics();
+    gs_image_file_free(&context->image);
+    obs_leave_graphics();
+
+    context->image_showing = false;
+    bfree(context->image_path);
+    context->image_path = NULL;
+}
+
+void mpvs_image_wait(void)
+{
+    while (os_atomic_load_long(&image_jobs) > 0)
+        os_sleep_ms(10);
+}
@@ -0,0 +1,172 @@
+#include "mpv-backend.h"
+#include <obs-module.h>
+#include <util/darray.h>
+#include <util/platform.h>
+
+static inline bool mpvs_loop_cache_has_audio(struct mpv_source* context)
+{
+    for (size_t i = 0; i < context->tracks.num; i++) {
+        if (context->tracks.array[i].type == MPV_TRACK_TYPE_AUDIO)
+            return true;
+    }
+    return false;
+}
+
+static bool mpvs_loop_cache_eligible(struct mpv_source* context)
+{
+    // only a single looping clip can be played back from memory, and audio
+    // would stop once mpv is paused. Untimed mode and sync groups control
+    // mpv's playback themselves.
+    if (!context->loop || context->dual_deck || context->untimed || context->sync || context->files.num != 1 || mpvs_loop_cache_has_audio(context))
+        return false;
+
+    double duration = 0, fps = 0;
+    if (mpv_get_property(context->mpv, "duration", MPV_FORMAT_DOUBLE, &duration) < 0 || duration <= 0)
+        return false;
+    if (duration > context->loop_cache_max_duration)
+        return false;
+    if (mpv_get_property(context->mpv, "container-fps", MPV_FORMAT_DOUBLE, &fps) < 0 || fps <= 0)
+        fps = 30;
+
+    size_t frame_size = (size_t)context->d3d_width * context->d3d_height * 4;
+    size_t estimate = frame_size * (size_t)ceil(duration * fps);
+    if (estimate > context->loop_cache_max_memory) {
+        obs_log(LOG_DEBUG, "[%s] Clip needs ~%zu MB, not caching it", obs_source_get_name(context->src), estimate / (1024 * 1024));
+        return false;
+    }
+
+    context->loop_duration = duration;
+    return true;
+}
+
+static void mpvs_loop_cache_record(struct mpv_source* context)
+{
+    double pts = 0;
+    if (mpv_get_property(context->mpv, "playback-time", MPV_FORMAT_DOUBLE, &pts) < 0)
+        return;
+
+    bool wrapped = context->loop_frames.num > 0 && pts < da_end(context->loop_frames)->pts;
+    if (wrapped) {
+        // the clip started over, which means we have all of its frames
+        context->loop_cache_state = MPVS_LOOP_CACHE_PLAYING;
+        os_atomic_set_bool(&context->loop_cache_playing, true);
+        context->loop_frame_index = 0;
+        // follows the obs clock like the frames mpv renders for obs
+        context->loop_start_ts = obs_get_video_frame_time() - (uint64_t)(pts * 1000000000.0);
+        mpv_set_property_string(context->mpv, "pause", "yes");
+        obs_log(LOG_INFO, "[%s] Playing %zu frames (%.1f MB) from the loop cache", obs_source_get_name(context->src),
+            context->loop_frames.num, context->loop_memory / (1024.0 * 1024.0));
+        return;
+    }
+
+    size_t frame_size = (size_t)context->d3d_width * context->d3d_height * 4;
+    if (context->loop_memory + frame_size > context->loop_cache_max_memory) {
+        obs_log(LOG_WARNING, "[%s] Loop cache memory limit reached, disabling it for this clip", obs_source_get_name(context->src));
+        mpvs_loop_cache_free(context);
+        context->loop_cache_rejected = true;
+        return;
+    }
+
+    struct mpvs_loop_frame frame;
+    frame.pts = pts;
+    frame.texture = gs_texture_create(context->d3d_width, context->d3d_height, GS_RGBA, 1, NULL, 0);
+    if (!frame.texture)
+        return;
+    gs_copy_texture(frame.texture, context->video_buffer);
+    da_push_back(context->loop_frames, &frame);
+    context->loop_memory += frame_size;
+}
+
+static void mpvs_loop_cache_play(struct mpv_source* context)
+{
+    double t = fmod((obs_get_video_frame_time() - context->loop_start_ts) / 1000000000.0, context->loop_duration);
+
+    // frames are sorted by their timestamp and playback only moves forward
+    // until the clip starts over
+    if (t < context->loop_frames.array[context->loop_frame_index].pts)
+        context->loop_frame_index = 0;
+    while (context->loop_frame_index + 1 < context->loop_frames.num && context->loop_frames.array[context->loop_frame_index + 1].pts <= t)
+        context->loop_frame_index++;
+}
+
+void mpvs_loop_cache_tick(struct mpv_source* context, bool rendered)
+{
+    // the resume flag is written before the reset flag, see mpvs_loop_cache_reset
+    bool reset = os_atomic_set_bool(&context->loop_cache_reset, false);
+    if (reset && context->loop_cache_state == MPVS_LOOP_CACHE_OFF && !context->loop_cache_rejected)
+        return;
+    if (reset || (!context->loop_cache && context->loop_cache_state != MPVS_LOOP_CACHE_OFF)) {
+        bool unpause = context->loop_cache_state == MPVS_LOOP_CACHE_PLAYING && (!reset || os_atomic_load_bool(&context->loop_cache_resume));
+        mpvs_loop_cache_free(context);
+        if (unpause)
+            mpv_set_property_string(context->mpv, "pause", "no");
+        return;
+    }
+
+    if (!context->loop_cache || !context->file_loaded)
+        return;
+
+    double pts = 0;
+    switch (context->loop_cache_state) {
+    case MPVS_LOOP_CACHE_OFF:
+        if (!rendered || context->loop_cache_rejected)
+            break;
+        if (!mpvs_loop_cache_eligible(context)) {
+            context->loop_cache_rejected = true;
+            break;
+        }
+        context->loop_cache_state = MPVS_LOOP_CACHE_WAITING;
+        /* fall through */
+    case MPVS_LOOP_CACHE_WAITING:
+        // recording has to start at the beginning of the clip
+        if (!rendered || mpv_get_property(context->mpv, "playback-time", MPV_FORMAT_DOUBLE, &pts) < 0 || pts > 0.1)
+            break;
+        context->loop_cache_state = MPVS_LOOP_CACHE_RECORDING;
+        /* fall through */
+    case MPVS_LOOP_CACHE_RECORDING:
+        if (rendered)
+            mpvs_loop_cache_record(context);
+        break;
+    case MPVS_LOOP_CACHE_PLAYING:
+        mpvs_loop_cache_play(context);
+        break;
+    }
+}
+
+void mpvs_loop_cache_reset(struct mpv_source* context, bool resume)
+{
+    // the media controls call this from the UI thread, the state of the
+    // cache is only checked in the tick
+    os_atomic_set_bool(&context->loop_cache_resume, resume);
+    os_atomic_set_bool(&context->loop_cache_reset, true);
+}
+
+gs_texture_t* mpvs_loop_cache_texture(struct mpv_source* context)
+{
+    if (context->loop_cache_state == MPVS_LOOP_CACHE_PLAYING && context->loop_frames.num > 0)
+        return context->loop_frames.array[context->loop_frame_index].texture;
+    return context->video_buffer;
+}
+
+int64_t mpvs_loop_cache_time(struct mpv_source* context)
+{
+    if (context->loop_duration <= 0)
+        return 0;
+    double t = fmod((obs_get_video_frame_time() - context->loop_start_ts) / 1000000000.0, context->loop_duration);
+    return (int64_t)(t * 1000);
+}
+
+void mpvs_loop_cache_free(struct mpv_source* context)
+{
+    obs_enter_graphics();
+    for (size_t i = 0; i < context->loop_frames.num; i++)
+        gs_texture_destroy(context->loop_frames.array[i].texture);
+    obs_leave_graphics();
+
+    da_free(context->loop_frames);
+    context->loop_frame_index = 0;
+    context->loop_memory = 0;
+    context->loop_cache_state = MPVS_LOOP_CACHE_OFF;
+    os_atomic_set_bool(&context->loop_cache_playing, false);
+    context->loop_cache_rejected = false;
+}
@@ -0,0 +1,364 @@
+#include "mpv-backend.h"
+#include <obs-module.h>
+#include <sys/stat.h>
+#include <util/darray.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#define MPVS_PROBE_CACHE_FILE "probe-cache.json"
+#define MPVS_PROBE_TIMEOUT_NS 10000000000ULL
+
+// Probing happens on a separate headless mpv core so that we know the tracks
+// and durations of playlist entries before the live player loads them
+static struct {
+    pthread_t thread;
+    bool thread_created;
+    volatile bool stop;
+    pthread_mutex_t mutex;
+    os_sem_t* queue_sem;
+    DARRAY(char*)
+    queue;
+
+    obs_data_t* cache; // path -> probe result
+    bool dirty;
+} probe;
+
+static inline bool mpvs_probe_stat(const char* path, long long* size, long long* mtime)
+{
+    struct stat st;
+    if (os_stat(path, &st) != 0)
+        return false;
+    *size = (long long)st.st_size;
+    *mtime = (long long)st.st_mtime;
+    return true;
+}
+
+static obs_data_t* mpvs_probe_read(mpv_handle* mpv)
+{
+    obs_data_t* entry = obs_data_create();
+    obs_data_array_t* track_array = obs_data_array_create();
+    mpv_node tracks = { 0 };
+    double duration = 0;
+
+    if (mpv_get_property(mpv, "duration", MPV_FORMAT_DOUBLE, &duration) >= 0)
+        obs_data_set_double(entry, "duration", duration);
+
+    if (mpv_get_property(mpv, "track-list", MPV_FORMAT_NODE, &tracks) < 0 || tracks.format != MPV_FORMAT_NODE_ARRAY)
+        goto end;
+
+    for (int i = 0; i < tracks.u.list->num; i++) {
+        mpv_node* track = &tracks.u.list->values[i];
+        if (track->format != MPV_FORMAT_NODE_MAP)
+            continue;
+
+        obs_data_t* item = obs_data_create();
+        for (int j = 0; j < track->u.list->num; j++) {
+            const char* key = track->u.list->keys[j];
+            mpv_node* value = &track->u.list->values[j];
+
+            if (value->format == MPV_FORMAT_STRING) {
+                if (strcmp(key, "type") == 0 || strcmp(key, "title") == 0 || strcmp(key, "lang") == 0)
+                    obs_data_set_string(item, key, value->u.string);
+            } else if (value->format == MPV_FORMAT_INT64) {
+                if (strcmp(key, "id") == 0 || strcmp(key, "demux-w") == 0 || strcmp(key, "demux-h") == 0)
+                    obs_data_set_int(item, key, value->u.int64);
+            }
+        }
+
+        // the size of the first video track is the size of the file
+        if (strcmp(obs_data_get_string(item, "type"), "video") == 0 && !obs_data_has_user_value(entry, "width")) {
+            obs_data_set_int(entry, "width", obs_data_get_int(item, "demux-w"));
+            obs_data_set_int(entry, "height", obs_data_get_int(item, "demux-h"));
+        }
+        obs_data_array_push_back(track_array, item);
+        obs_data_release(item);
+    }
+
+end:
+    obs_data_set_array(entry, "tracks", track_array);
+    obs_data_array_release(track_array);
+    mpv_free_node_contents(&tracks);
+    return entry;
+}
+
+static obs_data_t* mpvs_probe_file(mpv_handle** core, const char* path)
+{
+    mpv_handle* mpv = *core;
+    const char* cmd[] = { "loadfile", path, NULL };
+    int result = mpv_command(mpv, cmd);
+    if (result < 0) {
+        obs_log(LOG_WARNING, "Failed to probe %s: %s", path, mpv_error_string(result));
+        return NULL;
+    }
+
+    obs_data_t* entry = NULL;
+    bool done = false;
+    uint64_t deadline = os_gettime_ns() + MPVS_PROBE_TIMEOUT_NS;
+    while (!probe.stop && !done && os_gettime_ns() < deadline) {
+        mpv_event* event = mpv_wait_event(mpv, 0.25);
+        if (event->event_id == MPV_EVENT_FILE_LOADED) {
+            entry = mpvs_probe_read(mpv);
+            done = true;
+        } else if (event->event_id == MPV_EVENT_END_FILE) {
+            // the previous file being stopped also ends up here
+            mpv_event_end_file* end_file = event->data;
+            done = end_file->reason != MPV_END_FILE_REASON_STOP;
+        }
+    }
+
+    // a core with a stuck demuxer might not stop either, it's replaced by a
+    // new one for the next file
+    if (!done && !probe.stop) {
+        obs_log(LOG_WARNING, "Timed out probing %s", path);
+        mpvs_reaper_queue(mpv, "probe");
+        *core = NULL;
+        return NULL;
+    }
+
+    const char* stop_cmd[] = { "stop", NULL };
+    mpv_command(mpv, stop_cmd);
+    return entry;
+}
+
+static mpv_handle* mpvs_probe_create_core(void)
+{
+    mpv_handle* mpv = mpv_create();
+    if (!mpv)
+        return NULL;
+
+    mpv_set_option_string(mpv, "config", "no");
+    mpv_set_option_string(mpv, "load-scripts", "no");
+    mpv_set_option_string(mpv, "ytdl", "no");
+    mpv_set_option_string(mpv, "idle", "yes");
+    mpv_set_option_string(mpv, "pause", "yes");
+    mpv_set_option_string(mpv, "vo", "null");
+    mpv_set_option_string(mpv, "ao", "null");
+
+    if (mpv_initialize(mpv) < 0) {
+        mpv_destroy(mpv);
+        return NULL;
+    }
+    return mpv;
+}
+
+// drops the results of files that were deleted or changed since they were
+// probed, otherwise the cache would keep every file that was ever played
+static void mpvs_probe_prune(void)
+{
+    DARRAY(char*)
+    paths;
+    da_init(paths);
+    pthread_mutex_lock(&probe.mutex);
+    for (obs_data_item_t* item = obs_data_first(probe.cache); item; obs_data_item_next(&item)) {
+        char* path = bstrdup(obs_data_item_get_name(item));
+        da_push_back(paths, &path);
+    }
+    pthread_mutex_unlock(&probe.mutex);
+
+    size_t pruned = 0;
+    for (size_t i = 0; i < paths.num; i++) {
+        obs_data_t* entry = mpvs_probe_get(paths.array[i]);
+        if (!entry) {
+            pthread_mutex_lock(&probe.mutex);
+            obs_data_erase(probe.cache, paths.array[i]);
+            probe.dirty = true;
+            pthread_mutex_unlock(&probe.mutex);
+            pruned++;
+        }
+        obs_data_release(entry);
+        bfree(paths.array[i]);
+    }
+    da_free(paths);
+    if (pruned)
+        obs_log(LOG_DEBUG, "Removed %zu changed or deleted files from the media probe cache", pruned);
+}
+
+static void mpvs_probe_save(void)
+{
+    mpvs_probe_prune();
+    if (!probe.dirty)
+        return;
+
+    char* path = obs_module_config_path(MPVS_PROBE_CACHE_FILE);
+    char* dir = obs_module_config_path("");
+    os_mkdirs(dir);
+
+    pthread_mutex_lock(&probe.mutex);
+    if (probe.dirty && !obs_data_save_json_safe(probe.cache, path, "tmp", "bak"))
+        obs_log(LOG_WARNING, "Failed to save media probe cache to %s", path);
+    probe.dirty = false;
+    pthread_mutex_unlock(&probe.mutex);
+
+    bfree(dir);
+    bfree(path);
+}
+
+static void* mpvs_probe_thread(void* data)
+{
+    UNUSED_PARAMETER(data);
+    os_set_thread_name("obs-mpv: probe");
+    mpv_handle* mpv = NULL;
+
+    while (os_sem_wait(probe.queue_sem) == 0 && !probe.stop) {
+        char* path = NULL;
+        bool queue_empty;
+
+        pthread_mutex_lock(&probe.mutex);
+        if (probe.queue.num > 0) {
+            path = probe.queue.array[0];
+            da_erase(probe.queue, 0);
+        }
+        queue_empty = probe.queue.num == 0;
+        pthread_mutex_unlock(&probe.mutex);
+
+        long long size, mtime;
+        obs_data_t* cached = path ? mpvs_probe_get(path) : NULL;
+        if (cached) {
+            obs_data_release(cached);
+        } else if (path && mpvs_probe_stat(path, &size, &mtime)) {
+            // the file changed since it was probed
+            pthread_mutex_lock(&probe.mutex);
+            obs_data_erase(probe.cache, path);
+            pthread_mutex_unlock(&probe.mutex);
+
+            if (!mpv)
+                mpv = mpvs_probe_create_core();
+
+            obs_data_t* entry = mpv ? mpvs_probe_file(&mpv, path) : NULL;
+            if (entry) {
+                obs_data_set_int(entry, "size", size);
+                obs_data_set_int(entry, "mtime", mtime);
+
+                pthread_mutex_lock(&probe.mutex);
+                obs_data_set_obj(probe.cache, path, entry);
+                probe.dirty = true;
+                pthread_mutex_unlock(&probe.mutex);
+                obs_data_release(entry);
+            }
+        }
+        bfree(path);
+
+        if (queue_empty)
+            mpvs_probe_save();
+    }
+
+    mpvs_reaper_queue(mpv, "probe");
+    return NULL;
+}
+
+void mpvs_probe_init(void)
+{
+    char* path = obs_module_config_path(MPVS_PROBE_CACHE_FILE);
+    probe.cache = obs_data_create_from_json_file_safe(path, "bak");
+    if (!probe.cache)
+        probe.cache = obs_data_create();
+    bfree(path);
+
+    da_init(probe.queue);
+    pthread_mutex_init(&probe.mutex, NULL);
+    os_sem_init(&probe.queue_sem, 0);
+    probe.stop = false;
+    probe.thread_created = pthread_create(&probe.thread, NULL, mpvs_probe_thread, NULL) == 0;
+    if (!probe.thread_created)
+        obs_log(LOG_ERROR, "Failed to start media probe thread");
+}
+
+void mpvs_probe_free(void)
+{
+    if (probe.thread_created) {
+        probe.stop = true;
+        os_sem_post(probe.queue_sem);
+        pthread_join(probe.thread, NULL);
+        probe.thread_created = false;
+    }
+
+    mpvs_probe_save();
+
+    for (size_t i = 0; i < probe.queue.num; i++)
+        bfree(probe.queue.array[i]);
+    da_free(probe.queue);
+    os_sem_destroy(probe.queue_sem);
+    pthread_mutex_destroy(&probe.mutex);
+    obs_data_release(probe.cache);
+    probe.cache = NULL;
+}
+
+void mpvs_probe_queue(const char* path)
+{
+    if (!probe.thread_created || !path || !*path)
+        return;
+
+    char* p = bstrdup(path);
+    pthread_mutex_lock(&probe.mutex);
+    da_push_back(probe.queue, &p);
+    pthread_mutex_unlock(&probe.mutex);
+    os_sem_post(probe.queue_sem);
+}
+
+obs_data_t* mpvs_probe_get(const char* path)
+{
+    long long size, mtime;
+    if (!probe.cache || !mpvs_probe_stat(path, &size, &mtime))
+        return NULL;
+
+    pthread_mutex_lock(&probe.mutex);
+    obs_data_t* entry = obs_data_get_obj(probe.cache, path);
+    pthread_mutex_unlock(&probe.mutex);
+
+    // the file changed since it was probed
+    if (entry && (obs_data_get_int(entry, "size") != size || obs_data_get_int(entry, "mtime") != mtime)) {
+        obs_data_release(entry);
+        entry = NULL;
+    }
+    return entry;
+}
+
+obs_data_t* mpvs_probe_lookup(const char* path)
+{
+    if (!probe.cache)
+        return NULL;
+
+    pthread_mutex_lock(&probe.mutex);
+    obs_data_t* entry = obs_data_get_obj(probe.cache, path);
+    pthread_mutex_unlock(&probe.mutex);
+    return entry;
+}
+
+void mpvs_probe_get_tracks(obs_data_t* entry, struct darray* tracks)
+{
+    obs_data_array_t* array = obs_data_get_array(entry, "tracks");
+    size_t count = obs_data_array_count(array);
+
+    for (size_t i = 0; i < count; i++) {
+        obs_data_t* item = obs_data_array_item(array, i);
+        const char* type = obs_data_get_string(item, "type");
+        struct mpv_track_info info = { 0 };
+
+        info.id = obs_data_get_int(item, "id");
+        info.demux_w = obs_data_get_int(item, "demux-w");
+        info.demux_h = obs_data_get_int(item, "demux-h");
+        if (strcmp(type, "audio") == 0)
+            info.type = MPV_TRACK_TYPE_AUDIO;
+        else if (strcmp(type, "video") == 0)
+            info.type = MPV_TRACK_TYPE_VIDEO;
+        else
+            info.type = MPV_TRACK_TYPE_SUB;
+
+        if (obs_data_has_user_value(item, "title"))
+            info.title = bstrdup(obs_data_get_string(item, "title"));
+        if (obs_data_has_user_value(item, "lang"))
+            info.lang = bstrdup(obs_data_get_string(item, "lang"));
+        mpvs_set_default_track_title(&info);
+
+        darray_push_back(sizeof(struct mpv_track_info), tracks, &info);
+        obs_data_release(item);
+    }
+    obs_data_array_release(array);
+
+    // same as mpvs_handle_file_loaded
+    struct mpv_track_info sub_track = { 0 };
+    sub_track.id = 0;
+    sub_track.type = MPV_TRACK_TYPE_SUB;
+    sub_track.title = bstrdup(obs_module_text("None"));
+    darray_push_back(sizeof(struct mpv_track_info), tracks, &sub_track);
+}
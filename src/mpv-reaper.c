@@ -0,0 +1,211 @@
+#if !defined(WIN32) && !defined(_GNU_SOURCE)
+#    define _GNU_SOURCE // dladdr
+#endif
+#include "mpv-backend.h"
+#include <obs-module.h>
+#include <util/darray.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#if defined(WIN32)
+#    include <windows.h>
+#else
+#    include <dlfcn.h>
+#endif
+
+#define MPVS_REAPER_THREADS 4
+#define MPVS_REAPER_TIMEOUT_NS 5000000000ULL
+#define MPVS_REAPER_CHECK_MS 1000 // idle workers look for hanging cores this often
+
+// mpv_destroy waits until the core has shut down, which can take seconds for
+// network streams or stuck demuxers. Cores are destroyed on worker threads
+// instead so removing sources or switching scene collections doesn't block
+// obs, and when many sources are removed at once they're torn down in parallel.
+// Cores that still hang when the plugin is unloaded are left running, the
+// plugin then stays loaded and keeps the state their streams use.
+
+struct mpvs_reaper_job {
+    mpv_handle* mpv;
+    char* name;
+    uint64_t queued_ns;
+};
+
+struct mpvs_reaper_worker {
+    pthread_t thread;
+    bool created;
+    struct mpvs_reaper_job job; // the core that is being destroyed, mpv is NULL if idle
+    uint64_t start_ns;
+    bool reported; // the core took longer than MPVS_REAPER_TIMEOUT_NS and was logged
+};
+
+static struct {
+    struct mpvs_reaper_worker workers[MPVS_REAPER_THREADS];
+    bool running;
+    volatile bool stop;
+    pthread_mutex_t mutex;
+    os_event_t* queue_event; // manual reset, set while the queue isn't empty
+    os_event_t* done_event;  // signaled whenever a core was destroyed
+    DARRAY(struct mpvs_reaper_job)
+    queue;
+} reaper;
+
+static void mpvs_reaper_check_locked(void)
+{
+    uint64_t now = os_gettime_ns();
+    for (size_t i = 0; i < MPVS_REAPER_THREADS; i++) {
+        struct mpvs_reaper_worker* worker = &reaper.workers[i];
+        if (worker->job.mpv && !worker->reported && now - worker->start_ns > MPVS_REAPER_TIMEOUT_NS) {
+            obs_log(LOG_WARNING, "[%s] mpv core is taking more than %.0f s to shut down", worker->job.name, MPVS_REAPER_TIMEOUT_NS / 1000000000.0);
+            worker->reported = true;
+        }
+    }
+}
+
+static void* mpvs_reaper_thread(void* data)
+{
+    struct mpvs_reaper_worker* worker = data;
+    os_set_thread_name("obs-mpv: reaper");
+
+    while (true) {
+        os_event_timedwait(reaper.queue_event, MPVS_REAPER_CHECK_MS);
+        pthread_mutex_lock(&reaper.mutex);
+        mpvs_reaper_check_locked();
+        if (reaper.queue.num == 0) {
+            if (!reaper.stop)
+                os_event_reset(reaper.queue_event);
+            pthread_mutex_unlock(&reaper.mutex);
+            if (reaper.stop)
+                break;
+            continue;
+        }
+        worker->job = reaper.queue.array[0];
+        da_erase(reaper.queue, 0);
+        worker->start_ns = os_gettime_ns();
+        worker->reported = false;
+        pthread_mutex_unlock(&reaper.mutex);
+
+        mpv_destroy(worker->job.mpv);
+
+        pthread_mutex_lock(&reaper.mutex);
+        uint64_t end = os_gettime_ns();
+        if (worker->reported)
+            obs_log(LOG_INFO, "[%s] mpv core shut down after %.1f s", worker->job.name, (end - worker->start_ns) / 1000000000.0);
+        else
+            obs_log(LOG_DEBUG, "[%s] mpv core shut down in %.1f ms, %.1f ms after it was queued", worker->job.name,
+                (end - worker->start_ns) / 1000000.0, (end - worker->job.queued_ns) / 1000000.0);
+        bfree(worker->job.name);
+        worker->job.mpv = NULL;
+        worker->job.name = NULL;
+        pthread_mutex_unlock(&reaper.mutex);
+
+        os_event_signal(reaper.done_event);
+    }
+    return NULL;
+}
+
+void mpvs_reaper_init(void)
+{
+    da_init(reaper.queue);
+    pthread_mutex_init(&reaper.mutex, NULL);
+    os_event_init(&reaper.queue_event, OS_EVENT_TYPE_MANUAL);
+    os_event_init(&reaper.done_event, OS_EVENT_TYPE_AUTO);
+    reaper.stop = false;
+
+    for (size_t i = 0; i < MPVS_REAPER_THREADS; i++) {
+        struct mpvs_reaper_worker* worker = &reaper.workers[i];
+        worker->created = pthread_create(&worker->thread, NULL, mpvs_reaper_thread, worker) == 0;
+        reaper.running |= worker->created;
+    }
+    if (!reaper.running)
+        obs_log(LOG_ERROR, "Failed to start mpv reaper threads, cores will be destroyed synchronously");
+}
+
+// the hanging workers are still in mpv_destroy, which calls the stream
+// callbacks of the plugin, so the plugin must not be unloaded
+static void mpvs_reaper_pin_module(void)
+{
+#if defined(WIN32)
+    HMODULE module;
+    if (!GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_PIN, (LPCWSTR)mpvs_reaper_pin_module, &module))
+        obs_log(LOG_WARNING, "Failed to keep the plugin loaded for hanging mpv cores");
+#else
+    Dl_info info;
+    if (!dladdr((void*)mpvs_reaper_pin_module, &info) || !info.dli_fname || !dlopen(info.dli_fname, RTLD_NOW | RTLD_NOLOAD | RTLD_NODELETE))
+        obs_log(LOG_WARNING, "Failed to keep the plugin loaded for hanging mpv cores");
+#endif
+}
+
+bool mpvs_reaper_free(void)
+{
+    if (!reaper.running)
+        return true;
+
+    // obs waits for cores that are still shutting down, but not forever
+    uint64_t deadline = os_gettime_ns() + MPVS_REAPER_TIMEOUT_NS;
+    bool idle = false;
+    while (true) {
+        pthread_mutex_lock(&reaper.mutex);
+        idle = reaper.queue.num == 0;
+        for (size_t i = 0; i < MPVS_REAPER_THREADS; i++)
+            idle = idle && !reaper.workers[i].job.mpv;
+        pthread_mutex_unlock(&reaper.mutex);
+
+        if (idle || os_gettime_ns() >= deadline)
+            break;
+        pthread_mutex_lock(&reaper.mutex);
+        mpvs_reaper_check_locked();
+        pthread_mutex_unlock(&reaper.mutex);
+        os_event_timedwait(reaper.done_event, 100);
+    }
+
+    if (!idle) {
+        // the hanging threads still use the reaper state, so it's left alone
+        pthread_mutex_lock(&reaper.mutex);
+        for (size_t i = 0; i < MPVS_REAPER_THREADS; i++) {
+            if (reaper.workers[i].job.mpv)
+                obs_log(LOG_WARNING, "[%s] mpv core didn't shut down, not waiting for it", reaper.workers[i].job.name);
+        }
+        if (reaper.queue.num > 0)
+            obs_log(LOG_WARNING, "%zu mpv cores weren't destroyed", reaper.queue.num);
+        pthread_mutex_unlock(&reaper.mutex);
+        mpvs_reaper_pin_module();
+        reaper.running = false;
+        return false;
+    }
+
+    reaper.stop = true;
+    os_event_signal(reaper.queue_event);
+    for (size_t i = 0; i < MPVS_REAPER_THREADS; i++) {
+        if (reaper.workers[i].created)
+            pthread_join(reaper.workers[i].thread, NULL);
+        reaper.workers[i].created = false;
+    }
+
+    da_free(reaper.queue);
+    os_event_destroy(reaper.queue_event);
+    os_event_destroy(reaper.done_event);
+    pthread_mutex_destroy(&reaper.mutex);
+    reaper.running = false;
+    return true;
+}
+
+void mpvs_reaper_queue(mpv_handle* mpv, const char* name)
+{
+    if (!mpv)
+        return;
+
+    // the wakeup callback points to the source, which is gone before the core
+    mpv_set_wakeup_callback(mpv, NULL, NULL);
+
+    if (!reaper.running) {
+        mpv_destroy(mpv);
+        return;
+    }
+
+    struct mpvs_reaper_job job = { mpv, bstrdup(name ? name : "mpv"), os_gettime_ns() };
+    pthread_mutex_lock(&reaper.mutex);
+    da_push_back(reaper.queue, &job);
+    mpvs_reaper_check_locked();
+    pthread_mutex_unlock(&reaper.mutex);
+    os_event_signal(reaper.queue_event);
+}
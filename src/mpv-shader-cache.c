@@ -0,0 +1,178 @@
+#include "mpv-backend.h"
+#include <obs-module.h>
+#include <util/darray.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#define MPVS_SHADER_CACHE_DIR "shader-cache"
+#define MPVS_SHADER_CACHE_WARM_UP_TIMEOUT_NS 5000000000ULL
+// 8 bit 4:2:0 is what most files use, so this compiles the shaders for
+// the common yuv conversion and chroma scaling
+#define MPVS_SHADER_CACHE_WARM_UP_FILE "av://lavfi:testsrc2=size=1920x1080:rate=30,format=yuv420p"
+
+// mpv compiles its shaders whenever a render context is created, with a
+// cache directory shared by all sources they only have to be compiled once
+static struct {
+    char* dir;
+    struct mpv_source* warm; // headless source of the warm up, graphics thread only
+    uint64_t warm_up_start_ns;
+    volatile long hits;
+    volatile long misses;
+} shader_cache;
+
+static size_t mpvs_shader_cache_count(void)
+{
+    size_t count = 0;
+    os_dir_t* dir = shader_cache.dir ? os_opendir(shader_cache.dir) : NULL;
+    if (!dir)
+        return 0;
+
+    struct os_dirent* ent;
+    while ((ent = os_readdir(dir)) != NULL) {
+        if (!ent->directory)
+            count++;
+    }
+    os_closedir(dir);
+    return count;
+}
+
+static void mpvs_shader_cache_warm_up_tick(void* param, float seconds);
+
+static void mpvs_shader_cache_warm_up_end(void* param)
+{
+    struct mpv_source* warm = param;
+    if (!warm || warm != shader_cache.warm)
+        return;
+    shader_cache.warm = NULL;
+
+    obs_remove_tick_callback(mpvs_shader_cache_warm_up_tick, warm);
+    obs_enter_graphics();
+    mpvs_free_core(warm);
+    obs_leave_graphics();
+    bfree(warm);
+}
+
+// one step per frame, so the graphics thread never waits for mpv
+static void mpvs_shader_cache_warm_up_tick(void* param, float seconds)
+{
+    UNUSED_PARAMETER(seconds);
+    struct mpv_source* warm = param;
+    if (warm->have_frame)
+        return; // already done, waiting for mpvs_shader_cache_warm_up_end
+
+    bool timed_out = os_gettime_ns() - shader_cache.warm_up_start_ns >= MPVS_SHADER_CACHE_WARM_UP_TIMEOUT_NS;
+    mpvs_handle_events(warm);
+
+    pthread_mutex_lock(&warm->mpv_event_mutex);
+    bool need_redraw = warm->redraw;
+    warm->redraw = false;
+    pthread_mutex_unlock(&warm->mpv_event_mutex);
+
+    if (warm->file_loaded && need_redraw && warm->render) {
+        obs_enter_graphics();
+        warm->render(warm);
+        obs_leave_graphics();
+        warm->have_frame = true;
+        obs_log(LOG_INFO, "Warmed up shader cache in %.1f ms, %zu cached shaders", (os_gettime_ns() - shader_cache.warm_up_start_ns) / 1000000.0,
+            mpvs_shader_cache_count());
+    } else if (timed_out) {
+        warm->have_frame = true;
+        obs_log(LOG_WARNING, "Shader cache warm up timed out");
+    } else {
+        return;
+    }
+
+    // tick callbacks can't be removed while they're called
+    obs_queue_task(OBS_TASK_GRAPHICS, mpvs_shader_cache_warm_up_end, warm, false);
+}
+
+// renders a single frame of a test video with a headless source, which fills
+// the cache for the first real source. Creating a render context needs the
+// graphics context, so the source is created in a graphics task and then
+// stepped by a tick callback until it rendered its first frame.
+static void mpvs_shader_cache_warm_up(void* param)
+{
+    UNUSED_PARAMETER(param);
+    shader_cache.warm_up_start_ns = os_gettime_ns();
+    struct mpv_source* warm = bzalloc(sizeof(struct mpv_source));
+    pthread_mutex_init_value(&warm->mpv_event_mutex);
+    da_init(warm->tracks);
+    warm->deck_load_request = -1;
+
+    obs_enter_graphics();
+    mpvs_init(warm);
+    if (!warm->init) {
+        mpvs_free_core(warm);
+        obs_leave_graphics();
+        bfree(warm);
+        return;
+    }
+    obs_leave_graphics();
+
+    mpv_set_property_string(warm->mpv, "ao", "null");
+    mpvs_load_file(warm, MPVS_SHADER_CACHE_WARM_UP_FILE);
+    shader_cache.warm = warm;
+    obs_add_tick_callback(mpvs_shader_cache_warm_up_tick, warm);
+}
+
+void mpvs_shader_cache_init(void)
+{
+    shader_cache.dir = obs_module_config_path(MPVS_SHADER_CACHE_DIR);
+    if (os_mkdirs(shader_cache.dir) == MKDIR_ERROR) {
+        obs_log(LOG_WARNING, "Failed to create shader cache directory %s", shader_cache.dir);
+        bfree(shader_cache.dir);
+        shader_cache.dir = NULL;
+        return;
+    }
+
+    // an empty cache means that this is the first start or that it was cleared
+    if (mpvs_shader_cache_count() == 0)
+        obs_queue_task(OBS_TASK_GRAPHICS, mpvs_shader_cache_warm_up, NULL, false);
+}
+
+void mpvs_shader_cache_free(void)
+{
+    long hits = os_atomic_load_long(&shader_cache.hits);
+    long misses = os_atomic_load_long(&shader_cache.misses);
+    if (hits + misses > 0)
+        obs_log(LOG_INFO, "Shader cache: %ld hits, %ld misses", hits, misses);
+    mpvs_shader_cache_warm_up_end(shader_cache.warm);
+    bfree(shader_cache.dir);
+    shader_cache.dir = NULL;
+}
+
+void mpvs_shader_cache_apply(struct mpv_source* context)
+{
+    if (!shader_cache.dir)
+        return;
+
+    // these are options, so they're set before mpv is initialized. Older mpv
+    // versions don't have gpu-shader-cache, which is fine.
+    mpv_set_option_string(context->mpv, "gpu-shader-cache-dir", shader_cache.dir);
+    mpv_set_option_string(context->mpv, "gpu-shader-cache", "yes");
+}
+
+void mpvs_shader_cache_begin(struct mpv_source* context)
+{
+    context->shader_cache_files = mpvs_shader_cache_count();
+    context->shader_cache_start_ns = os_gettime_ns();
+}
+
+void mpvs_shader_cache_end(struct mpv_source* context)
+{
+    if (!context->shader_cache_start_ns || !shader_cache.dir)
+        return;
+
+    // if the first frame needed shaders that weren't cached, mpv wrote them
+    // to the cache directory
+    size_t files = mpvs_shader_cache_count();
+    bool hit = files <= context->shader_cache_files;
+    if (hit)
+        os_atomic_inc_long(&shader_cache.hits);
+    else
+        os_atomic_inc_long(&shader_cache.misses);
+
+    obs_log(LOG_INFO, "[%s] Shader cache %s (%zu new shaders), first frame after %.1f ms", obs_source_get_name(context->src),
+        hit ? "hit" : "miss", files - util_min(files, context->shader_cache_files), (os_gettime_ns() - context->shader_cache_start_ns) / 1000000.0);
+    context->shader_cache_start_ns = 0;
+}
@@ -0,0 +1,182 @@
+#include "mpv-backend.h"
+#include <obs-module.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <util/threading.h>
+
+// Sources with "shared instance" enabled and the same playlist are put into a
+// group. Only the primary source of a group has an mpv core, all other sources
+// draw its texture. The graphics context always has to be entered before the
+// registry mutex, since rendering looks up the primary source.
+
+struct mpvs_shared {
+    char* key;
+    struct mpv_source* primary;
+    DARRAY(struct mpv_source*)
+    followers;
+};
+
+static struct {
+    pthread_mutex_t mutex;
+    DARRAY(struct mpvs_shared*)
+    groups;
+} shared = { PTHREAD_MUTEX_INITIALIZER };
+
+static char* mpvs_shared_key(char** files, size_t count)
+{
+    struct dstr key = { 0 };
+    for (size_t i = 0; i < count; i++)
+        dstr_catf(&key, "%s\n", files[i]);
+    return key.array;
+}
+
+// hands the core of the primary source over to a follower, which keeps playing
+// the playlist without having to reload it
+static void mpvs_shared_promote(struct mpv_source* primary, struct mpv_source* follower)
+{
+    if (primary->loop_cache_state == MPVS_LOOP_CACHE_PLAYING)
+        mpv_set_property_string(primary->mpv, "pause", "no");
+    mpvs_loop_cache_free(primary);
+    mpvs_image_free(primary);
+    mpvs_deck_destroy(primary);
+
+    mpvs_load_gl_functions(follower);
+    pthread_mutex_lock(&primary->core_mutex);
+    pthread_mutex_lock(&follower->core_mutex);
+    mpvs_swap_core(follower, primary);
+    pthread_mutex_unlock(&follower->core_mutex);
+    pthread_mutex_unlock(&primary->core_mutex);
+    os_atomic_store_long(&follower->media_state, os_atomic_load_long(&primary->media_state));
+    mpvs_set_mpv_properties(follower);
+
+    obs_log(LOG_INFO, "[%s] Took over shared playback from %s", obs_source_get_name(follower->src), obs_source_get_name(primary->src));
+}
+
+static void mpvs_shared_leave_locked(struct mpv_source* context)
+{
+    struct mpvs_shared* group = context->shared;
+    context->shared = NULL;
+
+    if (group->primary == context && group->followers.num > 0) {
+        group->primary = group->followers.array[0];
+        da_erase(group->followers, 0);
+        mpvs_shared_promote(context, group->primary);
+    } else if (group->primary == context) {
+        da_erase_item(shared.groups, &group);
+        bfree(group->key);
+        da_free(group->followers);
+        bfree(group);
+    } else {
+        da_erase_item(group->followers, &context);
+    }
+
+    // the source plays on its own again, so it has to reload its playlist
+    for (size_t i = 0; i < context->files.num; i++)
+        bfree(context->files.array[i]);
+    da_resize(context->files, 0);
+}
+
+static void mpvs_shared_join_locked(struct mpv_source* context, char* key)
+{
+    struct mpvs_shared* group = NULL;
+    for (size_t i = 0; i < shared.groups.num; i++) {
+        if (strcmp(shared.groups.array[i]->key, key) == 0) {
+            group = shared.groups.array[i];
+            break;
+        }
+    }
+
+    if (!group) {
+        group = bzalloc(sizeof(struct mpvs_shared));
+        group->key = key;
+        group->primary = context;
+        da_push_back(shared.groups, &group);
+        context->shared = group;
+        return;
+    }
+
+    // the source might have been playing on its own until now
+    bfree(key);
+    mpvs_loop_cache_free(context);
+    mpvs_image_free(context);
+    mpvs_deck_destroy(context);
+    pthread_mutex_lock(&context->core_mutex);
+    mpvs_free_core(context);
+    pthread_mutex_unlock(&context->core_mutex);
+    da_push_back(group->followers, &context);
+    context->shared = group;
+    obs_log(LOG_INFO, "[%s] Sharing playback with %s", obs_source_get_name(context->src), obs_source_get_name(group->primary->src));
+}
+
+void mpvs_shared_update(struct mpv_source* context, char** files, size_t count)
+{
+    char* key = context->shared_instance && count > 0 ? mpvs_shared_key(files, count) : NULL;
+    if (!key && !context->shared)
+        return;
+
+    obs_enter_graphics();
+    pthread_mutex_lock(&shared.mutex);
+    if (context->shared && key && strcmp(context->shared->key, key) == 0) {
+        bfree(key);
+    } else {
+        if (context->shared)
+            mpvs_shared_leave_locked(context);
+        if (key)
+            mpvs_shared_join_locked(context, key);
+    }
+    pthread_mutex_unlock(&shared.mutex);
+    obs_leave_graphics();
+}
+
+void mpvs_shared_leave(struct mpv_source* context)
+{
+    if (!context->shared)
+        return;
+
+    obs_enter_graphics();
+    pthread_mutex_lock(&shared.mutex);
+    mpvs_shared_leave_locked(context);
+    pthread_mutex_unlock(&shared.mutex);
+    obs_leave_graphics();
+}
+
+bool mpvs_shared_is_follower(struct mpv_source* context)
+{
+    pthread_mutex_lock(&shared.mutex);
+    bool follower = context->shared && context->shared->primary != context;
+    pthread_mutex_unlock(&shared.mutex);
+    return follower;
+}
+
+struct mpv_source* mpvs_shared_source(struct mpv_source* context)
+{
+    pthread_mutex_lock(&shared.mutex);
+    struct mpv_source* source = context->shared ? context->shared->primary : context;
+    pthread_mutex_unlock(&shared.mutex);
+    return source;
+}
+
+struct mpv_source* mpvs_shared_acquire(struct mpv_source* context)
+{
+    // the primary can be released by its owner at any time, a reference taken
+    // while it's still registered keeps it from being destroyed
+    pthread_mutex_lock(&shared.mutex);
+    struct mpv_source* source = context->shared ? context->shared->primary : context;
+    obs_source_t* ref = obs_source_get_ref(source->src);
+    pthread_mutex_unlock(&shared.mutex);
+    return ref ? source : NULL;
+}
+
+void mpvs_shared_release(struct mpv_source* source)
+{
+    if (source)
+        obs_source_release(source->src);
+}
+
+size_t mpvs_shared_follower_count(struct mpv_source* context)
+{
+    pthread_mutex_lock(&shared.mutex);
+    size_t count = context->shared && context->shared->primary == context ? context->shared->followers.num : 0;
+    pthread_mutex_unlock(&shared.mutex);
+    return count;
+}
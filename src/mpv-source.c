@@ -30,22 +30,100 @@ static inline void generate_and_load_playlist(struct mpv_source* context)
 
     DARRAY(char*)
     tmp;
+    DARRAY(struct mpvs_dir*)
+    dirs;
+    DARRAY(struct mpvs_bundle*)
+    bundles;
     da_init(tmp);
+    da_init(dirs);
+    da_init(bundles);
+    struct dstr bundle_path = { 0 };
 
     for (size_t i = 0; i < count; i++) {
         obs_data_t* item = obs_data_array_item(array, i);
         const char* path = obs_data_get_string(item, "value");
+        size_t name;
         if (!path || !*path) {
             obs_data_release(item);
             continue;
         }
-        if (os_file_exists(path)) {
+        if (mpvs_is_directory(path)) {
+            // directories are expanded into all media files below them
+            struct mpvs_dir* dir = NULL;
+            for (size_t j = 0; j < context->dirs.num; j++) {
+                if (context->dirs.array[j] && strcmp(mpvs_dir_get_path(context->dirs.array[j]), path) == 0) {
+                    dir = context->dirs.array[j];
+                    context->dirs.array[j] = NULL;
+                    break;
+                }
+            }
+            if (!dir)
+                dir = mpvs_dir_create(path);
+            mpvs_dir_get_files(dir, &tmp.da);
+            da_push_back(dirs, &dir);
+        } else if (mpvs_is_bundle(path)) {
+            // bundles are expanded into all media files in them
+            struct mpvs_bundle* bundle = mpvs_bundle_acquire(path, context->bundle_preload);
+            if (bundle) {
+                mpvs_bundle_get_files(bundle, &tmp.da);
+                da_push_back(bundles, &bundle);
+            }
+        } else if ((name = mpvs_bundle_split(path, &bundle_path)) > 0) {
+            // a single file in a bundle
+            struct mpvs_bundle* bundle = mpvs_bundle_acquire(bundle_path.array, context->bundle_preload);
+            char* p = bundle ? mpvs_bundle_get_url(bundle, path + name) : NULL;
+            if (p) {
+                da_push_back(tmp, &p);
+                da_push_back(bundles, &bundle);
+            } else {
+                mpvs_bundle_release(bundle);
+            }
+        } else if (mpvs_is_edit_list(path)) {
+            // the segments play as one timeline
+            char* p = mpvs_edit_list_to_edl(path);
+            if (p)
+                da_push_back(tmp, &p);
+        } else if (context->ytdl_cache && mpvs_ytdl_is_page(path)) {
+            // the page stays in the playlist, the on_load hook swaps in the resolved URL
+            mpvs_ytdl_queue(path);
             char* p = bstrdup(path);
             da_push_back(tmp, &p);
+        } else if (mpvs_http_is_url(path)) {
+            char* p = context->http_cache ? mpvs_http_cache_url(path) : bstrdup(path);
+            da_push_back(tmp, &p);
+        } else if (os_file_exists(path)) {
+            char* p = context->tail_follow ? mpvs_tail_url(context, path) : NULL;
+            if (!p)
+                p = bstrdup(path);
+            da_push_back(tmp, &p);
         }
         obs_data_release(item);
     }
 
+    // stop watching directories which were removed from the playlist
+    for (size_t i = 0; i < context->dirs.num; i++)
+        mpvs_dir_destroy(context->dirs.array[i]);
+    da_free(context->dirs);
+    da_move(context->dirs, dirs);
+
+    // the new bundles were acquired first, so bundles that are still in the
+    // playlist stay mapped
+    for (size_t i = 0; i < context->bundles.num; i++)
+        mpvs_bundle_release(context->bundles.array[i]);
+    da_free(context->bundles);
+    da_move(context->bundles, bundles);
+    dstr_free(&bundle_path);
+
+    // with a shared instance only the primary source of the group loads the playlist
+    mpvs_shared_update(context, tmp.array, tmp.num);
+    if (mpvs_shared_is_follower(context)) {
+        for (size_t i = 0; i < context->files.num; i++)
+            bfree(context->files.array[i]);
+        da_resize(context->files, 0);
+        da_copy(context->files, tmp);
+        goto end;
+    }
+
     if (tmp.num == 0) {
         MPV_SEND_COMMAND_ASYNC("playlist-clear");
         MPV_SEND_COMMAND_ASYNC("stop");
@@ -82,6 +160,16 @@ static inline void generate_and_load_playlist(struct mpv_source* context)
     da_resize(context->files, 0);
     da_copy(context->files, tmp);
 
+    // once there's a render context we keep it, dropping it while mpv is
+    // playing would break the video output
+    context->audio_only = !context->mpv_gl && !context->dual_deck;
+    for (size_t i = 0; i < context->files.num && context->audio_only; i++)
+        context->audio_only = mpvs_has_extension(context->files.array[i], EXTENSIONS_AUDIO);
+
+    // look up tracks and durations of all entries in the background
+    for (size_t i = 0; i < context->files.num; i++)
+        mpvs_probe_queue(context->files.array[i]);
+
     // write files to .m3u playlist
     for (size_t i = 0; i < context->files.num; i++)
         dstr_catf(&playlist, "%s\n", context->files.array[i]);
@@ -92,7 +180,11 @@ static inline void generate_and_load_playlist(struct mpv_source* context)
 
     if (context->files.num > 0) {
         context->file_loaded = false;
-        if (!context->init) {
+        os_atomic_set_long(&context->playlist_index, 0);
+        if (context->dual_deck) {
+            // the deck loads the files one by one, see mpvs_deck_tick
+            os_atomic_set_long(&context->deck_load_request, 0);
+        } else if (!context->init) {
             // the core hasn't been initialized yet, so we just remember the path to load it later
             bfree(context->queued_temp_playlist_file_path);
             context->queued_temp_playlist_file_path = bstrdup(tmp_file.array);
@@ -143,6 +235,134 @@ static inline void destroy_jack_source(struct mpv_source* context)
     context->jack_client_name = NULL;
 }
 
+static void mpvs_proc_get_stats(void* data, calldata_t* cd)
+{
+    struct mpv_source* context = data;
+    obs_data_t* stats = obs_data_create();
+
+    if (context->shared_instance) {
+        obs_data_set_bool(stats, "shared_follower", mpvs_shared_is_follower(context));
+        obs_data_set_int(stats, "shared_followers", (long long)mpvs_shared_follower_count(context));
+    }
+
+    // the stats of the modules read mpv properties, the core can't go away
+    // meanwhile. The shared instance stats take the registry mutex, which is
+    // held while cores are swapped, so they're read before.
+    pthread_mutex_lock(&context->core_mutex);
+
+    obs_data_set_bool(stats, "audio_only", context->audio_only);
+    obs_data_set_bool(stats, "has_alpha", context->has_alpha);
+    if (context->direct_render)
+        obs_data_set_bool(stats, "direct_render_active", context->direct_active);
+    if (context->untimed) {
+        obs_data_set_int(stats, "untimed_frames", (long long)context->untimed_frames);
+        obs_data_set_int(stats, "untimed_timeouts", (long long)context->untimed_timeouts);
+    }
+    if (context->obs_clock && context->init) {
+        int active = 0;
+        int64_t mistimed = 0, delayed = 0;
+        double speed_correction = 0, jitter = 0, avsync = 0;
+        mpv_get_property(context->mpv, "display-sync-active", MPV_FORMAT_FLAG, &active);
+        mpv_get_property(context->mpv, "mistimed-frame-count", MPV_FORMAT_INT64, &mistimed);
+        mpv_get_property(context->mpv, "vo-delayed-frame-count", MPV_FORMAT_INT64, &delayed);
+        mpv_get_property(context->mpv, "video-speed-correction", MPV_FORMAT_DOUBLE, &speed_correction);
+        mpv_get_property(context->mpv, "vsync-jitter", MPV_FORMAT_DOUBLE, &jitter);
+        mpv_get_property(context->mpv, "avsync", MPV_FORMAT_DOUBLE, &avsync);
+        obs_data_set_bool(stats, "obs_clock_active", active);
+        obs_data_set_int(stats, "obs_clock_frames", (long long)context->obs_clock_frames);
+        obs_data_set_int(stats, "obs_clock_repeats", (long long)context->obs_clock_repeats);
+        obs_data_set_int(stats, "mistimed_frames", mistimed);
+        obs_data_set_int(stats, "delayed_frames", delayed);
+        obs_data_set_double(stats, "speed_correction", speed_correction);
+        obs_data_set_double(stats, "vsync_jitter", jitter);
+        obs_data_set_double(stats, "avsync_ms", avsync * 1000.0);
+    }
+    mpvs_cache_get_stats(context, stats);
+    if (context->timeshift_minutes)
+        mpvs_timeshift_get_stats(context, stats);
+    if (context->http_cache)
+        mpvs_http_get_stats(stats);
+    if (context->ytdl_cache)
+        mpvs_ytdl_get_stats(stats);
+    if (context->tail_follow)
+        mpvs_tail_get_stats(context, stats);
+    if (context->dormant_minutes) {
+        obs_data_set_bool(stats, "dormant", context->dormant);
+        obs_data_set_int(stats, "dormant_wakeups", (long long)context->dormant_wakeups);
+        obs_data_set_double(stats, "last_wake_ms", context->last_wake_ns / 1000000.0);
+    }
+    obs_data_set_string(stats, "render_mode", context->render_mode == MPVS_RENDER_NORMAL ? "normal" : context->render_mode == MPVS_RENDER_NONBLOCKING ? "nonblocking" : "frozen");
+    obs_data_set_double(stats, "render_time_ms", context->render_time_ns / 1000000.0);
+    obs_data_set_double(stats, "render_max_time_ms", context->render_max_time_ns / 1000000.0);
+    obs_data_set_int(stats, "render_over_budget", (long long)context->render_over_budget);
+    if (context->sync) {
+        obs_data_set_bool(stats, "sync_master", mpvs_sync_is_master(context));
+        obs_data_set_double(stats, "sync_drift_ms", context->sync_drift * 1000.0);
+        obs_data_set_double(stats, "sync_group_drift_ms", mpvs_sync_group_drift(context) * 1000.0);
+        obs_data_set_double(stats, "sync_speed", context->sync_speed);
+    }
+    obs_data_set_double(stats, "last_transition_gap_ms", context->last_transition_gap_ns / 1000000.0);
+    mpvs_cue_get_stats(context, stats);
+    if (context->dual_deck) {
+        obs_data_set_int(stats, "deck_index", (long long)context->deck_index);
+        obs_data_set_bool(stats, "deck_prerolled", context->deck && context->deck->have_frame);
+    }
+    if (context->loop_cache) {
+        obs_data_set_bool(stats, "loop_cache_playing", os_atomic_load_bool(&context->loop_cache_playing));
+        obs_data_set_int(stats, "loop_cache_frames", (long long)context->loop_frames.num);
+        obs_data_set_double(stats, "loop_cache_memory_mb", context->loop_memory / (1024.0 * 1024.0));
+    }
+    pthread_mutex_unlock(&context->core_mutex);
+
+    calldata_set_string(cd, "stats", obs_data_get_json(stats));
+    obs_data_release(stats);
+}
+
+static void mpvs_go_live(void* data)
+{
+    struct mpv_source* context = mpvs_shared_acquire(data);
+    if (!context)
+        return;
+    if (mpvs_core_acquire(context)) {
+        mpvs_timeshift_go_live(context);
+        mpvs_core_release(context);
+    }
+    mpvs_shared_release(context);
+}
+
+static void mpvs_proc_go_live(void* data, calldata_t* cd)
+{
+    UNUSED_PARAMETER(cd);
+    mpvs_go_live(data);
+}
+
+static void mpvs_proc_cue(void* data, calldata_t* cd)
+{
+    const char* path = calldata_string(cd, "path");
+    struct mpv_source* context = path && *path ? mpvs_shared_acquire(data) : NULL;
+    if (!context)
+        return;
+    mpvs_cue_request(context, path);
+    mpvs_shared_release(context);
+}
+
+static void mpvs_proc_take(void* data, calldata_t* cd)
+{
+    struct mpv_source* context = mpvs_shared_acquire(data);
+    if (!context)
+        return;
+    mpvs_cue_take_request(context, (uint64_t)calldata_int(cd, "timestamp"));
+    mpvs_shared_release(context);
+}
+
+static bool mpvs_go_live_clicked(obs_properties_t* props, obs_property_t* property, void* data)
+{
+    UNUSED_PARAMETER(props);
+    UNUSED_PARAMETER(property);
+    mpvs_go_live(data);
+    return false;
+}
+
 static inline bool mpvs_internal_audio_control_modified(obs_properties_t* props,
     obs_property_t* property,
     obs_data_t* settings)
@@ -153,6 +373,17 @@ static inline bool mpvs_internal_audio_control_modified(obs_properties_t* props,
     return true;
 }
 
+static inline bool mpvs_loop_cache_modified(obs_properties_t* props,
+    obs_property_t* property,
+    obs_data_t* settings)
+{
+    UNUSED_PARAMETER(property);
+    bool loop_cache = obs_data_get_bool(settings, "loop_cache");
+    obs_property_set_visible(obs_properties_get(props, "loop_cache_max_duration"), loop_cache);
+    obs_property_set_visible(obs_properties_get(props, "loop_cache_max_memory"), loop_cache);
+    return true;
+}
+
 static inline bool mpvs_file_changed(obs_properties_t* props,
     obs_property_t* property,
     obs_data_t* settings)
@@ -170,6 +401,45 @@ static inline bool mpvs_file_changed(obs_properties_t* props,
     return true;
 }
 
+static inline void mpvs_add_track_items(obs_property_t* video_tracks, obs_property_t* audio_tracks,
+    obs_property_t* sub_tracks, struct mpv_track_info* tracks, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        struct mpv_track_info* track = &tracks[i];
+        if (track->type == MPV_TRACK_TYPE_VIDEO)
+            obs_property_list_add_int(video_tracks, track->title, track->id);
+        else if (track->type == MPV_TRACK_TYPE_AUDIO)
+            obs_property_list_add_int(audio_tracks, track->title, track->id);
+        else if (track->type == MPV_TRACK_TYPE_SUB)
+            obs_property_list_add_int(sub_tracks, track->title, track->id);
+    }
+}
+
+static inline void mpvs_add_playlist_duration(obs_properties_t* props, struct mpv_source* context)
+{
+    double duration = 0;
+    size_t probed = 0;
+    for (size_t i = 0; i < context->files.num; i++) {
+        obs_data_t* entry = mpvs_probe_lookup(context->files.array[i]);
+        if (entry) {
+            duration += obs_data_get_double(entry, "duration");
+            probed++;
+        }
+        obs_data_release(entry);
+    }
+
+    if (context->files.num == 0)
+        return;
+
+    int64_t seconds = (int64_t)duration;
+    struct dstr str = { 0 };
+    dstr_printf(&str, "%s: %02" PRId64 ":%02" PRId64 ":%02" PRId64, obs_module_text("PlaylistDuration"), seconds / 3600, (seconds / 60) % 60, seconds % 60);
+    if (probed < context->files.num)
+        dstr_catf(&str, " (%zu/%zu)", probed, context->files.num);
+    obs_properties_add_text(props, "playlist_duration", str.array, OBS_TEXT_INFO);
+    dstr_free(&str);
+}
+
 /* Basic obs functions ----------------------------------------------------- */
 
 static const char* mpvs_source_get_name(void* unused)
@@ -186,11 +456,15 @@ static void* mpvs_source_create(obs_data_t* settings, obs_source_t* source)
     context->height = 512;
     context->src = source;
     context->redraw = true;
+    context->deck_load_request = -1;
 
     context->audio_backend = mpvs_audio_driver_to_index(MPVS_DEFAULT_AUDIO_DRIVER);
 
     da_init(context->tracks);
     pthread_mutex_init_value(&context->mpv_event_mutex);
+    pthread_mutex_init_value(&context->core_mutex);
+    if (os_event_init(&context->frame_event, OS_EVENT_TYPE_AUTO) != 0)
+        context->frame_event = NULL;
 
     // add default tracks
     struct dstr track_name;
@@ -217,6 +491,14 @@ static void* mpvs_source_create(obs_data_t* settings, obs_source_t* source)
 
     create_jack_capture(context);
 
+    mpvs_cache_join(context);
+
+    proc_handler_t* ph = obs_source_get_proc_handler(source);
+    proc_handler_add(ph, "void get_stats(out string stats)", mpvs_proc_get_stats, context);
+    proc_handler_add(ph, "void go_live()", mpvs_proc_go_live, context);
+    proc_handler_add(ph, "void cue(in string path)", mpvs_proc_cue, context);
+    proc_handler_add(ph, "void take(in int timestamp)", mpvs_proc_take, context);
+
     obs_source_update(context->src, settings);
     return context;
 }
@@ -224,21 +506,13 @@ static void* mpvs_source_create(obs_data_t* settings, obs_source_t* source)
 static void mpvs_source_destroy(void* data)
 {
     struct mpv_source* context = data;
-    mpv_render_context_free(context->mpv_gl);
-    mpv_destroy(context->mpv);
 
-    obs_enter_graphics();
-    if (context->video_buffer) {
-        if (context->fbo)
-            context->_glDeleteFramebuffers(1, &context->fbo);
-        gs_texture_destroy(context->video_buffer);
-    }
-    obs_leave_graphics();
-
-    // free all tracks
-    for (size_t i = 0; i < context->tracks.num; i++)
-        destroy_mpv_track_info(&context->tracks.array[i]);
-    da_free(context->tracks);
+    // a follower takes over the core if this is the primary of a shared instance
+    mpvs_shared_leave(context);
+    mpvs_sync_leave(context);
+    mpvs_cache_leave(context);
+    mpvs_deck_destroy(context);
+    mpvs_free_core(context);
 
     for (size_t i = 0; i < context->files.num; i++)
         bfree(context->files.array[i]);
@@ -251,20 +525,24 @@ static void mpvs_source_destroy(void* data)
         context->tmp_playlist_path = NULL;
     }
 
-#if defined(WIN32)
-    // destroy textures and fbo when the backend is d3d
-    // when it's opengl we just use the texture that obs created
-    if (obs_device_type == GS_DEVICE_DIRECT3D_11) {
-        if (context->wgl_texture)
-            context->_glDeleteTextures(1, &context->wgl_texture);
-        if (context->fbo)
-            context->_glDeleteFramebuffers(1, &context->fbo);
-    }
-#endif
+    for (size_t i = 0; i < context->dirs.num; i++)
+        mpvs_dir_destroy(context->dirs.array[i]);
+    da_free(context->dirs);
+    for (size_t i = 0; i < context->bundles.num; i++)
+        mpvs_bundle_release(context->bundles.array[i]);
+    da_free(context->bundles);
 
+    mpvs_image_free(context);
+    mpvs_loop_cache_free(context);
     destroy_jack_source(context);
+    if (context->frame_event)
+        os_event_destroy(context->frame_event);
     dstr_free(&context->last_path);
     bfree(context->queued_temp_playlist_file_path);
+    bfree(context->deck_file);
+    bfree(context->dormant_path);
+    bfree(context->ytdl_hook_url);
+    mpvs_cue_free(context);
     bfree(data);
 }
 
@@ -277,10 +555,62 @@ static void mpvs_source_update(void* data, obs_data_t* settings)
     int video_track = (int)obs_data_get_int(settings, "video_track");
     int sub_track = (int)obs_data_get_int(settings, "sub_track");
 
+    bool dual_deck = obs_data_get_bool(settings, "dual_deck");
+    if (context->dual_deck != dual_deck) {
+        context->dual_deck = dual_deck;
+        // forces the playlist to be reloaded with the new mode
+        for (size_t i = 0; i < context->files.num; i++)
+            bfree(context->files.array[i]);
+        da_resize(context->files, 0);
+        MPV_SEND_COMMAND_ASYNC("playlist-clear");
+    }
+
+    context->shared_instance = obs_data_get_bool(settings, "shared_instance");
+    context->direct_render = obs_data_get_bool(settings, "direct_render");
+    context->http_cache = obs_data_get_bool(settings, "http_cache");
+    context->bundle_preload = obs_data_get_bool(settings, "bundle_preload");
+    context->ytdl_cache = obs_data_get_bool(settings, "ytdl_cache");
+    mpvs_ytdl_register(context);
+    context->tail_follow = obs_data_get_bool(settings, "tail_follow");
     generate_and_load_playlist(context);
+    context->dormant_reloading = false;
+
+    context->obs_clock = obs_data_get_bool(settings, "obs_clock");
+
+    // the dual deck prerolls with mpv's clock, so it can't be stepped
+    bool untimed = obs_data_get_bool(settings, "untimed") && !context->dual_deck && context->frame_event;
+    if (context->untimed != untimed) {
+        context->untimed = untimed;
+        context->untimed_paused = false;
+        context->untimed_stepping = false;
+        context->untimed_step_ts = 0;
+        // mpvs_set_mpv_properties pauses mpv and disables audio for untimed mode
+        if (!untimed) {
+            MPV_SEND_COMMAND_ASYNC("set", "aid", "auto");
+            MPV_SEND_COMMAND_ASYNC("set", "pause", "no");
+        }
+        os_atomic_store_long(&context->media_state, OBS_MEDIA_STATE_PLAYING);
+    }
+
+    // members of a sync group have to control their own core
+    const char* sync_group = obs_data_get_string(settings, "sync_group");
+    bool can_sync = !context->dual_deck && !context->untimed && !context->shared_instance;
+    mpvs_sync_update(context, can_sync ? sync_group : NULL);
 
     bool loop = obs_data_get_bool(settings, "loop");
     bool shuffle = obs_data_get_bool(settings, "shuffle");
+    context->gapless = obs_data_get_bool(settings, "gapless");
+    context->loop_cache = obs_data_get_bool(settings, "loop_cache");
+    context->loop_cache_max_duration = (double)obs_data_get_int(settings, "loop_cache_max_duration");
+    context->loop_cache_max_memory = (size_t)obs_data_get_int(settings, "loop_cache_max_memory") * 1024 * 1024;
+    // the playlist or the limits might have changed
+    mpvs_loop_cache_reset(context, true);
+
+    context->dormant_minutes = (int)obs_data_get_int(settings, "dormant_minutes");
+    context->timeshift_minutes = (int)obs_data_get_int(settings, "timeshift_minutes");
+    context->timeshift_disk_limit = (size_t)obs_data_get_int(settings, "timeshift_disk_mb") * 1024 * 1024;
+    mpvs_timeshift_register(context);
+    mpvs_cache_update(context, (size_t)obs_data_get_int(settings, "cache_forward_mb") * 1024 * 1024, (size_t)obs_data_get_int(settings, "cache_back_mb") * 1024 * 1024);
 
     if (context->shuffle != shuffle) {
         context->shuffle = shuffle;
@@ -289,7 +619,7 @@ static void mpvs_source_update(void* data, obs_data_t* settings)
 
     if (context->loop != loop) {
         context->loop = loop;
-        MPV_SEND_COMMAND_ASYNC("set", "loop", loop ? "inf" : "no");
+        MPV_SEND_COMMAND_ASYNC("set", "loop", loop && !context->dual_deck ? "inf" : "no");
     }
 
     // select the current tracks
@@ -334,6 +664,26 @@ static void mpvs_source_defaults(obs_data_t* settings)
 {
     obs_data_set_default_string(settings, "file", "");
     obs_data_set_default_bool(settings, "osc", false);
+    obs_data_set_default_bool(settings, "gapless", false);
+    obs_data_set_default_bool(settings, "dual_deck", false);
+    obs_data_set_default_bool(settings, "shared_instance", false);
+    obs_data_set_default_bool(settings, "direct_render", false);
+    obs_data_set_default_bool(settings, "obs_clock", false);
+    obs_data_set_default_bool(settings, "untimed", false);
+    obs_data_set_default_string(settings, "sync_group", "");
+    obs_data_set_default_bool(settings, "loop_cache", false);
+    obs_data_set_default_int(settings, "loop_cache_max_duration", 10);
+    obs_data_set_default_int(settings, "loop_cache_max_memory", 512);
+    // mpv's defaults
+    obs_data_set_default_int(settings, "cache_forward_mb", 150);
+    obs_data_set_default_int(settings, "cache_back_mb", 50);
+    obs_data_set_default_int(settings, "dormant_minutes", 0);
+    obs_data_set_default_int(settings, "timeshift_minutes", 0);
+    obs_data_set_default_int(settings, "timeshift_disk_mb", 0);
+    obs_data_set_default_bool(settings, "http_cache", false);
+    obs_data_set_default_bool(settings, "bundle_preload", false);
+    obs_data_set_default_bool(settings, "ytdl_cache", false);
+    obs_data_set_default_bool(settings, "tail_follow", false);
     obs_data_set_default_int(settings, "video_track", 0);
     obs_data_set_default_int(settings, "audio_track", 0);
     obs_data_set_default_int(settings, "sub_track", 0);
@@ -365,16 +715,73 @@ static obs_properties_t* mpvs_source_properties(void* data)
     dstr_replace(&exts, ";", " ");
     dstr_cat_dstr(&filter, &exts);
 
+    dstr_cat(&filter, ");;Image Files (");
+    dstr_copy(&exts, EXTENSIONS_IMAGE);
+    dstr_replace(&exts, ";", " ");
+    dstr_cat_dstr(&filter, &exts);
+
     dstr_cat(&filter, ");;Playlist Files (");
     dstr_copy(&exts, EXTENSIONS_PLAYLIST);
     dstr_replace(&exts, ";", " ");
     dstr_cat_dstr(&filter, &exts);
+
+    dstr_cat(&filter, ");;Bundles (");
+    dstr_cat(&filter, EXTENSIONS_BUNDLE);
+    dstr_cat(&filter, ");;Edit Lists (");
+    dstr_cat(&filter, EXTENSIONS_EDIT);
     dstr_cat(&filter, ")");
 
     obs_properties_add_editable_list(props, "playlist", obs_module_text("Playlist"), OBS_EDITABLE_LIST_TYPE_FILES_AND_URLS, filter.array, context->last_path.array);
 
     obs_properties_add_bool(props, "shuffle", obs_module_text("Shuffle"));
     obs_properties_add_bool(props, "loop", obs_module_text("Loop"));
+    obs_property_t* gapless = obs_properties_add_bool(props, "gapless", obs_module_text("Gapless"));
+    obs_property_set_long_description(gapless, obs_module_text("GaplessHint"));
+    obs_property_t* direct_render = obs_properties_add_bool(props, "direct_render", obs_module_text("DirectRender"));
+    obs_property_set_long_description(direct_render, obs_module_text("DirectRenderHint"));
+    obs_property_t* obs_clock = obs_properties_add_bool(props, "obs_clock", obs_module_text("ObsClock"));
+    obs_property_set_long_description(obs_clock, obs_module_text("ObsClockHint"));
+    obs_property_t* untimed = obs_properties_add_bool(props, "untimed", obs_module_text("Untimed"));
+    obs_property_set_long_description(untimed, obs_module_text("UntimedHint"));
+    obs_property_t* sync_group = obs_properties_add_text(props, "sync_group", obs_module_text("SyncGroup"), OBS_TEXT_DEFAULT);
+    obs_property_set_long_description(sync_group, obs_module_text("SyncGroupHint"));
+    obs_property_t* shared_instance = obs_properties_add_bool(props, "shared_instance", obs_module_text("SharedInstance"));
+    obs_property_set_long_description(shared_instance, obs_module_text("SharedInstanceHint"));
+    obs_property_t* dual_deck = obs_properties_add_bool(props, "dual_deck", obs_module_text("DualDeck"));
+    obs_property_set_long_description(dual_deck, obs_module_text("DualDeckHint"));
+
+    obs_property_t* loop_cache = obs_properties_add_bool(props, "loop_cache", obs_module_text("LoopCache"));
+    obs_property_set_long_description(loop_cache, obs_module_text("LoopCacheHint"));
+    obs_property_set_modified_callback(loop_cache, mpvs_loop_cache_modified);
+    obs_property_t* p = obs_properties_add_int(props, "loop_cache_max_duration", obs_module_text("LoopCacheMaxDuration"), 1, 60, 1);
+    obs_property_int_set_suffix(p, " s");
+    p = obs_properties_add_int(props, "loop_cache_max_memory", obs_module_text("LoopCacheMaxMemory"), 16, 8192, 16);
+    obs_property_int_set_suffix(p, " MB");
+
+    p = obs_properties_add_int(props, "cache_forward_mb", obs_module_text("CacheForward"), 1, 4096, 1);
+    obs_property_int_set_suffix(p, " MB");
+    obs_property_set_long_description(p, obs_module_text("CacheHint"));
+    p = obs_properties_add_int(props, "cache_back_mb", obs_module_text("CacheBack"), 0, 4096, 1);
+    obs_property_int_set_suffix(p, " MB");
+    obs_property_set_long_description(p, obs_module_text("CacheHint"));
+    p = obs_properties_add_int(props, "dormant_minutes", obs_module_text("Dormant"), 0, 1440, 1);
+    obs_property_int_set_suffix(p, " min");
+    obs_property_set_long_description(p, obs_module_text("DormantHint"));
+    p = obs_properties_add_int(props, "timeshift_minutes", obs_module_text("Timeshift"), 0, 240, 1);
+    obs_property_int_set_suffix(p, " min");
+    obs_property_set_long_description(p, obs_module_text("TimeshiftHint"));
+    p = obs_properties_add_int(props, "timeshift_disk_mb", obs_module_text("TimeshiftDisk"), 0, 65536, 64);
+    obs_property_int_set_suffix(p, " MB");
+    obs_property_set_long_description(p, obs_module_text("TimeshiftDiskHint"));
+    obs_properties_add_button(props, "timeshift_go_live", obs_module_text("GoLive"), mpvs_go_live_clicked);
+    p = obs_properties_add_bool(props, "http_cache", obs_module_text("HttpCache"));
+    obs_property_set_long_description(p, obs_module_text("HttpCacheHint"));
+    p = obs_properties_add_bool(props, "bundle_preload", obs_module_text("BundlePreload"));
+    obs_property_set_long_description(p, obs_module_text("BundlePreloadHint"));
+    p = obs_properties_add_bool(props, "ytdl_cache", obs_module_text("YtdlCache"));
+    obs_property_set_long_description(p, obs_module_text("YtdlCacheHint"));
+    p = obs_properties_add_bool(props, "tail_follow", obs_module_text("TailFollow"));
+    obs_property_set_long_description(p, obs_module_text("TailFollowHint"));
 
     obs_properties_add_bool(props, "osc", obs_module_text("EnableOSC"));
 
@@ -382,21 +789,33 @@ static obs_properties_t* mpvs_source_properties(void* data)
     obs_property_t* audio_tracks = obs_properties_add_list(props, "audio_track", obs_module_text("AudioTrack"), OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
     obs_property_t* sub_tracks = obs_properties_add_list(props, "sub_track", obs_module_text("SubtitleTrack"), OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
 
-    obs_property_set_enabled(video_tracks, context->file_loaded);
-    obs_property_set_enabled(audio_tracks, context->file_loaded);
-    obs_property_set_enabled(sub_tracks, context->file_loaded);
-
-    // iterate over all tracks and add them to the list
-    for (size_t i = 0; i < context->tracks.num; i++) {
-        struct mpv_track_info* track = &context->tracks.array[i];
-        if (track->type == MPV_TRACK_TYPE_VIDEO)
-            obs_property_list_add_int(video_tracks, track->title, track->id);
-        else if (track->type == MPV_TRACK_TYPE_AUDIO)
-            obs_property_list_add_int(audio_tracks, track->title, track->id);
-        else if (track->type == MPV_TRACK_TYPE_SUB)
-            obs_property_list_add_int(sub_tracks, track->title, track->id);
+    // until mpv has loaded the file the tracks can come from the probe cache
+    obs_data_t* probed = NULL;
+    size_t index = (size_t)os_atomic_load_long(&context->playlist_index);
+    if (!context->file_loaded && index < context->files.num)
+        probed = mpvs_probe_lookup(context->files.array[index]);
+
+    bool have_tracks = context->file_loaded || probed;
+    obs_property_set_enabled(video_tracks, have_tracks);
+    obs_property_set_enabled(audio_tracks, have_tracks);
+    obs_property_set_enabled(sub_tracks, have_tracks);
+
+    if (probed) {
+        DARRAY(struct mpv_track_info)
+        tracks;
+        da_init(tracks);
+        mpvs_probe_get_tracks(probed, &tracks.da);
+        mpvs_add_track_items(video_tracks, audio_tracks, sub_tracks, tracks.array, tracks.num);
+        for (size_t i = 0; i < tracks.num; i++)
+            destroy_mpv_track_info(&tracks.array[i]);
+        da_free(tracks);
+        obs_data_release(probed);
+    } else {
+        mpvs_add_track_items(video_tracks, audio_tracks, sub_tracks, context->tracks.array, context->tracks.num);
     }
 
+    mpvs_add_playlist_duration(props, context);
+
     // no point in showing this if the jack source doesn't work
     if (mpvs_have_jack_capture_source) {
         obs_property_t* cb = obs_properties_add_bool(props, "internal_audio_control", obs_module_text("InternalAudioControl"));
@@ -430,22 +849,68 @@ static obs_properties_t* mpvs_source_properties(void* data)
 
 static void mpvs_source_render(void* data, gs_effect_t* effect)
 {
-    struct mpv_source* context = data;
+    // followers of a shared instance draw the texture of the primary source
+    struct mpv_source* context = mpvs_shared_source(data);
 
     bool stopped_or_ended = context->media_state == OBS_MEDIA_STATE_ENDED || context->media_state == OBS_MEDIA_STATE_STOPPED;
+    // during a gapless transition the last frame of the previous file stays on screen
+    bool holding_frame = context->transition_start_ns && context->have_frame;
 
-    if (stopped_or_ended || !context->video_buffer)
+    if ((stopped_or_ended && !holding_frame) || !context->video_buffer)
         return; // don't render the black texture
+
+    // skips the copy from video_buffer, the tick stops rendering into it
+    // as long as this works. A demoted source renders into video_buffer, so
+    // it holds the last good frame if the source freezes. mpv doesn't blend,
+    // so video with alpha always goes through the texture. A source that is
+    // drawn more than once per frame (studio mode, projectors) is only
+    // rendered directly the first time, the other draws use video_buffer,
+    // which is rendered once below
+    uint64_t frame_ts = obs_get_video_frame_time();
+    if (context->direct_render && !context->has_alpha && context->render_mode == MPVS_RENDER_NORMAL && !context->loop_cache && !context->image_showing && !holding_frame
+        && context->direct_ts != frame_ts && mpvs_render_gl_direct(context)) {
+        context->direct_active = true;
+        context->direct_ts = frame_ts;
+        return;
+    }
+    if (context->texture_stale) {
+        mpvs_render_gl_nested(context);
+        context->texture_stale = false;
+    }
+
+    gs_texture_t* texture = mpvs_loop_cache_texture(context);
+    uint32_t cx = context->d3d_width, cy = context->d3d_height;
+    if (context->image_showing) {
+        texture = context->image.texture;
+        cx = context->image.cx;
+        cy = context->image.cy;
+    }
+
+    // most videos don't have an alpha channel, in an srgb canvas they can be
+    // copied as they are without blending or converting them to linear
+    bool opaque = !context->has_alpha && !context->image_showing && gs_get_color_space() == GS_CS_SRGB;
+
     const bool previous = gs_framebuffer_srgb_enabled();
-    gs_enable_framebuffer_srgb(true);
+    gs_enable_framebuffer_srgb(!opaque);
 
     gs_blend_state_push();
-    gs_blend_function(GS_BLEND_ONE, GS_BLEND_INVSRCALPHA);
+    if (opaque)
+        gs_enable_blending(false);
+    else
+        gs_blend_function(GS_BLEND_ONE, GS_BLEND_INVSRCALPHA);
 
     gs_eparam_t* const param = gs_effect_get_param_by_name(effect, "image");
-    gs_effect_set_texture_srgb(param, context->video_buffer);
-
-    gs_draw_sprite(context->video_buffer, 0, context->d3d_width, context->d3d_height);
+    if (opaque)
+        gs_effect_set_texture(param, texture);
+    else
+        gs_effect_set_texture_srgb(param, texture);
+
+    // on windows the texture can be larger than the video, with blending
+    // the padding is transparent, without it only the video is drawn
+    if (opaque)
+        gs_draw_sprite_subregion(texture, 0, 0, 0, util_min(cx, context->width), util_min(cy, context->height));
+    else
+        gs_draw_sprite(texture, 0, cx, cy);
 
     gs_blend_state_pop();
     gs_enable_framebuffer_srgb(previous);
@@ -453,58 +918,108 @@ static void mpvs_source_render(void* data, gs_effect_t* effect)
 
 static uint32_t mpvs_source_getwidth(void* data)
 {
-    struct mpv_source* context = data;
-    return context->width;
+    struct mpv_source* context = mpvs_shared_acquire(data);
+    if (!context)
+        return 0;
+    uint32_t width = context->image_showing ? context->image.cx : context->width;
+    mpvs_shared_release(context);
+    return width;
 }
 
 static uint32_t mpvs_source_getheight(void* data)
 {
-    struct mpv_source* context = data;
-    return context->height;
+    struct mpv_source* context = mpvs_shared_acquire(data);
+    if (!context)
+        return 0;
+    uint32_t height = context->image_showing ? context->image.cy : context->height;
+    mpvs_shared_release(context);
+    return height;
 }
 
 /* OBS media functions ----------------------------------------------------- */
 
 static void mpvs_play_pause(void* data, bool pause)
 {
-    struct mpv_source* context = data;
-
-    if (!context->mpv)
+    struct mpv_source* context = mpvs_shared_acquire(data);
+    if (!context)
         return;
-    mpv_set_property_string(context->mpv, "pause", pause ? "yes" : "no");
+    if (mpvs_core_acquire(context)) {
+        mpvs_media_play_pause(context, pause);
+        mpvs_core_release(context);
+    }
+    mpvs_shared_release(context);
 }
 
 static void mpvs_restart(void* data)
 {
     // todo, this should probably restart the current file
-    struct mpv_source* context = data;
-    generate_and_load_playlist(context);
+    struct mpv_source* context = mpvs_shared_acquire(data);
+    if (!context)
+        return;
+    mpvs_loop_cache_reset(context, true);
+    // the playlist is loaded by the tick, which owns the core
+    os_atomic_set_bool(&context->restart_requested, true);
+    mpvs_shared_release(context);
 }
 
 static void mpvs_stop(void* data)
 {
-    struct mpv_source* context = data;
-    MPV_SEND_COMMAND_ASYNC("stop");
+    struct mpv_source* context = mpvs_shared_acquire(data);
+    if (!context)
+        return;
+    mpvs_loop_cache_reset(context, true);
+    if (mpvs_core_acquire(context)) {
+        MPV_SEND_COMMAND_ASYNC("stop");
+        mpvs_core_release(context);
+    }
+    mpvs_shared_release(context);
 }
 
 static void mpvs_playlist_next(void* data)
 {
-    struct mpv_source* context = data;
-    MPV_SEND_COMMAND_ASYNC("playlist-next");
+    struct mpv_source* context = mpvs_shared_acquire(data);
+    if (!context)
+        return;
+    mpvs_loop_cache_reset(context, true);
+    if (context->dual_deck) {
+        // cut to the prerolled file as soon as it's ready
+        os_atomic_set_bool(&context->deck_cut_pending, true);
+    } else if (mpvs_core_acquire(context)) {
+        MPV_SEND_COMMAND_ASYNC("playlist-next");
+        mpvs_core_release(context);
+    }
+    mpvs_shared_release(context);
 }
 
 static void mpvs_playlist_prev(void* data)
 {
-    struct mpv_source* context = data;
-    MPV_SEND_COMMAND_ASYNC("playlist-prev");
+    struct mpv_source* context = mpvs_shared_acquire(data);
+    if (!context)
+        return;
+    mpvs_loop_cache_reset(context, true);
+    if (context->dual_deck) {
+        if (context->deck_index > 0)
+            os_atomic_set_long(&context->deck_load_request, (long)context->deck_index - 1);
+        else if (context->loop && context->files.num > 0)
+            os_atomic_set_long(&context->deck_load_request, (long)context->files.num - 1);
+    } else if (mpvs_core_acquire(context)) {
+        MPV_SEND_COMMAND_ASYNC("playlist-prev");
+        mpvs_core_release(context);
+    }
+    mpvs_shared_release(context);
 }
 
-static int64_t mpvs_get_duration(void* data)
+static int64_t mpvs_get_duration_locked(struct mpv_source* context)
 {
-    struct mpv_source* context = data;
-    if (!context->mpv || !context->file_loaded)
+    if (!context->file_loaded)
         return 0;
 
+    // live streams have the window of the timeshift buffer as their duration
+    if (mpvs_timeshift_active(context))
+        return mpvs_timeshift_duration(context);
+    if (context->tail_following)
+        return mpvs_tail_duration(context);
+
     double duration;
     int error;
 
@@ -517,11 +1032,28 @@ static int64_t mpvs_get_duration(void* data)
     return (int64_t)floor(duration) * 1000;
 }
 
-static int64_t mpvs_get_time(void* data)
+static int64_t mpvs_get_duration(void* data)
 {
-    struct mpv_source* context = data;
-    if (!context->mpv || !context->file_loaded)
+    struct mpv_source* context = mpvs_shared_acquire(data);
+    int64_t duration = 0;
+    if (!context)
         return 0;
+    if (mpvs_core_acquire(context)) {
+        duration = mpvs_get_duration_locked(context);
+        mpvs_core_release(context);
+    }
+    mpvs_shared_release(context);
+    return duration;
+}
+
+static int64_t mpvs_get_time_locked(struct mpv_source* context)
+{
+    if (!context->file_loaded)
+        return 0;
+    if (os_atomic_load_bool(&context->loop_cache_playing))
+        return mpvs_loop_cache_time(context);
+    if (mpvs_timeshift_active(context))
+        return mpvs_timeshift_time(context);
 
     double playback_time;
     int error;
@@ -536,21 +1068,51 @@ static int64_t mpvs_get_time(void* data)
     return (int64_t)floor(playback_time) * 1000;
 }
 
+static int64_t mpvs_get_time(void* data)
+{
+    struct mpv_source* context = mpvs_shared_acquire(data);
+    int64_t time = 0;
+    if (!context)
+        return 0;
+    if (mpvs_core_acquire(context)) {
+        time = mpvs_get_time_locked(context);
+        mpvs_core_release(context);
+    }
+    mpvs_shared_release(context);
+    return time;
+}
+
 static void mpvs_set_time(void* data, int64_t ms)
 {
-    struct mpv_source* context = data;
+    struct mpv_source* context = mpvs_shared_acquire(data);
     double time = ms / 1000.0;
     struct dstr str;
-    dstr_init(&str);
-    dstr_catf(&str, "%.2f", time);
-    MPV_SEND_COMMAND_ASYNC("seek", str.array, "absolute");
-    dstr_free(&str);
+    if (!context)
+        return;
+    mpvs_loop_cache_reset(context, true);
+    if (mpvs_core_acquire(context)) {
+        if (mpvs_timeshift_active(context)) {
+            mpvs_timeshift_seek(context, ms);
+        } else if (!mpvs_sync_seek(context, time)) {
+            dstr_init(&str);
+            dstr_catf(&str, "%.2f", time);
+            MPV_SEND_COMMAND_ASYNC("seek", str.array, "absolute");
+            dstr_free(&str);
+        }
+        mpvs_core_release(context);
+    }
+    mpvs_shared_release(context);
 }
 
 static enum obs_media_state mpvs_get_state(void* data)
 {
-    struct mpv_source* context = data;
-    return (enum obs_media_state)os_atomic_load_long(&context->media_state);
+    struct mpv_source* context = mpvs_shared_acquire(data);
+    if (!context)
+        return OBS_MEDIA_STATE_NONE;
+    // mpv is paused while the frames come from the loop cache
+    enum obs_media_state state = os_atomic_load_bool(&context->loop_cache_playing) ? OBS_MEDIA_STATE_PLAYING : (enum obs_media_state)os_atomic_load_long(&context->media_state);
+    mpvs_shared_release(context);
+    return state;
 }
 
 /* OBS interaction functions ----------------------------------------------- */
@@ -558,8 +1120,6 @@ static enum obs_media_state mpvs_get_state(void* data)
 static void mpvs_mouse_click(void* data, const struct obs_mouse_event* event,
     int32_t type, bool mouse_up, uint32_t click_count)
 {
-    struct mpv_source* context = data;
-    UNUSED_PARAMETER(context);
     UNUSED_PARAMETER(event);
     UNUSED_PARAMETER(type);
     UNUSED_PARAMETER(mouse_up);
@@ -588,19 +1148,20 @@ static void mpvs_mouse_click(void* data, const struct obs_mouse_event* event,
     main.format = MPV_FORMAT_NODE_ARRAY;
     main.u.list = &list;
 
-    if (mouse_up) {
+    if (mouse_up)
         list.num = 3;
+    struct mpv_source* context = mpvs_shared_acquire(data);
+    if (context && mpvs_core_acquire(context)) {
         mpv_command_node_async(context->mpv, 0, &main);
-    } else {
-        mpv_command_node_async(context->mpv, 0, &main);
+        mpvs_core_release(context);
     }
+    mpvs_shared_release(context);
     da_free(nodes);
 }
 
 static void mpvs_mouse_move(void* data, const struct obs_mouse_event* event,
     bool mouse_leave)
 {
-    struct mpv_source* context = data;
     UNUSED_PARAMETER(mouse_leave);
     struct dstr x, y;
     dstr_init(&x);
@@ -609,7 +1170,12 @@ static void mpvs_mouse_move(void* data, const struct obs_mouse_event* event,
     // convert position to string
     dstr_printf(&x, "%d", event->x);
     dstr_printf(&y, "%d", event->y);
-    MPV_SEND_COMMAND_ASYNC("mouse", x.array, y.array);
+    struct mpv_source* context = mpvs_shared_acquire(data);
+    if (context && mpvs_core_acquire(context)) {
+        MPV_SEND_COMMAND_ASYNC("mouse", x.array, y.array);
+        mpvs_core_release(context);
+    }
+    mpvs_shared_release(context);
     dstr_free(&y);
     dstr_free(&x);
 }
@@ -617,7 +1183,6 @@ static void mpvs_mouse_move(void* data, const struct obs_mouse_event* event,
 static void mpvs_key_click(void* data, const struct obs_key_event* event,
     bool key_up)
 {
-    struct mpv_source* context = data;
     struct dstr key_combo;
     dstr_init(&key_combo);
     const bool mouse_left = event->modifiers & INTERACT_MOUSE_LEFT;
@@ -651,11 +1216,12 @@ static void mpvs_key_click(void* data, const struct obs_key_event* event,
 
     obs_log(LOG_DEBUG, "MPV key combo: %s", key_combo.array);
 
-    if (key_up) {
-        MPV_SEND_COMMAND_ASYNC("keyup", key_combo.array);
-    } else {
-        MPV_SEND_COMMAND_ASYNC("keydown", key_combo.array);
+    struct mpv_source* context = mpvs_shared_acquire(data);
+    if (context && mpvs_core_acquire(context)) {
+        MPV_SEND_COMMAND_ASYNC(key_up ? "keyup" : "keydown", key_combo.array);
+        mpvs_core_release(context);
     }
+    mpvs_shared_release(context);
     dstr_free(&key_combo);
 }
 
@@ -672,13 +1238,46 @@ static void mpvs_source_video_tick(void* data, float seconds)
 {
     UNUSED_PARAMETER(seconds);
     struct mpv_source* context = data;
-    obs_enter_graphics();
 
-    if (!context->init)
+    // visibility changes move the demuxer cache budget between sources
+    mpvs_cache_tick(context);
+
+    // the primary source of the shared instance does all the work
+    if (mpvs_shared_is_follower(context)) {
+        if (context->dirs.num > 0)
+            mpvs_dir_tick(context);
+        return;
+    }
+
+    if (mpvs_dormant_tick(context))
+        return;
+
+    if (!context->init) {
+        obs_enter_graphics();
         mpvs_init(context);
+        obs_leave_graphics();
+    }
     if (context->init_failed)
         return;
 
+    if (os_atomic_set_bool(&context->restart_requested, false))
+        generate_and_load_playlist(context);
+
+    if (context->sync)
+        mpvs_sync_tick(context);
+
+    if (context->ytdl_hook_pending)
+        mpvs_ytdl_tick(context);
+
+    if (context->timeshift_minutes || context->timeshift_bytes)
+        mpvs_timeshift_tick(context);
+
+    if (context->tail_following)
+        mpvs_tail_tick(context);
+
+    if (context->untimed)
+        mpvs_untimed_wait(context);
+
     // mpv will set these flags in a separate thread
     // from what I can tell initilazation, event handling and rendering
     // should all happen in the same thread so we all do it here in the graphics thread
@@ -691,12 +1290,116 @@ static void mpvs_source_video_tick(void* data, float seconds)
         context->new_events = false;
     pthread_mutex_unlock(&context->mpv_event_mutex);
 
+    if (context->untimed)
+        mpvs_untimed_frame_check(context, need_redraw);
+
+    // without a render context there's nothing to do in the graphics thread
+    if (!context->mpv_gl) {
+        if (need_poll)
+            mpvs_handle_events(context);
+        if (context->dirs.num > 0)
+            mpvs_dir_tick(context);
+        if (context->audio_only)
+            return;
+        need_poll = false;
+    }
+
+    // with the obs clock mpv has to be told about every obs frame
+    bool obs_clock = context->obs_clock && !context->untimed && context->mpv_gl;
+
+    // a frozen source might not get a new frame from mpv, it retries anyway
+    if (context->render_mode == MPVS_RENDER_FROZEN && context->mpv_gl)
+        need_redraw = true;
+
+    // still images and paused videos don't produce new frames, so most of
+    // the time there's nothing to do in the graphics thread
+    bool graphics_work = need_redraw || need_poll || obs_clock || !context->mpv_gl || context->dual_deck || context->deck
+        || context->loop_cache_state != MPVS_LOOP_CACHE_OFF || os_atomic_load_bool(&context->loop_cache_reset) || mpvs_image_pending(context)
+        || context->cue_state != MPVS_CUE_NONE || context->cue_take_ns || os_atomic_load_bool(&context->cue_requested);
+    if (!graphics_work) {
+        if (context->dirs.num > 0)
+            mpvs_dir_tick(context);
+        mpvs_untimed_step(context);
+        return;
+    }
+
+    obs_enter_graphics();
+    if (!context->mpv_gl && !mpvs_init_video(context)) {
+        obs_leave_graphics();
+        return;
+    }
+
     if (need_poll)
         mpvs_handle_events(context);
 
-    if (context->render && need_redraw)
-        context->render(context);
+    if (context->dirs.num > 0)
+        mpvs_dir_tick(context);
+
+    mpvs_cue_tick(context);
+
+    // the core that was cut to already holds its first frame, its events are
+    // handled and the frame is rendered in the same obs frame as the end of
+    // the previous file
+    if ((context->dual_deck || context->deck) && mpvs_deck_tick(context)) {
+        mpvs_handle_events(context);
+        need_redraw = true;
+    }
+
+    mpvs_image_tick(context);
+
+    // the frame is rendered in video_render if it was drawn directly last time
+    bool direct = context->direct_active;
+    context->direct_active = false;
+
+    // the texture for a file of another size replaces the held frame in the
+    // same tick the first frame of that file is rendered into it
+    if (context->pending_width && context->render && need_redraw)
+        mpvs_set_video_size(context, context->pending_width, context->pending_height);
+
+    bool rendered = context->render && need_redraw;
+    if (rendered && direct) {
+        context->texture_stale = true;
+    } else if (rendered) {
+        // a frozen source keeps the last good frame in video_buffer
+        rendered = mpvs_watchdog_render(context);
+        context->texture_stale = false;
+    }
+    if (rendered) {
+        context->have_frame = true;
+        if (context->file_loaded) {
+            context->image_showing = false;
+            if (context->shader_cache_start_ns)
+                mpvs_shader_cache_end(context);
+            mpvs_cue_frame_rendered(context);
+            if (context->dormant_wake_ns && !context->dormant_path) {
+                context->last_wake_ns = os_gettime_ns() - context->dormant_wake_ns;
+                context->dormant_wake_ns = 0;
+            }
+        }
+
+        if (context->transition_start_ns && context->file_loaded) {
+            context->last_transition_gap_ns = os_gettime_ns() - context->transition_start_ns;
+            context->transition_start_ns = 0;
+            obs_log(LOG_INFO, "[%s] Playlist transition took %.2f ms", obs_source_get_name(context->src), context->last_transition_gap_ns / 1000000.0);
+        }
+    }
+
+    // every tick is a vsync of the display mpv resamples to, reporting it
+    // lets mpv measure the obs frame timing and keep the speed correction stable
+    if (obs_clock) {
+        mpv_render_context_report_swap(context->mpv_gl);
+        if (context->file_loaded && os_atomic_load_long(&context->media_state) == OBS_MEDIA_STATE_PLAYING) {
+            context->obs_clock_frames++;
+            if (!rendered)
+                context->obs_clock_repeats++;
+        }
+    }
+
+    mpvs_loop_cache_tick(context, rendered);
     obs_leave_graphics();
+
+    // the frame for the next obs frame is decoded while obs renders this one
+    mpvs_untimed_step(context);
 }
 
 struct obs_source_info mpv_source_info = {
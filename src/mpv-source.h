@@ -1,6 +1,7 @@
 #pragma once
 #include <glad/glad.h>
 #include <glad/glad_egl.h>
+#include <graphics/image-file.h>
 #include <mpv/client.h>
 #include <mpv/render_gl.h>
 #include <obs-module.h>
@@ -97,13 +98,66 @@ extern int obs_device_type;
     "*.asx;*.b4s;*.cue;*.ifo;*.m3u;*.m3u8;*.pls;" \
     "*.ram;*.rar;*.sdp;*.vlc;*.xspf;*.wax;*.wvx;*.zip;*.conf"
 
+#define EXTENSIONS_IMAGE                                 \
+    "*.bmp;*.gif;*.jpeg;*.jpg;*.jxl;*.png;*.tga;*.tif;" \
+    "*.tiff;*.webp"
+
+#define EXTENSIONS_BUNDLE "*.obsbundle"
+
+#define EXTENSIONS_EDIT "*.obsedit"
+
 #define EXTENSIONS_MEDIA \
-    EXTENSIONS_VIDEO ";" EXTENSIONS_AUDIO ";" EXTENSIONS_PLAYLIST
+    EXTENSIONS_VIDEO ";" EXTENSIONS_AUDIO ";" EXTENSIONS_IMAGE ";" EXTENSIONS_PLAYLIST
 
 struct mpv_source;
 
 typedef void(mpvs_platform_callback_t)(struct mpv_source*);
 
+enum mpvs_loop_cache_state {
+    MPVS_LOOP_CACHE_OFF,
+    MPVS_LOOP_CACHE_WAITING,   // the clip can be cached, waiting for it to start over
+    MPVS_LOOP_CACHE_RECORDING, // copying every rendered frame
+    MPVS_LOOP_CACHE_PLAYING,   // mpv is paused and the frames are played from memory
+};
+
+enum mpvs_cue_state {
+    MPVS_CUE_NONE,
+    MPVS_CUE_LOADING, // waiting for the first frame of the cued file
+    MPVS_CUE_READY,   // holding the first frame until it's taken
+};
+
+enum mpvs_render_mode {
+    MPVS_RENDER_NORMAL,
+    MPVS_RENDER_NONBLOCKING, // renders went over the frame budget, mpv doesn't wait for the frame timing
+    MPVS_RENDER_FROZEN,      // renders stalled, the last good frame is shown
+};
+
+enum mpvs_sync_stage {
+    MPVS_SYNC_IDLE,
+    MPVS_SYNC_SEEKING, // waiting for the seek command to run
+    MPVS_SYNC_SEEKED,  // waiting for the frame at the new position
+    MPVS_SYNC_READY,   // prerolled, waiting for the other members of the group
+};
+
+struct mpvs_loop_frame {
+    gs_texture_t* texture;
+    double pts;
+};
+
+// a media file that was added to or removed from a watched directory
+struct mpvs_dir_change {
+    char* path;
+    bool added;
+    char* prev; // neighbours in the sorted directory index, used to place
+    char* next; // new files in the playlist, NULL if there are none
+};
+
+struct mpvs_bundle;
+struct mpvs_dir;
+struct mpvs_image_job;
+struct mpvs_shared;
+struct mpvs_sync;
+
 struct mpv_source {
     // basic source stuff
     uint32_t width;
@@ -112,6 +166,11 @@ struct mpv_source {
     uint32_t d3d_width;
     uint32_t d3d_height;
 
+    // size of the next file during a gapless transition, it's applied when
+    // the first frame of that file is rendered
+    uint32_t pending_width;
+    uint32_t pending_height;
+
     obs_source_t* src;
     bool osc; // mpv on screen controller
     DARRAY(char*)
@@ -120,12 +179,20 @@ struct mpv_source {
     char* tmp_playlist_path;
     bool shuffle;
     bool loop;
+    bool gapless; // prefetch the next playlist entry and hold the last frame
+    DARRAY(struct mpvs_dir*)
+    dirs; // directories in the playlist, their files are part of files
+    DARRAY(struct mpvs_bundle*)
+    bundles; // bundles in the playlist, kept open while they're used
+    bool bundle_preload;
 
     // mpv handles/thread stuff
     mpv_handle* mpv;
     mpv_render_context* mpv_gl;
     gs_texture_t* video_buffer;
     pthread_mutex_t mpv_event_mutex;
+    pthread_mutex_t core_mutex; // held while mpv is freed or swapped, see mpvs_core_acquire
+    volatile bool restart_requested;
     GLuint fbo;
     GLuint wgl_texture; // on windows with d3d we need to create a texture for mpv to render to
     bool redraw;
@@ -133,6 +200,15 @@ struct mpv_source {
     bool init_failed;
     bool new_events;
     bool file_loaded;
+    // observed playlist-pos, the entry the probe cache supplies tracks for
+    volatile long playlist_index;
+    bool have_frame;    // video_buffer contains a frame rendered by mpv
+    bool audio_only;    // no render context, the tick doesn't touch the graphics thread
+    bool direct_render; // render into the obs render target instead of video_buffer if possible
+    bool direct_active; // the last video_render call rendered directly
+    bool texture_stale; // video_buffer doesn't contain the latest frame
+    uint64_t direct_ts; // obs frame time of the last direct render
+    bool has_alpha;     // the video has an alpha channel, otherwise it's drawn without blending
     volatile long media_state;
     int audio_backend;
     // when obs starts up we can't load the playlist since the core isn't initialized yet
@@ -149,6 +225,158 @@ struct mpv_source {
     int current_video_track;
     int current_sub_track;
 
+    // gapless playlist transitions
+    uint64_t transition_start_ns; // when the previous file ended, 0 if no transition is in progress
+    uint64_t last_transition_gap_ns;
+
+    // dual deck playback, the deck is a second internal mpv core that prerolls
+    // the next playlist entry paused on its first frame
+    bool dual_deck;
+    struct mpv_source* deck;
+    size_t deck_index;               // playlist index of the file loaded in this core
+    char* deck_file;                 // path of the file loaded in this core
+    volatile bool deck_cut_pending;  // set at the end of the file or by media_next on the UI thread
+    volatile long deck_load_request; // playlist index the deck should load next, -1 if none
+
+    // cue and take, a file is held on its first frame until it's taken
+    char* cue_request; // requests from the proc handlers, guarded by mpv_event_mutex
+    bool take_request;
+    uint64_t take_request_at;
+    volatile bool cue_requested;
+    enum mpvs_cue_state cue_state;
+    bool cue_on_deck;     // prerolled in the second core of the dual deck
+    int64_t cue_entry_id;   // mpv playlist entry of the cued file, 0 if there is none
+    int64_t cue_taken_id;   // entry of a taken file that is still playing while another one is cued
+    int64_t cue_playing_id; // mpv playlist entry that was started last
+    char* cue_path;
+    bool cue_take_pending;
+    uint64_t cue_take_at; // obs timestamp to take the file at, 0 for the next frame
+    uint64_t cue_start_ns;
+    uint64_t cue_take_ns; // waiting for the first new frame after the take
+    uint64_t last_cue_ready_ns;
+    uint64_t last_take_ns;
+
+    // untimed mode, mpv stays paused and is advanced by one frame per obs frame
+    bool untimed;
+    bool untimed_paused;      // paused through the media controls
+    bool untimed_stepping;    // a step was requested and its frame wasn't rendered yet
+    bool untimed_late;        // the wait for the step timed out
+    uint64_t untimed_step_ts; // obs frame time of the last step
+    os_event_t* frame_event;  // signaled when mpv has a new frame to render
+    uint64_t untimed_frames;
+    uint64_t untimed_timeouts; // frame steps that weren't ready in time
+
+    // obs clock, mpv shows one frame per obs frame and adjusts its speed to match
+    bool obs_clock;
+    uint64_t obs_clock_frames;
+    uint64_t obs_clock_repeats; // ticks without a new frame while playing
+
+    // demuxer cache, the budget is this source's part of the module wide budget
+    size_t cache_forward_bytes; // requested in the settings
+    size_t cache_back_bytes;
+    size_t cache_budget;
+    size_t cache_forward_applied; // set on the current core
+    size_t cache_back_applied;
+    int cache_weight; // priority, 0 if the source has no core
+    int cache_cores;  // 2 while the dual deck has its second core
+
+    // tail follow, files that are still being written are played while they grow
+    bool tail_follow;
+    bool tail_following; // the current file is opened with appending://
+    double tail_behind;  // seconds between the playback position and the last demuxed packet
+    double tail_speed;
+    uint64_t tail_check_ns;
+    uint64_t tail_catchups; // seeks forward to the write head
+
+    // live timeshift, the demuxer cache keeps the last minutes of a live stream
+    int timeshift_minutes;       // 0 to play live streams without a back buffer
+    size_t timeshift_disk_limit; // bytes, 0 keeps the buffer in memory
+    bool timeshift_live;         // the current file has no duration
+    size_t timeshift_bytes;      // back buffer for the window at the current bitrate
+    bool timeshift_on_disk;
+    bool timeshift_file;         // the cache of the current file is on disk, only for network streams
+    bool timeshift_hooked;       // the on_load hook was added to the core
+    uint64_t timeshift_restarts; // times the stream was opened again because the cache file was full
+    double timeshift_start; // seekable window in stream time
+    double timeshift_end;   // live edge
+    uint64_t timeshift_check_ns;
+
+    // dormant mode, the core is released after the source was hidden for a while
+    int dormant_minutes; // 0 to keep the core
+    bool dormant;
+    uint64_t hidden_since_ns;
+    char* dormant_path; // file and position to restore after waking up
+    double dormant_time;
+    bool dormant_paused;
+    bool dormant_jumped; // the playlist was moved to dormant_path
+    bool dormant_reloading; // woke up, the playlist is loaded in the next update
+    uint64_t dormant_wakeups;
+    uint64_t dormant_wake_ns;
+    uint64_t last_wake_ns; // time from waking up to the first frame
+
+    bool http_cache; // URLs are opened through the http cache stream
+
+    // resolved URL cache, a load of a web page waits in the on_load hook until it's resolved
+    bool ytdl_cache;
+    bool ytdl_hooked; // the hooks are only added to cores of sources that use the cache
+    bool ytdl_hook_pending;
+    uint64_t ytdl_hook_id;
+    char* ytdl_hook_url;
+    bool ytdl_retried; // the resolved URL failed and the page was resolved again
+
+    // render watchdog
+    enum mpvs_render_mode render_mode;
+    uint64_t render_retry_ns;    // when a frozen source tries to render again
+    uint32_t render_slow_frames; // consecutive renders over the frame budget
+    uint32_t render_good_frames; // consecutive renders within the budget while not waiting for frame timing
+    uint64_t render_wait_ns;     // time the current render waits for the target time of the frame
+    bool render_direct;          // the current render goes to the obs render target
+    uint64_t render_over_budget;
+    uint64_t render_time_ns;
+    uint64_t render_max_time_ns;
+
+    // sync group, all members start, pause and seek together
+    struct mpvs_sync* sync;
+    volatile long sync_stage; // enum mpvs_sync_stage
+    double sync_drift;        // seconds ahead of the master
+    double sync_speed;
+    uint64_t sync_resync_ns;  // no speed correction until then after a seek
+    double sync_time;         // observed playback-time
+    uint64_t sync_time_ns;    // when it was observed, 0 without a core
+    int64_t sync_entry;       // observed playlist-pos
+    uint64_t sync_preroll_id; // last preroll of the group this member applied
+    uint64_t sync_start_ts;   // last start of the group this member applied
+
+    // shader cache statistics for the first frame
+    size_t shader_cache_files;
+    uint64_t shader_cache_start_ns;
+
+    // shared instance, followers draw the texture of their group's primary source
+    bool shared_instance;
+    struct mpvs_shared* shared;
+
+    // the next image in the playlist, decoded in the background
+    struct mpvs_image_job* image_job; // decode that the source waits for, NULL if none
+    char* image_path;
+    gs_image_file_t image;
+    bool image_showing; // shown instead of video_buffer until mpv rendered the image
+
+    // loop cache for short clips
+    bool loop_cache;
+    double loop_cache_max_duration; // seconds
+    size_t loop_cache_max_memory;   // bytes
+    enum mpvs_loop_cache_state loop_cache_state;
+    volatile bool loop_cache_playing; // loop_cache_state is MPVS_LOOP_CACHE_PLAYING, for other threads
+    volatile bool loop_cache_reset;
+    volatile bool loop_cache_resume;  // unpause mpv after the cache was reset
+    bool loop_cache_rejected;         // the current clip can't be cached
+    DARRAY(struct mpvs_loop_frame)
+    loop_frames;
+    size_t loop_frame_index;
+    size_t loop_memory;
+    double loop_duration;
+    uint64_t loop_start_ts; // obs frame time at the start of the clip
+
     // gl functions
     PFNGLGENFRAMEBUFFERSPROC _glGenFramebuffers;
     PFNGLBINDFRAMEBUFFERPROC _glBindFramebuffer;
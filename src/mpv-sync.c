@@ -0,0 +1,351 @@
+#include "mpv-backend.h"
+#include <math.h>
+#include <obs-module.h>
+#include <util/darray.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#define MPVS_SYNC_PREROLL_TIMEOUT_NS 3000000000ULL
+#define MPVS_SYNC_RESYNC_DELAY_NS 1000000000ULL
+#define MPVS_SYNC_MAX_DRIFT 0.25      // seconds, members that are further off seek to the master
+#define MPVS_SYNC_GAIN 0.5            // speed change per second of drift
+#define MPVS_SYNC_MAX_CORRECTION 0.05 // largest speed change, small enough for audio to not be noticeable
+
+// Sources in the same sync group start, pause and seek together. The first
+// member is the master, the others follow its playback position by changing
+// their speed slightly. To start, all members are paused and seek to the same
+// position. Once every one of them has decoded the frame at that position
+// they're all unpaused in the tick of the next obs frame.
+// Each member only uses its own core, in its own tick. The media controls
+// request a preroll for the whole group and the members apply it when they
+// tick, the positions the members compare come from the playback-time and
+// playlist-pos they observe.
+
+struct mpvs_sync {
+    char* name;
+    DARRAY(struct mpv_source*)
+    members;
+    uint64_t preroll_id; // counts the prerolls, members apply the ones they haven't yet
+    double preroll_time;
+    bool starting; // the members preroll for a synchronized start
+    uint64_t preroll_start_ns;
+    uint64_t start_ts; // obs frame time at which the members unpause, 0 if none
+};
+
+static struct {
+    pthread_mutex_t mutex;
+    DARRAY(struct mpvs_sync*)
+    groups;
+} sync_groups = { PTHREAD_MUTEX_INITIALIZER };
+
+static inline bool mpvs_sync_usable(struct mpv_source* member)
+{
+    return member->init && member->mpv;
+}
+
+static inline bool mpvs_sync_playing(struct mpv_source* member)
+{
+    return os_atomic_load_long(&member->media_state) == OBS_MEDIA_STATE_PLAYING;
+}
+
+static void mpvs_sync_set_speed(struct mpv_source* member, double speed)
+{
+    member->sync_speed = speed;
+    mpv_set_property_async(member->mpv, 0, "speed", MPV_FORMAT_DOUBLE, &speed);
+}
+
+// the playback time the member reported, moved on by the time since then,
+// returns false if it hasn't reported one with its current core
+static bool mpvs_sync_member_time(struct mpv_source* member, uint64_t now, double* time)
+{
+    if (!member->sync_time_ns)
+        return false;
+    *time = member->sync_time;
+    if (mpvs_sync_playing(member) && now > member->sync_time_ns)
+        *time += (now - member->sync_time_ns) / 1000000000.0 * member->sync_speed;
+    return true;
+}
+
+static double mpvs_sync_master_time(struct mpvs_sync* group, struct mpv_source* fallback)
+{
+    uint64_t now = os_gettime_ns();
+    double time = 0;
+    if (!mpvs_sync_member_time(group->members.array[0], now, &time))
+        mpvs_sync_member_time(fallback, now, &time);
+    return time;
+}
+
+// pauses all members on the frame at time, if start is set they're unpaused
+// together once all of them are ready, see mpvs_sync_start_locked. The
+// members seek in their own tick in mpvs_sync_preroll_member_locked
+static void mpvs_sync_preroll_locked(struct mpvs_sync* group, double time, bool start)
+{
+    group->preroll_id++;
+    group->preroll_time = time;
+    group->starting = start;
+    group->start_ts = 0;
+    group->preroll_start_ns = os_gettime_ns();
+}
+
+static void mpvs_sync_preroll_member_locked(struct mpvs_sync* group, struct mpv_source* context)
+{
+    context->sync_preroll_id = group->preroll_id;
+    os_atomic_set_long(&context->sync_stage, group->starting ? MPVS_SYNC_SEEKING : MPVS_SYNC_IDLE);
+    context->sync_drift = 0;
+    mpv_set_property_string(context->mpv, "pause", "yes");
+    mpvs_sync_set_speed(context, 1.0);
+
+    char pos[32];
+    snprintf(pos, sizeof(pos), "%f", group->preroll_time);
+    const char* cmd[] = { "seek", pos, "absolute+exact", NULL };
+    int result = mpv_command_async(context->mpv, group->starting ? MPVS_SYNC_SEEK_DONE : 0, cmd);
+    if (result < 0)
+        obs_log(LOG_ERROR, "[%s] Failed to seek sync group member: %s", obs_source_get_name(context->src), mpv_error_string(result));
+}
+
+static void mpvs_sync_start_locked(struct mpvs_sync* group)
+{
+    bool ready = true;
+    for (size_t i = 0; i < group->members.num; i++) {
+        struct mpv_source* member = group->members.array[i];
+        if (mpvs_sync_usable(member) && (member->sync_preroll_id != group->preroll_id || os_atomic_load_long(&member->sync_stage) != MPVS_SYNC_READY))
+            ready = false;
+    }
+
+    if (!ready) {
+        if (os_gettime_ns() - group->preroll_start_ns < MPVS_SYNC_PREROLL_TIMEOUT_NS)
+            return;
+        obs_log(LOG_WARNING, "Sync group %s: not all members prerolled in time, starting anyway", group->name);
+    }
+
+    // some members might have ticked in this frame already, so all of them
+    // unpause in the next one, see mpvs_sync_unpause_locked
+    group->start_ts = obs_get_video_frame_time() + obs_get_frame_interval_ns();
+    group->starting = false;
+
+    obs_log(LOG_DEBUG, "Sync group %s: starting %zu members after %.1f ms", group->name, group->members.num,
+        (os_gettime_ns() - group->preroll_start_ns) / 1000000.0);
+}
+
+static void mpvs_sync_unpause_locked(struct mpvs_sync* group, struct mpv_source* context)
+{
+    if (!group->start_ts || context->sync_start_ts == group->start_ts || obs_get_video_frame_time() < group->start_ts)
+        return;
+    context->sync_start_ts = group->start_ts;
+    os_atomic_set_long(&context->sync_stage, MPVS_SYNC_IDLE);
+    mpv_set_property_string(context->mpv, "pause", "no");
+    // the observed positions of the members need a moment to settle
+    context->sync_resync_ns = os_gettime_ns() + MPVS_SYNC_RESYNC_DELAY_NS;
+}
+
+static void mpvs_sync_correct_locked(struct mpvs_sync* group, struct mpv_source* context)
+{
+    struct mpv_source* master = group->members.array[0];
+    if (!mpvs_sync_usable(master) || !mpvs_sync_usable(context))
+        return;
+    if (!mpvs_sync_playing(master) || !mpvs_sync_playing(context) || os_gettime_ns() < context->sync_resync_ns) {
+        context->sync_drift = 0;
+        return;
+    }
+
+    // positions are only comparable while both play the same playlist entry
+    if (context->sync_entry != master->sync_entry)
+        return;
+
+    uint64_t now = os_gettime_ns();
+    double time, master_time;
+    if (!mpvs_sync_member_time(context, now, &time) || !mpvs_sync_member_time(master, now, &master_time))
+        return;
+
+    double drift = time - master_time;
+    context->sync_drift = drift;
+
+    if (fabs(drift) > MPVS_SYNC_MAX_DRIFT) {
+        char target[32];
+        snprintf(target, sizeof(target), "%f", master_time);
+        const char* cmd[] = { "seek", target, "absolute+exact", NULL };
+        mpv_command_async(context->mpv, 0, cmd);
+        mpvs_sync_set_speed(context, 1.0);
+        context->sync_resync_ns = os_gettime_ns() + MPVS_SYNC_RESYNC_DELAY_NS;
+        obs_log(LOG_INFO, "[%s] Drifted %.1f ms from sync group %s, seeking to master", obs_source_get_name(context->src), drift * 1000.0, group->name);
+        return;
+    }
+
+    double speed = 1.0 - util_clamp(drift * MPVS_SYNC_GAIN, -MPVS_SYNC_MAX_CORRECTION, MPVS_SYNC_MAX_CORRECTION);
+    if (fabs(speed - context->sync_speed) > 0.0005)
+        mpvs_sync_set_speed(context, speed);
+}
+
+static void mpvs_sync_leave_locked(struct mpv_source* context)
+{
+    struct mpvs_sync* group = context->sync;
+    context->sync = NULL;
+
+    // the next member becomes the master, it goes back to normal speed in
+    // its own tick
+    da_erase_item(group->members, &context);
+    if (group->members.num == 0) {
+        da_erase_item(sync_groups.groups, &group);
+        bfree(group->name);
+        da_free(group->members);
+        bfree(group);
+    }
+
+    if (mpvs_sync_usable(context) && context->sync_speed != 1.0)
+        mpvs_sync_set_speed(context, 1.0);
+    os_atomic_set_long(&context->sync_stage, MPVS_SYNC_IDLE);
+    context->sync_drift = 0;
+}
+
+static void mpvs_sync_join_locked(struct mpv_source* context, const char* name)
+{
+    struct mpvs_sync* group = NULL;
+    for (size_t i = 0; i < sync_groups.groups.num; i++) {
+        if (strcmp(sync_groups.groups.array[i]->name, name) == 0) {
+            group = sync_groups.groups.array[i];
+            break;
+        }
+    }
+
+    if (!group) {
+        group = bzalloc(sizeof(struct mpvs_sync));
+        group->name = bstrdup(name);
+        da_push_back(sync_groups.groups, &group);
+    }
+
+    da_push_back(group->members, &context);
+    context->sync = group;
+    context->sync_speed = 1.0;
+    // only later prerolls apply to the new member
+    context->sync_preroll_id = group->preroll_id;
+    context->sync_start_ts = group->start_ts;
+    obs_log(LOG_INFO, "[%s] Joined sync group %s (%zu members)", obs_source_get_name(context->src), name, group->members.num);
+}
+
+void mpvs_sync_update(struct mpv_source* context, const char* name)
+{
+    if (name && !*name)
+        name = NULL;
+
+    pthread_mutex_lock(&sync_groups.mutex);
+    if (!context->sync || !name || strcmp(context->sync->name, name) != 0) {
+        if (context->sync)
+            mpvs_sync_leave_locked(context);
+        if (name)
+            mpvs_sync_join_locked(context, name);
+    }
+    pthread_mutex_unlock(&sync_groups.mutex);
+}
+
+void mpvs_sync_leave(struct mpv_source* context)
+{
+    pthread_mutex_lock(&sync_groups.mutex);
+    if (context->sync)
+        mpvs_sync_leave_locked(context);
+    pthread_mutex_unlock(&sync_groups.mutex);
+}
+
+bool mpvs_sync_play_pause(struct mpv_source* context, bool pause)
+{
+    pthread_mutex_lock(&sync_groups.mutex);
+    struct mpvs_sync* group = context->sync;
+    if (group)
+        mpvs_sync_preroll_locked(group, mpvs_sync_master_time(group, context), !pause);
+    pthread_mutex_unlock(&sync_groups.mutex);
+    return group != NULL;
+}
+
+bool mpvs_sync_seek(struct mpv_source* context, double time)
+{
+    pthread_mutex_lock(&sync_groups.mutex);
+    struct mpvs_sync* group = context->sync;
+    if (group) {
+        struct mpv_source* master = group->members.array[0];
+        bool playing = group->starting || group->start_ts > obs_get_video_frame_time() || mpvs_sync_playing(master->sync_time_ns ? master : context);
+        mpvs_sync_preroll_locked(group, time, playing);
+    }
+    pthread_mutex_unlock(&sync_groups.mutex);
+    return group != NULL;
+}
+
+void mpvs_sync_tick(struct mpv_source* context)
+{
+    pthread_mutex_lock(&sync_groups.mutex);
+    struct mpvs_sync* group = context->sync;
+    if (group && mpvs_sync_usable(context)) {
+        if (context->sync_preroll_id != group->preroll_id)
+            mpvs_sync_preroll_member_locked(group, context);
+        if (group->starting)
+            mpvs_sync_start_locked(group);
+        mpvs_sync_unpause_locked(group, context);
+        if (group->members.array[0] != context)
+            mpvs_sync_correct_locked(group, context);
+        else if (context->sync_speed != 1.0)
+            mpvs_sync_set_speed(context, 1.0);
+    }
+    pthread_mutex_unlock(&sync_groups.mutex);
+}
+
+static void mpvs_sync_set_position(struct mpv_source* context, mpv_event_property* prop)
+{
+    bool time = strcmp(prop->name, "playback-time") == 0;
+    if (!time && strcmp(prop->name, "playlist-pos") != 0)
+        return;
+
+    // other members only read it while holding the lock, and the source
+    // only joins and leaves groups in the video thread, where this runs
+    bool locked = context->sync != NULL;
+    if (locked)
+        pthread_mutex_lock(&sync_groups.mutex);
+    if (time) {
+        context->sync_time = prop->format == MPV_FORMAT_DOUBLE ? *(double*)prop->data : 0;
+        context->sync_time_ns = prop->format == MPV_FORMAT_DOUBLE ? os_gettime_ns() : 0;
+    } else {
+        context->sync_entry = prop->format == MPV_FORMAT_INT64 ? *(int64_t*)prop->data : -1;
+    }
+    if (locked)
+        pthread_mutex_unlock(&sync_groups.mutex);
+}
+
+void mpvs_sync_core_freed(struct mpv_source* context)
+{
+    pthread_mutex_lock(&sync_groups.mutex);
+    context->sync_time_ns = 0;
+    context->sync_entry = -1;
+    pthread_mutex_unlock(&sync_groups.mutex);
+}
+
+void mpvs_sync_handle_event(struct mpv_source* context, mpv_event* event)
+{
+    if (event->event_id == MPV_EVENT_PROPERTY_CHANGE) {
+        mpvs_sync_set_position(context, event->data);
+        return;
+    }
+
+    // the seek command ran and the next playback restart is the one for the
+    // prerolled position
+    if (event->event_id == MPV_EVENT_COMMAND_REPLY && event->reply_userdata == MPVS_SYNC_SEEK_DONE)
+        os_atomic_compare_swap_long(&context->sync_stage, MPVS_SYNC_SEEKING, MPVS_SYNC_SEEKED);
+    else if (event->event_id == MPV_EVENT_PLAYBACK_RESTART)
+        os_atomic_compare_swap_long(&context->sync_stage, MPVS_SYNC_SEEKED, MPVS_SYNC_READY);
+}
+
+bool mpvs_sync_is_master(struct mpv_source* context)
+{
+    pthread_mutex_lock(&sync_groups.mutex);
+    bool master = context->sync && context->sync->members.array[0] == context;
+    pthread_mutex_unlock(&sync_groups.mutex);
+    return master;
+}
+
+double mpvs_sync_group_drift(struct mpv_source* context)
+{
+    double drift = 0;
+    pthread_mutex_lock(&sync_groups.mutex);
+    if (context->sync) {
+        for (size_t i = 0; i < context->sync->members.num; i++)
+            drift = fmax(drift, fabs(context->sync->members.array[i]->sync_drift));
+    }
+    pthread_mutex_unlock(&sync_groups.mutex);
+    return drift;
+}
@@ -0,0 +1,133 @@
+#include "mpv-backend.h"
+#include <obs-module.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+
+#define MPVS_TAIL_PROTOCOL "appending://"
+#define MPVS_TAIL_GROWING_SECONDS 10 // files written to this recently are followed
+#define MPVS_TAIL_INTERVAL_NS 250000000ULL
+#define MPVS_TAIL_TARGET 1.0    // seconds behind the write head
+#define MPVS_TAIL_MAX_BEHIND 10 // seconds behind the write head before seeking
+#define MPVS_TAIL_FAST_SPEED 1.1
+#define MPVS_TAIL_SLOW_SPEED 0.95
+
+// Replay buffer saves and recordings are played while OBS is still writing
+// them. Files that were modified in the last few seconds are opened with
+// mpv's appending:// protocol, which keeps reading when it reaches the end of
+// the file instead of ending playback. The last packet the demuxer read is
+// about where the file is being written, the tick keeps the playback position
+// close to it by changing the speed and seeks forward if it fell too far behind.
+
+static bool mpvs_tail_is_growing(const char* path)
+{
+    struct stat st;
+    if (os_stat(path, &st) != 0)
+        return false;
+    return time(NULL) - st.st_mtime <= MPVS_TAIL_GROWING_SECONDS;
+}
+
+char* mpvs_tail_url(struct mpv_source* context, const char* path)
+{
+    struct dstr url = { 0 };
+    dstr_printf(&url, "%s%s", MPVS_TAIL_PROTOCOL, path);
+
+    // a file that was followed stays that way after it's finished, otherwise
+    // the playlist would change and start it again
+    bool followed = false;
+    for (size_t i = 0; i < context->files.num && !followed; i++)
+        followed = strcmp(context->files.array[i], url.array) == 0;
+    if (followed || mpvs_tail_is_growing(path))
+        return url.array;
+    dstr_free(&url);
+    return NULL;
+}
+
+static void mpvs_tail_set_speed(struct mpv_source* context, double speed)
+{
+    if (speed == context->tail_speed)
+        return;
+    context->tail_speed = speed;
+    char str[32];
+    snprintf(str, sizeof(str), "%f", speed);
+    MPV_SEND_COMMAND_ASYNC("set", "speed", str);
+}
+
+void mpvs_tail_file_loaded(struct mpv_source* context)
+{
+    char* path = mpv_get_property_string(context->mpv, "path");
+    bool following = path && strncmp(path, MPVS_TAIL_PROTOCOL, strlen(MPVS_TAIL_PROTOCOL)) == 0;
+    mpv_free(path);
+
+    // the speed carries over to the next file
+    if (context->tail_following)
+        mpvs_tail_set_speed(context, 1.0);
+    context->tail_following = following;
+    context->tail_behind = 0;
+    context->tail_check_ns = 0;
+    if (following)
+        obs_log(LOG_INFO, "[%s] Following a file that is being written", obs_source_get_name(context->src));
+}
+
+void mpvs_tail_tick(struct mpv_source* context)
+{
+    uint64_t now = os_gettime_ns();
+    if (!context->file_loaded || now - context->tail_check_ns < MPVS_TAIL_INTERVAL_NS)
+        return;
+    context->tail_check_ns = now;
+
+    double time = 0, head = 0;
+    int paused = 0;
+    if (mpv_get_property(context->mpv, "playback-time", MPV_FORMAT_DOUBLE, &time) < 0 || mpv_get_property(context->mpv, "demuxer-cache-time", MPV_FORMAT_DOUBLE, &head) < 0)
+        return;
+    mpv_get_property(context->mpv, "pause", MPV_FORMAT_FLAG, &paused);
+    context->tail_behind = util_max(head - time, 0);
+
+    // once the file is finished it plays to its end at normal speed
+    char* path = mpv_get_property_string(context->mpv, "path");
+    bool growing = path && mpvs_tail_is_growing(path + strlen(MPVS_TAIL_PROTOCOL));
+    mpv_free(path);
+
+    // a paused file or a sync group member keeps its own pace
+    if (paused || context->sync || !growing) {
+        mpvs_tail_set_speed(context, 1.0);
+        return;
+    }
+
+    if (context->tail_behind > MPVS_TAIL_MAX_BEHIND) {
+        char str[32];
+        snprintf(str, sizeof(str), "%f", head - MPVS_TAIL_TARGET);
+        MPV_SEND_COMMAND_ASYNC("seek", str, "absolute");
+        context->tail_catchups++;
+        obs_log(LOG_DEBUG, "[%s] %.1f s behind the write head, seeking forward", obs_source_get_name(context->src), context->tail_behind);
+    } else if (context->tail_behind > MPVS_TAIL_TARGET * 2) {
+        mpvs_tail_set_speed(context, MPVS_TAIL_FAST_SPEED);
+    } else if (context->tail_behind < MPVS_TAIL_TARGET / 2) {
+        // slowing down before the demuxer runs dry avoids pausing for the cache
+        mpvs_tail_set_speed(context, MPVS_TAIL_SLOW_SPEED);
+    } else if ((context->tail_speed > 1.0 && context->tail_behind <= MPVS_TAIL_TARGET) || (context->tail_speed < 1.0 && context->tail_behind >= MPVS_TAIL_TARGET)) {
+        mpvs_tail_set_speed(context, 1.0);
+    }
+}
+
+int64_t mpvs_tail_duration(struct mpv_source* context)
+{
+    double head = 0;
+    mpv_get_property(context->mpv, "demuxer-cache-time", MPV_FORMAT_DOUBLE, &head);
+    return (int64_t)(head * 1000.0);
+}
+
+void mpvs_tail_get_stats(struct mpv_source* context, obs_data_t* stats)
+{
+    obs_data_set_bool(stats, "tail_following", context->tail_following && context->file_loaded);
+    if (!context->tail_following || !context->file_loaded)
+        return;
+
+    int64_t size = 0;
+    mpv_get_property(context->mpv, "file-size", MPV_FORMAT_INT64, &size);
+    obs_data_set_double(stats, "tail_behind", context->tail_behind);
+    obs_data_set_double(stats, "tail_speed", context->tail_speed);
+    obs_data_set_double(stats, "tail_file_mb", size / (1024.0 * 1024.0));
+    obs_data_set_int(stats, "tail_catchups", (long long)context->tail_catchups);
+}
@@ -0,0 +1,250 @@
+#include "mpv-backend.h"
+#include <math.h>
+#include <obs-module.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+
+#define MPVS_TIMESHIFT_DIR "timeshift"
+#define MPVS_TIMESHIFT_INTERVAL_NS 1000000000ULL
+// container overhead and the keyframe before the start of the window
+#define MPVS_TIMESHIFT_MARGIN 1.25
+// distance to the end of the cache when jumping to the live edge
+#define MPVS_TIMESHIFT_LIVE_OFFSET 1.0
+#define MPVS_TIMESHIFT_HOOK_PRIORITY 20 // after the ytdl hooks, which set the stream URL
+
+// Live streams have no duration, so OBS can't seek in them. With timeshift the
+// demuxer cache keeps the last timeshift_minutes of the stream behind the
+// playback position. The back buffer is sized from the bitrate of the stream
+// and requested from the module wide cache budget, or kept in a file in the
+// plugin config directory up to timeshift_disk_limit. The media controls then
+// show the seekable window of the cache as the duration of the file.
+// Only network streams get the cache file, it's turned on for them in the
+// on_load hook. mpv never shrinks that file, data that falls out of the back
+// buffer stays in it, so once it reaches the limit the stream is opened again
+// at the live edge, which starts a new file.
+
+static bool mpvs_timeshift_get_range(struct mpv_source* context, double* start, double* end)
+{
+    mpv_node state = { 0 };
+    bool found = false;
+    if (mpv_get_property(context->mpv, "demuxer-cache-state", MPV_FORMAT_NODE, &state) < 0 || state.format != MPV_FORMAT_NODE_MAP)
+        goto done;
+
+    for (int i = 0; i < state.u.list->num; i++) {
+        mpv_node* ranges = &state.u.list->values[i];
+        if (strcmp(state.u.list->keys[i], "seekable-ranges") != 0 || ranges->format != MPV_FORMAT_NODE_ARRAY)
+            continue;
+
+        // the last range ends at the live edge
+        for (int j = 0; j < ranges->u.list->num; j++) {
+            mpv_node* range = &ranges->u.list->values[j];
+            if (range->format != MPV_FORMAT_NODE_MAP)
+                continue;
+            for (int k = 0; k < range->u.list->num; k++) {
+                mpv_node* value = &range->u.list->values[k];
+                if (value->format != MPV_FORMAT_DOUBLE)
+                    continue;
+                if (strcmp(range->u.list->keys[k], "start") == 0)
+                    *start = value->u.double_;
+                else if (strcmp(range->u.list->keys[k], "end") == 0)
+                    *end = value->u.double_;
+            }
+            found = true;
+        }
+    }
+
+done:
+    mpv_free_node_contents(&state);
+    return found && *end > *start;
+}
+
+static void mpvs_timeshift_update_window(struct mpv_source* context)
+{
+    double start = 0, end = 0;
+    if (!mpvs_timeshift_get_range(context, &start, &end))
+        return;
+    context->timeshift_start = util_max(start, end - context->timeshift_minutes * 60.0);
+    context->timeshift_end = end;
+}
+
+void mpvs_timeshift_set_properties(struct mpv_source* context)
+{
+    // the back buffer can only be used for seeking with a seekable cache
+    MPV_SET_PROP_STR("demuxer-seekable-cache", context->timeshift_minutes ? "yes" : "auto");
+    MPV_SET_PROP_STR("cache-on-disk", "no");
+}
+
+void mpvs_timeshift_register(struct mpv_source* context)
+{
+    // like the ytdl hooks they can't be removed and continue right away
+    // once the buffer isn't on disk anymore
+    if (!context->mpv || !context->timeshift_minutes || !context->timeshift_disk_limit || context->timeshift_hooked)
+        return;
+    context->timeshift_hooked = true;
+    mpv_hook_add(context->mpv, MPVS_TIMESHIFT_HOOK, "on_load", MPVS_TIMESHIFT_HOOK_PRIORITY);
+}
+
+static bool mpvs_timeshift_is_network(const char* url)
+{
+    const char* protocols[] = { "http://", "https://", "rtmp://", "rtmps://", "rtsp://", "rtp://", "srt://", "udp://", "tcp://", "hls://", "mms://", NULL };
+    for (const char** protocol = protocols; *protocol; protocol++) {
+        if (astrcmpi_n(url, *protocol, strlen(*protocol)) == 0)
+            return true;
+    }
+    return false;
+}
+
+void mpvs_timeshift_handle_hook(struct mpv_source* context, mpv_event_hook* hook)
+{
+    // local files can be seeked anyway, they don't need a copy on disk
+    char* url = context->timeshift_minutes && context->timeshift_disk_limit ? mpv_get_property_string(context->mpv, "stream-open-filename") : NULL;
+    if (url && mpvs_timeshift_is_network(url)) {
+        char* dir = obs_module_config_path(MPVS_TIMESHIFT_DIR);
+        os_mkdirs(dir);
+        mpv_set_property_string(context->mpv, "file-local-options/demuxer-cache-dir", dir);
+        mpv_set_property_string(context->mpv, "file-local-options/cache-on-disk", "yes");
+        bfree(dir);
+    }
+    mpv_free(url);
+    mpv_hook_continue(context->mpv, hook->id);
+}
+
+static int64_t mpvs_timeshift_file_bytes(struct mpv_source* context)
+{
+    mpv_node state = { 0 };
+    int64_t bytes = 0;
+    if (mpv_get_property(context->mpv, "demuxer-cache-state", MPV_FORMAT_NODE, &state) >= 0 && state.format == MPV_FORMAT_NODE_MAP) {
+        for (int i = 0; i < state.u.list->num; i++) {
+            mpv_node* value = &state.u.list->values[i];
+            if (strcmp(state.u.list->keys[i], "file-cache-bytes") == 0 && value->format == MPV_FORMAT_INT64)
+                bytes = value->u.int64;
+        }
+    }
+    mpv_free_node_contents(&state);
+    return bytes;
+}
+
+void mpvs_timeshift_file_loaded(struct mpv_source* context)
+{
+    context->timeshift_live = false;
+    context->timeshift_start = context->timeshift_end = 0;
+    context->timeshift_check_ns = 0;
+    int on_disk = 0;
+    mpv_get_property(context->mpv, "cache-on-disk", MPV_FORMAT_FLAG, &on_disk);
+    context->timeshift_file = on_disk;
+    if (!context->timeshift_minutes)
+        return;
+
+    double duration = 0;
+    if (mpv_get_property(context->mpv, "duration/full", MPV_FORMAT_DOUBLE, &duration) >= 0 && duration > 0)
+        return;
+    context->timeshift_live = true;
+    obs_log(LOG_INFO, "[%s] Live stream, keeping the last %d minutes for timeshift", obs_source_get_name(context->src), context->timeshift_minutes);
+}
+
+void mpvs_timeshift_tick(struct mpv_source* context)
+{
+    if (!mpvs_timeshift_active(context)) {
+        if (context->timeshift_bytes)
+            mpvs_cache_set_timeshift(context, 0, false);
+        return;
+    }
+
+    uint64_t now = os_gettime_ns();
+    if (now - context->timeshift_check_ns < MPVS_TIMESHIFT_INTERVAL_NS)
+        return;
+    context->timeshift_check_ns = now;
+    mpvs_timeshift_update_window(context);
+
+    int64_t file_bytes = context->timeshift_file ? mpvs_timeshift_file_bytes(context) : 0;
+    if (file_bytes > (int64_t)context->timeshift_disk_limit) {
+        obs_log(LOG_INFO, "[%s] Timeshift file reached %.1f MiB, opening the stream again", obs_source_get_name(context->src), file_bytes / (1024.0 * 1024.0));
+        MPV_SEND_COMMAND_ASYNC("playlist-play-index", "current");
+        context->timeshift_restarts++;
+        return;
+    }
+
+    // the buffer follows the bitrate, which is only known once packets were read
+    double video_bitrate = 0, audio_bitrate = 0;
+    mpv_get_property(context->mpv, "video-bitrate", MPV_FORMAT_DOUBLE, &video_bitrate);
+    mpv_get_property(context->mpv, "audio-bitrate", MPV_FORMAT_DOUBLE, &audio_bitrate);
+    if (video_bitrate + audio_bitrate <= 0)
+        return;
+
+    double bytes = (video_bitrate + audio_bitrate) / 8.0 * context->timeshift_minutes * 60.0 * MPVS_TIMESHIFT_MARGIN;
+    if (context->timeshift_file)
+        bytes = util_min(bytes, (double)context->timeshift_disk_limit);
+
+    // small changes of the bitrate don't resize the cache
+    if (fabs(bytes - (double)context->timeshift_bytes) > context->timeshift_bytes * 0.1) {
+        mpvs_cache_set_timeshift(context, (size_t)bytes, context->timeshift_file);
+        obs_log(LOG_DEBUG, "[%s] Timeshift buffer is %.1f MiB at %.0f kbit/s", obs_source_get_name(context->src), bytes / (1024.0 * 1024.0), (video_bitrate + audio_bitrate) / 1000.0);
+    }
+}
+
+int64_t mpvs_timeshift_duration(struct mpv_source* context)
+{
+    return (int64_t)((context->timeshift_end - context->timeshift_start) * 1000.0);
+}
+
+int64_t mpvs_timeshift_time(struct mpv_source* context)
+{
+    double time = 0;
+    mpv_get_property(context->mpv, "playback-time", MPV_FORMAT_DOUBLE, &time);
+    return (int64_t)(util_max(time - context->timeshift_start, 0) * 1000.0);
+}
+
+void mpvs_timeshift_seek(struct mpv_source* context, int64_t ms)
+{
+    mpvs_timeshift_update_window(context);
+    double time = util_min(context->timeshift_start + ms / 1000.0, context->timeshift_end - MPVS_TIMESHIFT_LIVE_OFFSET);
+    char str[32];
+    snprintf(str, sizeof(str), "%.2f", util_max(time, context->timeshift_start));
+    MPV_SEND_COMMAND_ASYNC("seek", str, "absolute");
+}
+
+void mpvs_timeshift_go_live(struct mpv_source* context)
+{
+    if (!mpvs_timeshift_active(context))
+        return;
+    mpvs_timeshift_update_window(context);
+    char str[32];
+    snprintf(str, sizeof(str), "%.2f", util_max(context->timeshift_end - MPVS_TIMESHIFT_LIVE_OFFSET, context->timeshift_start));
+    MPV_SEND_COMMAND_ASYNC("seek", str, "absolute");
+    MPV_SEND_COMMAND_ASYNC("set", "pause", "no");
+    obs_log(LOG_INFO, "[%s] Jumping to the live edge", obs_source_get_name(context->src));
+}
+
+void mpvs_timeshift_get_stats(struct mpv_source* context, obs_data_t* stats)
+{
+    obs_data_set_bool(stats, "timeshift_live", mpvs_timeshift_active(context));
+    if (!mpvs_timeshift_active(context))
+        return;
+
+    double time = 0;
+    mpv_get_property(context->mpv, "playback-time", MPV_FORMAT_DOUBLE, &time);
+    obs_data_set_double(stats, "timeshift_window", context->timeshift_end - context->timeshift_start);
+    obs_data_set_double(stats, "timeshift_behind_live", util_max(context->timeshift_end - time, 0));
+    obs_data_set_double(stats, "timeshift_buffer_limit_mb", context->timeshift_bytes / (1024.0 * 1024.0));
+    obs_data_set_bool(stats, "timeshift_on_disk", context->timeshift_on_disk);
+    obs_data_set_double(stats, "timeshift_file_mb", context->timeshift_file ? mpvs_timeshift_file_bytes(context) / (1024.0 * 1024.0) : 0);
+    obs_data_set_int(stats, "timeshift_restarts", (long long)context->timeshift_restarts);
+
+    // with the cache on disk mpv only keeps the packet index in memory
+    mpv_node state = { 0 };
+    int64_t total = 0, forward = 0;
+    if (mpv_get_property(context->mpv, "demuxer-cache-state", MPV_FORMAT_NODE, &state) >= 0 && state.format == MPV_FORMAT_NODE_MAP) {
+        for (int i = 0; i < state.u.list->num; i++) {
+            mpv_node* value = &state.u.list->values[i];
+            if (value->format != MPV_FORMAT_INT64)
+                continue;
+            if (strcmp(state.u.list->keys[i], "total-bytes") == 0)
+                total = value->u.int64;
+            else if (strcmp(state.u.list->keys[i], "fw-bytes") == 0)
+                forward = value->u.int64;
+        }
+    }
+    mpv_free_node_contents(&state);
+    obs_data_set_double(stats, "timeshift_buffer_mb", util_max(total - forward, 0) / (1024.0 * 1024.0));
+    obs_data_set_double(stats, "timeshift_memory_mb", context->timeshift_on_disk ? 0 : total / (1024.0 * 1024.0));
+}
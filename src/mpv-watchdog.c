@@ -0,0 +1,163 @@
+#include "mpv-backend.h"
+#include <errno.h>
+#include <obs-module.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#define MPVS_WATCHDOG_SLOW_FRAMES 10         // consecutive renders over the frame budget before demoting a source
+#define MPVS_WATCHDOG_STALL_NS 1000000000ULL // a single render that takes this long demotes the source right away
+#define MPVS_WATCHDOG_RETRY_NS 5000000000ULL // frozen sources try to render again after this
+#define MPVS_WATCHDOG_GOOD_FRAMES 600        // consecutive renders within the budget before waiting for the frame timing again
+#define MPVS_WATCHDOG_INTERVAL_MS 250
+
+// mpv renders in the graphics thread while obs holds the graphics lock, so a
+// wedged decoder or driver freezes the whole output. Every render is timed,
+// sources that keep going over the frame budget first stop waiting for the
+// frame timing and then stop rendering, showing their last good frame. A
+// frozen source tries again every few seconds, a source that stays within the
+// budget for a while waits for the frame timing again. The time mpv spends
+// waiting for the target time of a frame isn't counted against the budget.
+// A render that doesn't return at all can't be interrupted, but the watchdog
+// thread at least logs which source is blocking the graphics thread.
+
+static struct {
+    pthread_t thread;
+    bool thread_created;
+    os_event_t* stop_event;
+    pthread_mutex_t mutex;
+    const char* name; // source that is rendering right now, NULL if none
+    uint64_t start_ns;
+    bool reported;
+} watchdog;
+
+static void* mpvs_watchdog_thread(void* data)
+{
+    UNUSED_PARAMETER(data);
+    os_set_thread_name("obs-mpv: watchdog");
+
+    while (os_event_timedwait(watchdog.stop_event, MPVS_WATCHDOG_INTERVAL_MS) == ETIMEDOUT) {
+        pthread_mutex_lock(&watchdog.mutex);
+        uint64_t elapsed = watchdog.name ? os_gettime_ns() - watchdog.start_ns : 0;
+        if (elapsed > MPVS_WATCHDOG_STALL_NS && !watchdog.reported) {
+            obs_log(LOG_WARNING, "[%s] mpv has been blocking the graphics thread for %.1f s", watchdog.name, elapsed / 1000000000.0);
+            watchdog.reported = true;
+        }
+        pthread_mutex_unlock(&watchdog.mutex);
+    }
+    return NULL;
+}
+
+void mpvs_watchdog_init(void)
+{
+    pthread_mutex_init(&watchdog.mutex, NULL);
+    os_event_init(&watchdog.stop_event, OS_EVENT_TYPE_MANUAL);
+    watchdog.thread_created = pthread_create(&watchdog.thread, NULL, mpvs_watchdog_thread, NULL) == 0;
+    if (!watchdog.thread_created)
+        obs_log(LOG_WARNING, "Failed to start render watchdog thread");
+}
+
+void mpvs_watchdog_free(void)
+{
+    if (watchdog.thread_created) {
+        os_event_signal(watchdog.stop_event);
+        pthread_join(watchdog.thread, NULL);
+        watchdog.thread_created = false;
+    }
+    os_event_destroy(watchdog.stop_event);
+    pthread_mutex_destroy(&watchdog.mutex);
+}
+
+static void mpvs_watchdog_demote(struct mpv_source* context, uint64_t duration, uint64_t budget)
+{
+    bool stalled = duration >= MPVS_WATCHDOG_STALL_NS;
+    enum mpvs_render_mode mode = context->render_mode == MPVS_RENDER_NORMAL && !stalled ? MPVS_RENDER_NONBLOCKING : MPVS_RENDER_FROZEN;
+
+    context->render_slow_frames = 0;
+    context->render_good_frames = 0;
+    // a direct render went to the output, the frame in video_buffer is older
+    // than that, so the next tick renders into it once more
+    if (mode == MPVS_RENDER_FROZEN)
+        context->render_retry_ns = os_gettime_ns() + (context->render_direct ? 0 : MPVS_WATCHDOG_RETRY_NS);
+    if (mode == context->render_mode)
+        return;
+    context->render_mode = mode;
+
+    char* path = mpv_get_property_string(context->mpv, "path");
+    char* codec = mpv_get_property_string(context->mpv, "video-codec");
+    char* hwdec = mpv_get_property_string(context->mpv, "hwdec-current");
+    obs_log(LOG_WARNING, "[%s] Rendering took %.1f ms with a budget of %.1f ms, %s. File: %s, codec: %s, hwdec: %s", obs_source_get_name(context->src),
+        duration / 1000000.0, budget / 1000000.0, mode == MPVS_RENDER_NONBLOCKING ? "no longer waiting for frame timing" : "showing the last good frame",
+        path ? path : "none", codec ? codec : "none", hwdec ? hwdec : "no");
+    mpv_free(path);
+    mpv_free(codec);
+    mpv_free(hwdec);
+}
+
+bool mpvs_watchdog_begin(struct mpv_source* context, bool direct)
+{
+    uint64_t now = os_gettime_ns();
+    if (context->render_mode == MPVS_RENDER_FROZEN && now < context->render_retry_ns)
+        return false;
+
+    // mpv sleeps until the target time of the next frame inside the render
+    // call, that part of the render time is subtracted again in end
+    context->render_direct = direct;
+    context->render_wait_ns = 0;
+    mpv_render_frame_info info = { 0 };
+    mpv_render_param param = { MPV_RENDER_PARAM_NEXT_FRAME_INFO, &info };
+    if (!direct && mpvs_block_for_target_time(context) && mpv_render_context_get_info(context->mpv_gl, param) >= 0 && (info.flags & MPV_RENDER_FRAME_INFO_PRESENT) && info.target_time > 0) {
+        int64_t wait = info.target_time - mpv_get_time_us(context->mpv);
+        if (wait > 0)
+            context->render_wait_ns = (uint64_t)wait * 1000;
+    }
+
+    pthread_mutex_lock(&watchdog.mutex);
+    watchdog.name = obs_source_get_name(context->src);
+    watchdog.start_ns = now;
+    watchdog.reported = false;
+    pthread_mutex_unlock(&watchdog.mutex);
+    return true;
+}
+
+void mpvs_watchdog_end(struct mpv_source* context)
+{
+    pthread_mutex_lock(&watchdog.mutex);
+    uint64_t duration = os_gettime_ns() - watchdog.start_ns;
+    watchdog.name = NULL;
+    pthread_mutex_unlock(&watchdog.mutex);
+
+    duration -= util_min(duration, context->render_wait_ns);
+    context->render_time_ns = duration;
+    context->render_max_time_ns = util_max(context->render_max_time_ns, duration);
+
+    uint64_t budget = obs_get_frame_interval_ns();
+    if (duration <= budget) {
+        context->render_slow_frames = 0;
+        if (context->render_mode == MPVS_RENDER_FROZEN) {
+            // waits for the frame timing again after a run of good frames
+            context->render_mode = MPVS_RENDER_NONBLOCKING;
+            context->render_good_frames = 0;
+            obs_log(LOG_INFO, "[%s] Rendering recovered", obs_source_get_name(context->src));
+        } else if (context->render_mode == MPVS_RENDER_NONBLOCKING && ++context->render_good_frames >= MPVS_WATCHDOG_GOOD_FRAMES) {
+            context->render_mode = MPVS_RENDER_NORMAL;
+            context->render_good_frames = 0;
+            obs_log(LOG_INFO, "[%s] Rendering stayed within the budget, waiting for frame timing again", obs_source_get_name(context->src));
+        }
+        return;
+    }
+
+    context->render_over_budget++;
+    context->render_slow_frames++;
+    context->render_good_frames = 0;
+    if (duration >= MPVS_WATCHDOG_STALL_NS || context->render_slow_frames >= MPVS_WATCHDOG_SLOW_FRAMES || context->render_mode == MPVS_RENDER_FROZEN)
+        mpvs_watchdog_demote(context, duration, budget);
+}
+
+bool mpvs_watchdog_render(struct mpv_source* context)
+{
+    if (!mpvs_watchdog_begin(context, false))
+        return false;
+    context->render(context);
+    mpvs_watchdog_end(context);
+    return true;
+}
@@ -0,0 +1,627 @@
+#include "mpv-backend.h"
+#include <obs-module.h>
+#include <time.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#if defined(WIN32)
+#include <windows.h>
+#else
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char** environ;
+#endif
+
+#define MPVS_YTDL_CONFIG_FILE "ytdl.json"
+#define MPVS_YTDL_DEFAULT_RESOLVER "yt-dlp"
+#define MPVS_YTDL_DEFAULT_FORMAT "bestvideo[height<=?1080]+bestaudio/best"
+#define MPVS_YTDL_DEFAULT_TTL_MINUTES 60
+#define MPVS_YTDL_DEFAULT_TIMEOUT_SECONDS 60
+#define MPVS_YTDL_MAX_ENTRIES 256   // least recently used pages are dropped beyond this
+#define MPVS_YTDL_POLL_MS 100
+#define MPVS_YTDL_EXPIRY_MARGIN 300 // seconds before the expire parameter of the stream URLs
+#define MPVS_YTDL_HOOK_PRIORITY 5   // before mpv's own ytdl hook, which uses 10
+
+// Web video pages in the playlist are resolved with yt-dlp once, in the
+// background, and the stream URLs are kept until they expire. mpv gets them
+// through its on_load hook instead of running its own ytdl hook for every
+// loadfile. The resolved URLs are passed as edl:// timelines, which also
+// carry separate video and audio streams and aren't touched by mpv's ytdl
+// hook. If a resolved URL fails to open it's resolved again.
+// The resolver, format, expiry and timeout are set in ytdl.json in the plugin
+// config directory, the resolver can be any program that prints yt-dlp's JSON.
+// A resolver that runs longer than the timeout or while the plugin unloads is
+// killed together with everything it started.
+
+struct mpvs_ytdl_entry {
+    char* url;       // playlist entry
+    char* resolved;  // edl:// URL for mpv, NULL if it wasn't resolved yet or resolving failed
+    char* format;    // the formats yt-dlp picked
+    char** headers;  // http headers for the stream URLs, NULL terminated
+    uint64_t expires_ns;
+    uint64_t used_ns; // last time the page was queued or loaded
+    bool resolving;
+};
+
+static struct {
+    pthread_mutex_t mutex;
+    pthread_t thread;
+    bool thread_created;
+    os_sem_t* queue_sem;
+    volatile bool stop;
+    DARRAY(struct mpvs_ytdl_entry)
+    entries;
+    DARRAY(char*)
+    queue;
+
+    char* resolver;
+    char* format;
+    uint64_t ttl_ns;
+    uint64_t timeout_ns;
+
+    uint64_t resolves;
+    uint64_t failures;
+    uint64_t hits; // loads that used a cached URL
+    uint64_t last_resolve_ns;
+} ytdl = { PTHREAD_MUTEX_INITIALIZER };
+
+static struct mpvs_ytdl_entry* mpvs_ytdl_find_locked(const char* url)
+{
+    for (size_t i = 0; i < ytdl.entries.num; i++) {
+        if (strcmp(ytdl.entries.array[i].url, url) == 0)
+            return &ytdl.entries.array[i];
+    }
+    return NULL;
+}
+
+static inline bool mpvs_ytdl_fresh(struct mpvs_ytdl_entry* entry)
+{
+    return entry && entry->resolved && os_gettime_ns() < entry->expires_ns;
+}
+
+static void mpvs_ytdl_clear_entry(struct mpvs_ytdl_entry* entry)
+{
+    bfree(entry->resolved);
+    bfree(entry->format);
+    if (entry->headers)
+        strlist_free(entry->headers);
+    entry->resolved = NULL;
+    entry->format = NULL;
+    entry->headers = NULL;
+}
+
+/* Resolver ---------------------------------------------------------------- */
+
+static void mpvs_ytdl_quote(struct dstr* cmd, const char* arg)
+{
+#if defined(WIN32)
+    struct dstr quoted = { 0 };
+    dstr_copy(&quoted, arg);
+    dstr_replace(&quoted, "\"", "\\\"");
+    dstr_catf(cmd, " \"%s\"", quoted.array);
+    dstr_free(&quoted);
+#else
+    // the command runs in a shell, nothing in single quotes is expanded
+    struct dstr quoted = { 0 };
+    dstr_copy(&quoted, arg);
+    dstr_replace(&quoted, "'", "'\\''");
+    dstr_catf(cmd, " '%s'", quoted.array);
+    dstr_free(&quoted);
+#endif
+}
+
+// stream URLs of most sites stop working at the time in their expire parameter
+static uint64_t mpvs_ytdl_expiry(const char* url)
+{
+    uint64_t now = os_gettime_ns();
+    uint64_t expires = now + ytdl.ttl_ns;
+    const char* param = strstr(url, "expire=");
+    if (param)
+        param += 7;
+    else if ((param = strstr(url, "/expire/")) != NULL)
+        param += 8;
+    if (param) {
+        long long expire = strtoll(param, NULL, 10);
+        long long remaining = expire - (long long)time(NULL) - MPVS_YTDL_EXPIRY_MARGIN;
+        if (expire > 0)
+            expires = util_min(expires, now + (uint64_t)util_max(remaining, 0) * 1000000000ULL);
+    }
+    return expires;
+}
+
+static void mpvs_ytdl_add_headers(struct dstr* headers, obs_data_t* obj)
+{
+    obs_data_t* list = obs_data_get_obj(obj, "http_headers");
+    if (!list)
+        return;
+    for (obs_data_item_t* item = obs_data_first(list); item; obs_data_item_next(&item)) {
+        if (obs_data_item_gettype(item) != OBS_DATA_STRING)
+            continue;
+        // strlist entries are separated by newlines
+        dstr_catf(headers, "%s: %s\n", obs_data_item_get_name(item), obs_data_item_get_string(item));
+    }
+    obs_data_release(list);
+}
+
+// turns yt-dlp's JSON into an edl:// URL with one stream per format
+static bool mpvs_ytdl_parse(obs_data_t* info, struct mpvs_ytdl_entry* entry)
+{
+    struct dstr edl = { 0 };
+    struct dstr headers = { 0 };
+    dstr_copy(&edl, "edl://");
+    uint64_t expires = UINT64_MAX;
+
+    obs_data_array_t* formats = obs_data_get_array(info, "requested_formats");
+    size_t count = obs_data_array_count(formats);
+    for (size_t i = 0; i < count; i++) {
+        obs_data_t* format = obs_data_array_item(formats, i);
+        const char* url = obs_data_get_string(format, "url");
+        if (*url) {
+            if (edl.len > 6)
+                dstr_cat(&edl, ";!new_stream;");
+            dstr_cat(&edl, "!no_clip;");
+            mpvs_edl_append(&edl, url);
+            expires = util_min(expires, mpvs_ytdl_expiry(url));
+            if (!headers.len)
+                mpvs_ytdl_add_headers(&headers, format);
+        }
+        obs_data_release(format);
+    }
+    obs_data_array_release(formats);
+
+    // a single format with audio and video
+    const char* url = obs_data_get_string(info, "url");
+    if (edl.len == 6 && *url) {
+        dstr_cat(&edl, "!no_clip;");
+        mpvs_edl_append(&edl, url);
+        expires = mpvs_ytdl_expiry(url);
+    }
+    if (!headers.len)
+        mpvs_ytdl_add_headers(&headers, info);
+
+    bool found = edl.len > 6;
+    if (found) {
+        entry->resolved = edl.array;
+        entry->format = bstrdup(obs_data_get_string(info, "format"));
+        entry->headers = headers.len ? strlist_split(headers.array, '\n', false) : NULL;
+        entry->expires_ns = expires;
+    } else {
+        dstr_free(&edl);
+    }
+    dstr_free(&headers);
+    return found;
+}
+
+#if defined(WIN32)
+// runs the command and appends what it prints to output, returns its exit
+// code or -1 if it couldn't be started or was killed
+static int mpvs_ytdl_exec(const char* cmd, struct dstr* output)
+{
+    SECURITY_ATTRIBUTES sa = { sizeof(sa), NULL, TRUE };
+    HANDLE read_pipe, write_pipe;
+    if (!CreatePipe(&read_pipe, &write_pipe, &sa, 0))
+        return -1;
+    SetHandleInformation(read_pipe, HANDLE_FLAG_INHERIT, 0);
+
+    STARTUPINFOW si = { sizeof(si) };
+    si.dwFlags = STARTF_USESTDHANDLES;
+    si.hStdOutput = write_pipe;
+    si.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+    PROCESS_INFORMATION pi = { 0 };
+
+    // the job kills the resolver and every process it started
+    HANDLE job = CreateJobObjectW(NULL, NULL);
+    wchar_t* wcmd = NULL;
+    os_utf8_to_wcs_ptr(cmd, 0, &wcmd);
+    BOOL started = job && wcmd && CreateProcessW(NULL, wcmd, NULL, NULL, TRUE, CREATE_NO_WINDOW | CREATE_SUSPENDED, NULL, NULL, &si, &pi);
+    bfree(wcmd);
+    CloseHandle(write_pipe);
+    if (!started) {
+        CloseHandle(read_pipe);
+        if (job)
+            CloseHandle(job);
+        return -1;
+    }
+    AssignProcessToJobObject(job, pi.hProcess);
+    ResumeThread(pi.hThread);
+    CloseHandle(pi.hThread);
+
+    uint64_t start = os_gettime_ns();
+    bool killed = false;
+    char buf[4096];
+    while (true) {
+        if (ytdl.stop || os_gettime_ns() - start > ytdl.timeout_ns) {
+            TerminateJobObject(job, 1);
+            killed = true;
+            break;
+        }
+        DWORD available = 0, len = 0;
+        // fails once the resolver exited and closed its end of the pipe
+        if (!PeekNamedPipe(read_pipe, NULL, 0, NULL, &available, NULL))
+            break;
+        if (!available) {
+            os_sleep_ms(MPVS_YTDL_POLL_MS);
+            continue;
+        }
+        if (!ReadFile(read_pipe, buf, sizeof(buf), &len, NULL) || len == 0)
+            break;
+        dstr_ncat(output, buf, len);
+    }
+
+    DWORD exit_code = 1;
+    WaitForSingleObject(pi.hProcess, INFINITE);
+    GetExitCodeProcess(pi.hProcess, &exit_code);
+    CloseHandle(pi.hProcess);
+    CloseHandle(read_pipe);
+    CloseHandle(job);
+    return killed ? -1 : (int)exit_code;
+}
+#else
+// runs the command and appends what it prints to output, returns its exit
+// code or -1 if it couldn't be started or was killed
+static int mpvs_ytdl_exec(const char* cmd, struct dstr* output)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+        return -1;
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, fds[0]);
+    posix_spawn_file_actions_addclose(&actions, fds[1]);
+
+    // the shell and the resolver get their own process group, so both are killed
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setpgroup(&attr, 0);
+
+    pid_t pid;
+    char* argv[] = { "sh", "-c", (char*)cmd, NULL };
+    int error = posix_spawn(&pid, "/bin/sh", &actions, &attr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    close(fds[1]);
+    if (error != 0) {
+        close(fds[0]);
+        return -1;
+    }
+
+    uint64_t start = os_gettime_ns();
+    bool killed = false;
+    char buf[4096];
+    while (true) {
+        if (ytdl.stop || os_gettime_ns() - start > ytdl.timeout_ns) {
+            kill(-pid, SIGKILL);
+            killed = true;
+            break;
+        }
+        struct pollfd fd = { fds[0], POLLIN, 0 };
+        int ready = poll(&fd, 1, MPVS_YTDL_POLL_MS);
+        if (ready < 0 && errno != EINTR)
+            break;
+        if (ready <= 0)
+            continue;
+        ssize_t len = read(fds[0], buf, sizeof(buf));
+        if (len <= 0)
+            break;
+        dstr_ncat(output, buf, (size_t)len);
+    }
+    close(fds[0]);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+        ;
+    return killed || !WIFEXITED(status) ? -1 : WEXITSTATUS(status);
+}
+#endif
+
+static obs_data_t* mpvs_ytdl_run(const char* url)
+{
+    struct dstr cmd = { 0 };
+    mpvs_ytdl_quote(&cmd, ytdl.resolver);
+    dstr_cat(&cmd, " -J --no-playlist --no-warnings -f");
+    mpvs_ytdl_quote(&cmd, ytdl.format);
+    dstr_cat(&cmd, " --");
+    mpvs_ytdl_quote(&cmd, url);
+
+    struct dstr output = { 0 };
+    uint64_t start = os_gettime_ns();
+    int exit_code = mpvs_ytdl_exec(cmd.array, &output);
+    dstr_free(&cmd);
+
+    obs_data_t* info = exit_code == 0 && output.len ? obs_data_create_from_json(output.array) : NULL;
+    if (!info && !ytdl.stop && os_gettime_ns() - start > ytdl.timeout_ns)
+        obs_log(LOG_WARNING, "%s didn't resolve %s within %llu s, killed it", ytdl.resolver, url, (unsigned long long)(ytdl.timeout_ns / 1000000000ULL));
+    else if (!info && !ytdl.stop)
+        obs_log(LOG_WARNING, "%s failed to resolve %s (exit code %d)", ytdl.resolver, url, exit_code);
+    dstr_free(&output);
+    return info;
+}
+
+static void* mpvs_ytdl_thread(void* data)
+{
+    UNUSED_PARAMETER(data);
+    os_set_thread_name("obs-mpv: ytdl");
+
+    while (os_sem_wait(ytdl.queue_sem) == 0 && !ytdl.stop) {
+        pthread_mutex_lock(&ytdl.mutex);
+        char* url = ytdl.queue.num ? ytdl.queue.array[0] : NULL;
+        if (url)
+            da_erase(ytdl.queue, 0);
+        pthread_mutex_unlock(&ytdl.mutex);
+        if (!url)
+            continue;
+
+        uint64_t start = os_gettime_ns();
+        obs_data_t* info = mpvs_ytdl_run(url);
+        struct mpvs_ytdl_entry result = { 0 };
+        bool resolved = info && mpvs_ytdl_parse(info, &result);
+        obs_data_release(info);
+        uint64_t duration = os_gettime_ns() - start;
+
+        pthread_mutex_lock(&ytdl.mutex);
+        struct mpvs_ytdl_entry* entry = mpvs_ytdl_find_locked(url);
+        if (entry) {
+            mpvs_ytdl_clear_entry(entry);
+            entry->resolved = result.resolved;
+            entry->format = result.format;
+            entry->headers = result.headers;
+            entry->expires_ns = result.expires_ns;
+            entry->resolving = false;
+        } else {
+            mpvs_ytdl_clear_entry(&result);
+        }
+        ytdl.resolves++;
+        ytdl.failures += resolved ? 0 : 1;
+        ytdl.last_resolve_ns = duration;
+        if (resolved && entry)
+            obs_log(LOG_INFO, "Resolved %s in %.1f s (format %s, valid for %.0f min)", url, duration / 1000000000.0, entry->format ? entry->format : "unknown",
+                (entry->expires_ns - os_gettime_ns()) / 60000000000.0);
+        pthread_mutex_unlock(&ytdl.mutex);
+        bfree(url);
+    }
+    return NULL;
+}
+
+/* Module functions -------------------------------------------------------- */
+
+void mpvs_ytdl_init(void)
+{
+    char* path = obs_module_config_path(MPVS_YTDL_CONFIG_FILE);
+    obs_data_t* config = obs_data_create_from_json_file_safe(path, "bak");
+    if (!config) {
+        char* dir = obs_module_config_path("");
+        os_mkdirs(dir);
+        bfree(dir);
+        config = obs_data_create();
+        obs_data_set_string(config, "resolver", MPVS_YTDL_DEFAULT_RESOLVER);
+        obs_data_set_string(config, "format", MPVS_YTDL_DEFAULT_FORMAT);
+        obs_data_set_int(config, "ttl_minutes", MPVS_YTDL_DEFAULT_TTL_MINUTES);
+        obs_data_set_int(config, "timeout_seconds", MPVS_YTDL_DEFAULT_TIMEOUT_SECONDS);
+        obs_data_save_json_safe(config, path, "tmp", "bak");
+    }
+    obs_data_set_default_string(config, "resolver", MPVS_YTDL_DEFAULT_RESOLVER);
+    obs_data_set_default_string(config, "format", MPVS_YTDL_DEFAULT_FORMAT);
+    obs_data_set_default_int(config, "ttl_minutes", MPVS_YTDL_DEFAULT_TTL_MINUTES);
+    obs_data_set_default_int(config, "timeout_seconds", MPVS_YTDL_DEFAULT_TIMEOUT_SECONDS);
+    ytdl.resolver = bstrdup(obs_data_get_string(config, "resolver"));
+    ytdl.format = bstrdup(obs_data_get_string(config, "format"));
+    ytdl.ttl_ns = (uint64_t)util_max(obs_data_get_int(config, "ttl_minutes"), 1) * 60 * 1000000000ULL;
+    ytdl.timeout_ns = (uint64_t)util_max(obs_data_get_int(config, "timeout_seconds"), 1) * 1000000000ULL;
+    obs_data_release(config);
+    bfree(path);
+
+    os_sem_init(&ytdl.queue_sem, 0);
+    ytdl.stop = false;
+    ytdl.thread_created = pthread_create(&ytdl.thread, NULL, mpvs_ytdl_thread, NULL) == 0;
+    if (!ytdl.thread_created)
+        obs_log(LOG_ERROR, "Failed to start ytdl resolver thread");
+}
+
+void mpvs_ytdl_free(void)
+{
+    if (ytdl.thread_created) {
+        // a running resolver is killed
+        ytdl.stop = true;
+        os_sem_post(ytdl.queue_sem);
+        pthread_join(ytdl.thread, NULL);
+        ytdl.thread_created = false;
+    }
+    os_sem_destroy(ytdl.queue_sem);
+
+    for (size_t i = 0; i < ytdl.entries.num; i++) {
+        mpvs_ytdl_clear_entry(&ytdl.entries.array[i]);
+        bfree(ytdl.entries.array[i].url);
+    }
+    da_free(ytdl.entries);
+    for (size_t i = 0; i < ytdl.queue.num; i++)
+        bfree(ytdl.queue.array[i]);
+    da_free(ytdl.queue);
+    bfree(ytdl.resolver);
+    bfree(ytdl.format);
+    ytdl.resolver = NULL;
+    ytdl.format = NULL;
+}
+
+bool mpvs_ytdl_is_page(const char* path)
+{
+    // links straight to media files are played as they are
+    return mpvs_http_is_url(path) && !mpvs_is_media_file(path);
+}
+
+// drops pages whose URLs expired or failed to resolve, and the least recently
+// used ones if there are still too many. Pages that are being resolved stay.
+static void mpvs_ytdl_evict_locked(void)
+{
+    uint64_t now = os_gettime_ns();
+    for (size_t i = ytdl.entries.num; i > 0; i--) {
+        struct mpvs_ytdl_entry* entry = &ytdl.entries.array[i - 1];
+        if (entry->resolving || (entry->resolved && now < entry->expires_ns))
+            continue;
+        mpvs_ytdl_clear_entry(entry);
+        bfree(entry->url);
+        da_erase(ytdl.entries, i - 1);
+    }
+
+    while (ytdl.entries.num >= MPVS_YTDL_MAX_ENTRIES) {
+        size_t oldest = SIZE_MAX;
+        for (size_t i = 0; i < ytdl.entries.num; i++) {
+            struct mpvs_ytdl_entry* entry = &ytdl.entries.array[i];
+            if (!entry->resolving && (oldest == SIZE_MAX || entry->used_ns < ytdl.entries.array[oldest].used_ns))
+                oldest = i;
+        }
+        if (oldest == SIZE_MAX)
+            break;
+        mpvs_ytdl_clear_entry(&ytdl.entries.array[oldest]);
+        bfree(ytdl.entries.array[oldest].url);
+        da_erase(ytdl.entries, oldest);
+    }
+}
+
+static void mpvs_ytdl_queue_locked(const char* url)
+{
+    struct mpvs_ytdl_entry* entry = mpvs_ytdl_find_locked(url);
+    if (!entry) {
+        mpvs_ytdl_evict_locked();
+        struct mpvs_ytdl_entry new_entry = { bstrdup(url) };
+        entry = da_push_back_new(ytdl.entries);
+        *entry = new_entry;
+    }
+    entry->used_ns = os_gettime_ns();
+    if (entry->resolving || mpvs_ytdl_fresh(entry))
+        return;
+
+    entry->resolving = true;
+    char* p = bstrdup(url);
+    da_push_back(ytdl.queue, &p);
+    os_sem_post(ytdl.queue_sem);
+}
+
+void mpvs_ytdl_queue(const char* url)
+{
+    if (!ytdl.thread_created)
+        return;
+    pthread_mutex_lock(&ytdl.mutex);
+    mpvs_ytdl_queue_locked(url);
+    pthread_mutex_unlock(&ytdl.mutex);
+}
+
+/* Hooks ------------------------------------------------------------------- */
+
+void mpvs_ytdl_register(struct mpv_source* context)
+{
+    // mpv can't remove hooks, once the setting is turned off they continue
+    // right away in mpvs_ytdl_handle_hook
+    if (!context->mpv || !context->ytdl_cache || context->ytdl_hooked)
+        return;
+    context->ytdl_hooked = true;
+    mpv_hook_add(context->mpv, MPVS_YTDL_HOOK, "on_load", MPVS_YTDL_HOOK_PRIORITY);
+    mpv_hook_add(context->mpv, MPVS_YTDL_HOOK, "on_load_fail", MPVS_YTDL_HOOK_PRIORITY);
+}
+
+// passes the resolved URL to mpv and lets it continue loading, returns false
+// if the URL is still being resolved
+static bool mpvs_ytdl_apply(struct mpv_source* context)
+{
+    pthread_mutex_lock(&ytdl.mutex);
+    struct mpvs_ytdl_entry* entry = mpvs_ytdl_find_locked(context->ytdl_hook_url);
+    if (entry && entry->resolving) {
+        pthread_mutex_unlock(&ytdl.mutex);
+        return false;
+    }
+
+    if (entry && entry->resolved) {
+        mpv_set_property_string(context->mpv, "stream-open-filename", entry->resolved);
+        if (entry->headers) {
+            size_t count = 0;
+            while (entry->headers[count])
+                count++;
+            mpv_node* values = bzalloc(count * sizeof(mpv_node));
+            for (size_t i = 0; i < count; i++) {
+                values[i].format = MPV_FORMAT_STRING;
+                values[i].u.string = entry->headers[i];
+            }
+            mpv_node_list list = { (int)count, values, NULL };
+            mpv_node node = { .format = MPV_FORMAT_NODE_ARRAY, .u.list = &list };
+            mpv_set_property(context->mpv, "file-local-options/http-header-fields", MPV_FORMAT_NODE, &node);
+            bfree(values);
+        }
+        entry->used_ns = os_gettime_ns();
+        ytdl.hits++;
+    }
+    pthread_mutex_unlock(&ytdl.mutex);
+
+    // if resolving failed mpv opens the page itself, which might still work
+    mpv_hook_continue(context->mpv, context->ytdl_hook_id);
+    context->ytdl_hook_pending = false;
+    return true;
+}
+
+void mpvs_ytdl_handle_hook(struct mpv_source* context, mpv_event_hook* hook)
+{
+    char* path = context->ytdl_cache ? mpv_get_property_string(context->mpv, "path") : NULL;
+    if (!path || !mpvs_ytdl_is_page(path)) {
+        mpv_free(path);
+        mpv_hook_continue(context->mpv, hook->id);
+        return;
+    }
+
+    bool retry = false;
+    if (strcmp(hook->name, "on_load_fail") == 0) {
+        // the stream URL was cached but stopped working, it's only resolved
+        // again once per load so a broken page doesn't loop forever
+        char* stream = mpv_get_property_string(context->mpv, "stream-open-filename");
+        pthread_mutex_lock(&ytdl.mutex);
+        struct mpvs_ytdl_entry* entry = mpvs_ytdl_find_locked(path);
+        retry = entry && entry->resolved && stream && strcmp(entry->resolved, stream) == 0 && !context->ytdl_retried;
+        if (retry) {
+            obs_log(LOG_INFO, "[%s] Resolved URL of %s failed, resolving it again", obs_source_get_name(context->src), path);
+            mpvs_ytdl_clear_entry(entry);
+        }
+        pthread_mutex_unlock(&ytdl.mutex);
+        mpv_free(stream);
+
+        if (!retry) {
+            mpv_free(path);
+            mpv_hook_continue(context->mpv, hook->id);
+            return;
+        }
+    }
+    context->ytdl_retried = retry;
+
+    bfree(context->ytdl_hook_url);
+    context->ytdl_hook_url = bstrdup(path);
+    context->ytdl_hook_id = hook->id;
+    context->ytdl_hook_pending = true;
+    mpv_free(path);
+
+    if (ytdl.thread_created) {
+        pthread_mutex_lock(&ytdl.mutex);
+        mpvs_ytdl_queue_locked(context->ytdl_hook_url);
+        pthread_mutex_unlock(&ytdl.mutex);
+    }
+    mpvs_ytdl_apply(context);
+}
+
+void mpvs_ytdl_tick(struct mpv_source* context)
+{
+    if (context->ytdl_hook_pending && context->mpv)
+        mpvs_ytdl_apply(context);
+}
+
+void mpvs_ytdl_get_stats(obs_data_t* stats)
+{
+    pthread_mutex_lock(&ytdl.mutex);
+    obs_data_set_int(stats, "ytdl_resolves", (long long)ytdl.resolves);
+    obs_data_set_int(stats, "ytdl_failures", (long long)ytdl.failures);
+    obs_data_set_int(stats, "ytdl_hits", (long long)ytdl.hits);
+    obs_data_set_double(stats, "ytdl_last_resolve_ms", ytdl.last_resolve_ns / 1000000.0);
+    pthread_mutex_unlock(&ytdl.mutex);
+}
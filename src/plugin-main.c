@@ -16,6 +16,7 @@ You should have received a copy of the GNU General Public License along
 with this program. If not, see <https://www.gnu.org/licenses/>
 */
 
+#include "mpv-backend.h"
 #include "wgl.h"
 #include <glad/glad.h>
 #include <glad/glad_egl.h>
@@ -68,12 +69,19 @@ bool obs_module_load(void)
     gladLoadEGL();
 #endif
     obs_register_source(&mpv_source_info);
+    mpvs_reaper_init();
+    mpvs_watchdog_init();
+    mpvs_cache_init();
+    mpvs_http_init();
+    mpvs_ytdl_init();
+    mpvs_probe_init();
     obs_log(LOG_INFO, "plugin loaded successfully (version %s)",
         PLUGIN_VERSION);
 
     obs_enter_graphics();
     obs_device_type = gs_get_device_type();
     obs_leave_graphics();
+    mpvs_shader_cache_init();
     return true;
 }
 
@@ -85,6 +93,17 @@ void obs_module_post_load()
 void obs_module_unload(void)
 {
     obs_log(LOG_INFO, "plugin unloaded");
+    mpvs_probe_free();
+    mpvs_ytdl_free();
+    mpvs_shader_cache_free();
+    mpvs_image_wait();
+    mpvs_bundle_wait();
+    // cores that still hang can open and read http streams, so the http
+    // state is only freed once every core was destroyed
+    if (mpvs_reaper_free())
+        mpvs_http_free();
+    mpvs_watchdog_free();
+    mpvs_cache_free();
 #if defined(WIN32)
     if (obs_device_type == GS_DEVICE_DIRECT3D_11)
         wgl_deinit();